@@ -448,6 +448,74 @@ JNIEXPORT void JNICALL Java_org_apache_qpid_proton_jni_ProtonJNI_pn_1bytes_1from
 %}
 
 
+// one JNI crossing moves a whole batch, the arrays hold
+// SWIGTYPE_p_pn_message_t proxies
+%native (pn_messenger_put_batch) int pn_messenger_put_batch(pn_messenger_t *, jobjectArray);
+%native (pn_messenger_get_batch) int pn_messenger_get_batch(pn_messenger_t *, jobjectArray);
+%{
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the proxies SWIG generates for pn_message_t keep the pointer in a
+// private swigCPtr field
+static pn_message_t *message_from_proxy(JNIEnv *jenv, jobject proxy)
+{
+    if (!proxy) return NULL;
+    jclass cls = JCALL1(GetObjectClass, jenv, proxy);
+    jfieldID fid = JCALL3(GetFieldID, jenv, cls, "swigCPtr", "J");
+    jlong ptr = JCALL2(GetLongField, jenv, proxy, fid);
+    JCALL1(DeleteLocalRef, jenv, cls);
+    return *(pn_message_t **)&ptr;
+}
+
+static pn_message_t **messages_from_array(JNIEnv *jenv, jobjectArray array, jsize n)
+{
+    pn_message_t **msgs = (pn_message_t **) malloc((n ? n : 1)*sizeof(pn_message_t *));
+    if (!msgs) return NULL;
+    jsize i = 0;
+    for(i=0;i<n;i++)
+    {
+      jobject proxy = JCALL2(GetObjectArrayElement, jenv, array, i);
+      msgs[i] = message_from_proxy(jenv, proxy);
+      JCALL1(DeleteLocalRef, jenv, proxy);
+    }
+    return msgs;
+}
+
+JNIEXPORT jint JNICALL Java_org_apache_qpid_proton_jni_ProtonJNI_pn_1messenger_1put_1batch(JNIEnv *jenv, jclass jcls,
+                                                              jlong jarg1, jobjectArray jarg2)
+{
+    pn_messenger_t *m = *(pn_messenger_t **)&jarg1;
+    jsize n = jarg2 ? get_array_length(jenv, jarg2) : 0;
+    pn_message_t **msgs = messages_from_array(jenv, jarg2, n);
+    if (!msgs) return PN_ERR;
+    jint rval = pn_messenger_put_batch(m, msgs, n);
+    free(msgs);
+    return rval;
+}
+
+JNIEXPORT jint JNICALL Java_org_apache_qpid_proton_jni_ProtonJNI_pn_1messenger_1get_1batch(JNIEnv *jenv, jclass jcls,
+                                                              jlong jarg1, jobjectArray jarg2)
+{
+    pn_messenger_t *m = *(pn_messenger_t **)&jarg1;
+    jsize n = jarg2 ? get_array_length(jenv, jarg2) : 0;
+    pn_message_t **msgs = messages_from_array(jenv, jarg2, n);
+    if (!msgs) return PN_ERR;
+    jint rval = pn_messenger_get_batch(m, msgs, n);
+    free(msgs);
+    return rval;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+%}
+%ignore pn_messenger_put_batch;
+%ignore pn_messenger_get_batch;
+
 
 int  pn_transport_push(pn_transport_t *transport, char *DATA, size_t SIZE);
 %ignore pn_transport_push;
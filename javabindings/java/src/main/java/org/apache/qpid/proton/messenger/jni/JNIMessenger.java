@@ -60,6 +60,27 @@ class JNIMessenger implements Messenger
         int err = Proton.pn_messenger_put(_impl, message_t);
         check(err);
     }
+
+    /**
+     * Puts several messages with a single native call, see
+     * pn_messenger_put_batch.
+     */
+    public void put(final Message[] messages) throws MessengerException
+    {
+        SWIGTYPE_p_pn_message_t[] batch = new SWIGTYPE_p_pn_message_t[messages.length];
+        for (int i = 0; i < messages.length; i++)
+        {
+            final Message message = messages[i];
+            batch[i] = (message instanceof JNIMessage) ? ((JNIMessage)message).getImpl() : convertMessage(message);
+        }
+        int n = Proton.pn_messenger_put_batch(_impl, batch);
+        check(n);
+        if (n < messages.length)
+        {
+            throw new MessengerException(Proton.pn_error_text(Proton.pn_messenger_error(_impl)));
+        }
+    }
+
     private SWIGTYPE_p_pn_message_t convertMessage(final Message message)
     {
         int length = 512;
@@ -127,6 +148,39 @@ class JNIMessenger implements Messenger
         return new JNIMessage(msg);
     }
 
+    /**
+     * Gets up to messages.length messages with a single native call,
+     * see pn_messenger_get_batch.
+     *
+     * @return the number of messages stored at the front of the array
+     */
+    public int get(final Message[] messages)
+    {
+        SWIGTYPE_p_pn_message_t[] batch = new SWIGTYPE_p_pn_message_t[messages.length];
+        for (int i = 0; i < batch.length; i++)
+        {
+            batch[i] = Proton.pn_message();
+        }
+        int n = Proton.pn_messenger_get_batch(_impl, batch);
+        int got = n > 0 ? n : 0;
+        for (int i = 0; i < batch.length; i++)
+        {
+            if (i < got)
+            {
+                messages[i] = new JNIMessage(batch[i]);
+            }
+            else
+            {
+                Proton.pn_message_free(batch[i]);
+            }
+        }
+        if (n != Proton.PN_EOS)
+        {
+            check(n);
+        }
+        return got;
+    }
+
     @Override
     public void start() throws IOException
     {
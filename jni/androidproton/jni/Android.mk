@@ -47,7 +47,10 @@ src/messenger/messenger.c \
 src/messenger/transform.c \
 src/messenger/subscription.c \
 src/messenger/store.c \
+src/messenger/journal.c \
+src/messenger/sharded.c \
 src/object/object.c \
+src/events/event.c \
 src/javaJAVA_wrap.c    #INCLUDED 6/10 TO TRY SWIG BINDINGS.
 LOCAL_SHARED_LIBRARIES += crypto-prebuilt \
 ssl-prebuilt
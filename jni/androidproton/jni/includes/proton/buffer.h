@@ -44,6 +44,10 @@ PN_EXTERN int pn_buffer_trim(pn_buffer_t *buf, size_t left, size_t right);
 PN_EXTERN void pn_buffer_clear(pn_buffer_t *buf);
 PN_EXTERN int pn_buffer_defrag(pn_buffer_t *buf);
 PN_EXTERN pn_bytes_t pn_buffer_bytes(pn_buffer_t *buf);
+PN_EXTERN pn_bytes_t pn_buffer_space(pn_buffer_t *buf);
+PN_EXTERN int pn_buffer_commit(pn_buffer_t *buf, size_t size);
+PN_EXTERN void pn_buffer_swap(pn_buffer_t *a, pn_buffer_t *b);
+PN_EXTERN int pn_buffer_slices(pn_buffer_t *buf, pn_bytes_t *slices, int max);
 PN_EXTERN int pn_buffer_print(pn_buffer_t *buf);
 
 #ifdef __cplusplus
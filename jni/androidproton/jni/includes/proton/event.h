@@ -0,0 +1,137 @@
+#ifndef PROTON_EVENT_H
+#define PROTON_EVENT_H 1
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <proton/import_export.h>
+#include <proton/engine.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @file
+ * Event API for the proton Engine.
+ *
+ * A collector is attached to a connection with
+ * ::pn_connection_collect. From then on the engine records an event
+ * in the collector whenever it changes the state of the connection
+ * or of one of its sessions, links or deliveries. Events are
+ * consumed in the order they were recorded with ::pn_collector_peek
+ * and ::pn_collector_pop, so an application only needs to look at
+ * the objects that actually changed rather than walking the work
+ * and endpoint lists.
+ */
+
+typedef struct pn_collector_t pn_collector_t; /**< Collector */
+typedef struct pn_event_t pn_event_t;         /**< Event */
+
+typedef enum {
+  PN_EVENT_NONE = 0,
+  PN_CONNECTION_STATE = 1,  /**< remote connection state changed */
+  PN_SESSION_STATE = 2,     /**< remote session state changed */
+  PN_LINK_STATE = 4,        /**< remote link state changed */
+  PN_LINK_FLOW = 8,         /**< link credit or drain state changed */
+  PN_DELIVERY = 16,         /**< delivery is readable or updated */
+  PN_TRANSPORT = 32         /**< transport has pending work */
+} pn_event_type_t;
+
+/** Get a human readable name for an event type.
+ *
+ * @param[in] type an event type
+ * @return the name of the event type
+ */
+PN_EXTERN const char *pn_event_type_name(pn_event_type_t type);
+
+/** Construct a new, empty collector.
+ *
+ * @return pointer to a new collector
+ */
+PN_EXTERN pn_collector_t *pn_collector(void);
+
+/** Free a collector along with any events it still holds. Every
+ * connection recording into the collector must first be freed or
+ * detached with ::pn_connection_collect.
+ *
+ * @param[in] collector the collector to free, no longer valid on
+ *                      return
+ */
+PN_EXTERN void pn_collector_free(pn_collector_t *collector);
+
+/** Access the oldest event held by a collector. The event remains
+ * valid until the next call to ::pn_collector_pop or
+ * ::pn_collector_free.
+ *
+ * @param[in] collector the collector
+ * @return the oldest event, or NULL if the collector is empty
+ */
+PN_EXTERN pn_event_t *pn_collector_peek(pn_collector_t *collector);
+
+/** Discard the oldest event held by a collector.
+ *
+ * @param[in] collector the collector
+ * @return true if an event was discarded, false if the collector
+ *         was empty
+ */
+PN_EXTERN bool pn_collector_pop(pn_collector_t *collector);
+
+/** Start recording the events of a connection into a collector. A
+ * collector may be shared by any number of connections. Passing a
+ * NULL collector stops recording.
+ *
+ * @param[in] connection the connection
+ * @param[in] collector the collector, or NULL
+ */
+PN_EXTERN void pn_connection_collect(pn_connection_t *connection, pn_collector_t *collector);
+
+PN_EXTERN pn_event_type_t pn_event_type(pn_event_t *event);
+
+/** Access the connection an event relates to. Every event has a
+ * connection.
+ */
+PN_EXTERN pn_connection_t *pn_event_connection(pn_event_t *event);
+
+/** Access the session an event relates to, or NULL for connection
+ * and transport events.
+ */
+PN_EXTERN pn_session_t *pn_event_session(pn_event_t *event);
+
+/** Access the link an event relates to, or NULL for connection,
+ * session and transport events.
+ */
+PN_EXTERN pn_link_t *pn_event_link(pn_event_t *event);
+
+/** Access the delivery of a ::PN_DELIVERY event, or NULL for any
+ * other event.
+ */
+PN_EXTERN pn_delivery_t *pn_event_delivery(pn_event_t *event);
+
+/** Access the transport of a ::PN_TRANSPORT event, or NULL for any
+ * other event.
+ */
+PN_EXTERN pn_transport_t *pn_event_transport(pn_event_t *event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* event.h */
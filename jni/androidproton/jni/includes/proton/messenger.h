@@ -24,6 +24,7 @@
 
 #include <proton/import_export.h>
 #include <proton/message.h>
+#include <proton/stats.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -49,6 +50,25 @@ typedef enum {
   PN_STATUS_SETTLED = 7
 } pn_status_t;
 
+/** Callback invoked when the status of an outgoing message changes,
+ * see pn_messenger_set_tracker_callback.
+ */
+typedef void (*pn_tracker_callback_t)(pn_messenger_t *messenger,
+                                      pn_tracker_t tracker,
+                                      pn_status_t status,
+                                      void *context);
+
+/** How messages outside any group are spread over the connections
+ * to a destination, see pn_messenger_set_stripes.
+ */
+typedef enum {
+  PN_STRIPE_ROUND_ROBIN, /**< each connection in turn */
+  PN_STRIPE_LEAST_BYTES  /**< the connection with the least bytes waiting */
+} pn_stripe_mode_t;
+
+/** The most connections a messenger opens to one destination. */
+#define PN_STRIPES_MAX (64)
+
 /** Construct a new Messenger with the given name. The name is global.
  * If a NULL name is supplied, a UUID based name will be chosen.
  *
@@ -258,6 +278,146 @@ PN_EXTERN int pn_messenger_get_incoming_window(pn_messenger_t *messenger);
  */
 PN_EXTERN int pn_messenger_set_incoming_window(pn_messenger_t *messenger, int window);
 
+/** Returns the drain latency set with pn_messenger_set_drain_latency.
+ *
+ * @param[in] messenger the messenger
+ *
+ * @return the drain latency in milliseconds
+ */
+PN_EXTERN int pn_messenger_get_drain_latency(pn_messenger_t *messenger);
+
+/** When receivers are waiting for credit and none is left, the
+ * messenger waits this long before asking the receivers holding
+ * credit to hand back what they have not used. The default is 250
+ * milliseconds, zero drains as soon as a receiver is starved.
+ *
+ * @param[in] messenger the messenger
+ * @param[in] latency the drain latency in milliseconds
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_messenger_set_drain_latency(pn_messenger_t *messenger, int latency);
+
+/** Keeps a durable copy of every outgoing message in a journal in
+ * the given directory, created if need be, so that messages survive
+ * the application crashing. A message is dropped from the journal
+ * once the peer reports an outcome for it, or once it is sent when it
+ * is outside the outgoing window. Messages left in the journal by a
+ * previous run are put back in the outgoing queue, in their original
+ * order, before this returns. Set the journal before the first put.
+ * The journal is kept in segments of a few MB that are deleted oldest
+ * first once every message in them is dropped, so a message that
+ * never gets an outcome, e.g. one to an address that cannot be
+ * reached, keeps all later segments on disk until it does.
+ *
+ * @param[in] messenger the messenger
+ * @param[in] directory the journal directory
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_messenger_set_journal(pn_messenger_t *messenger, const char *directory);
+
+/** Controls how often the journal is synced to disk. Messages are
+ * group committed once the given number of milliseconds has passed
+ * since the first one not yet synced, or once the given number of
+ * bytes is waiting, whichever comes first; a message is not durable
+ * until then. A latency of zero syncs every message. The default is
+ * 10 milliseconds and 1MB.
+ *
+ * @param[in] messenger the messenger
+ * @param[in] latency the sync latency in milliseconds
+ * @param[in] size the sync size in bytes
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_messenger_set_journal_sync(pn_messenger_t *messenger, int latency, size_t size);
+
+/** Spreads the messages sent to each destination over the given
+ * number of connections, each with its own link, instead of one, so
+ * that a busy address is not limited to a single TCP stream. Messages
+ * with the same group id (see ::pn_message_set_group_id) always use
+ * the same connection and so arrive in the order they were put; the
+ * others are spread according to the given mode. Connections are
+ * opened as they are first needed. The default is a single
+ * connection. Set this before the first put.
+ *
+ * @param[in] messenger the messenger
+ * @param[in] stripes the number of connections, 1 up to PN_STRIPES_MAX
+ * @param[in] mode how to pick a connection for messages outside a group
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_messenger_set_stripes(pn_messenger_t *messenger, int stripes, pn_stripe_mode_t mode);
+
+/** Redials connections that are lost without the messenger closing
+ * them. The first attempt is made after the given delay, each failed
+ * attempt doubles it up to the given maximum, and every delay is
+ * jittered over its latter half so that the clients of a restarted
+ * peer do not all return at once. Links are reopened, credit is
+ * handed out to subscriptions afresh, and outgoing messages that were
+ * sent but not yet settled by the peer are sent again in their
+ * original order, so such messages are delivered at least once and
+ * may arrive twice. Only messages inside the outgoing window (see
+ * ::pn_messenger_set_outgoing_window) or in the journal (see
+ * ::pn_messenger_set_journal) are held for this; the others are
+ * settled as soon as they are sent. Until a lost destination is
+ * redialled nothing else dials it, messages put to it meanwhile wait
+ * for the redial. A delay of zero, the default, turns reconnection
+ * off.
+ *
+ * @param[in] messenger the messenger
+ * @param[in] delay milliseconds before the first attempt
+ * @param[in] max_delay the longest delay between attempts
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_messenger_set_reconnect(pn_messenger_t *messenger, int delay, int max_delay);
+
+/** The steps of a message through a messenger that can be timed, see
+ * ::pn_messenger_latency.
+ */
+typedef enum {
+  PN_LATENCY_QUEUED = 0,   /**< from put until a delivery is made for it */
+  PN_LATENCY_TRANSFER = 1, /**< from then until its first transfer frame is written */
+  PN_LATENCY_OUTCOME = 2,  /**< from then until the peer's outcome arrives */
+  PN_LATENCY_TOTAL = 3,    /**< from put until the peer's outcome arrives */
+  PN_LATENCY_RECEIVE = 4   /**< from arrival until it is got by the application */
+} pn_latency_t;
+
+#define PN_LATENCY_CT (PN_LATENCY_RECEIVE + 1)
+
+/** Times messages on their way through the messenger, see
+ * ::pn_latency_t, recording each step in a histogram for the
+ * messenger as a whole and another for the address. Messages are
+ * timed from when they are put or received after this is turned on.
+ * The steps up to the peer's outcome are only timed for messages
+ * inside the outgoing window, the others are settled as soon as
+ * they are sent. Histograms are kept for every address used while
+ * timing, until the messenger is freed. Off by default.
+ *
+ * @param[in] messenger the messenger
+ * @param[in] enabled whether to time messages
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_messenger_set_latency(pn_messenger_t *messenger, bool enabled);
+
+/** Takes a snapshot of the latencies recorded for one step, in
+ * microseconds. Outgoing messages are counted under the address they
+ * were put to, incoming ones under the source address of the link
+ * they arrived on.
+ *
+ * @param[in] messenger the messenger
+ * @param[in] address the address, or NULL for the whole messenger
+ * @param[in] step the step
+ * @param[out] histogram filled in with what was recorded, cleared if
+ * nothing was
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_messenger_latency(pn_messenger_t *messenger, const char *address,
+                                   pn_latency_t step, pn_histogram_t *histogram);
+
 /** Currently a no-op placeholder.
  * For future compatibility, do not send or receive messages
  * before starting the messenger.
@@ -305,9 +465,33 @@ PN_EXTERN void pn_subscription_set_context(pn_subscription_t *sub, void *context
 
 PN_EXTERN const char *pn_subscription_address(pn_subscription_t *sub);
 
+/** Returns the credit weight of a subscription, see
+ * pn_subscription_set_weight. The default is 1.
+ *
+ * @param[in] sub the subscription
+ *
+ * @return the weight
+ */
+PN_EXTERN int pn_subscription_get_weight(pn_subscription_t *sub);
+
+/** Sets the credit weight of a subscription. Whenever the messenger
+ * hands out credit, receivers for a subscription of weight w are
+ * offered w times the share of a receiver of weight 1, so higher
+ * weighted sources get proportionally more of the incoming flow.
+ *
+ * @param[in] sub the subscription
+ * @param[in] weight the weight, at least 1
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_subscription_set_weight(pn_subscription_t *sub, int weight);
+
 /** Puts the message onto the messenger's outgoing queue.
  * The message may also be sent if transmission would not cause
- * blocking.  This call will not block.
+ * blocking.  This call will not block, unless the outgoing queue is
+ * full (see ::pn_messenger_set_outgoing_limit) and the messenger is
+ * blocking, in which case it waits up to the messenger's timeout for
+ * room. A put that finds no room fails with PN_OVERFLOW.
  *
  * @param[in] messenger the messenger
  * @param[in] msg the message to put on the outgoing queue
@@ -317,6 +501,105 @@ PN_EXTERN const char *pn_subscription_address(pn_subscription_t *sub);
  */
 PN_EXTERN int pn_messenger_put(pn_messenger_t *messenger, pn_message_t *msg);
 
+/** Puts several messages onto the messenger's outgoing queue, in
+ * order, as if by calling pn_messenger_put on each of them.
+ * Consecutive messages with the same address are rewritten and
+ * routed once, and their transfers are queued back to back on the
+ * same link. Afterwards the outgoing tracker refers to the last
+ * message put.
+ *
+ * @param[in] messenger the messenger
+ * @param[in] msgs the messages to put on the outgoing queue
+ * @param[in] n the number of messages
+ *
+ * @return the number of messages put, which is less than n only if
+ * one of them failed (see pn_messenger_error), or an error code if
+ * the first could not be put
+ * @see error.h
+ */
+PN_EXTERN int pn_messenger_put_batch(pn_messenger_t *messenger, pn_message_t **msgs, int n);
+
+/** Begins to put a message whose body is too large to hold in memory.
+ * The body, a single data section of the given size, is written with
+ * ::pn_messenger_stream_write as the link takes it, and the message
+ * is finished with ::pn_messenger_stream_end; the message itself must
+ * not have a body. Messages put earlier to the same address go first,
+ * and those put to it while the stream is open wait for it to end.
+ * Only one message can be streamed at a time. A streamed message is
+ * tracked like any other, see ::pn_messenger_outgoing_tracker, but is
+ * not journalled and not sent again after a reconnect.
+ *
+ * @param[in] messenger the messenger
+ * @param[in] msg the message, without a body
+ * @param[in] size the size of the body
+ *
+ * @return an error code or zero on success, PN_OVERFLOW if the
+ * messenger is non-blocking and earlier messages to the address are
+ * still waiting to go
+ * @see error.h
+ */
+PN_EXTERN int pn_messenger_stream_begin(pn_messenger_t *messenger, pn_message_t *msg, size_t size);
+
+/** Writes part of the body of the message being streamed. No more is
+ * taken than keeps the bytes waiting to be sent under the high water
+ * mark (see ::pn_messenger_set_stream_high_water). A blocking
+ * messenger waits, up to its timeout, for room to take something.
+ *
+ * @param[in] messenger the messenger
+ * @param[in] bytes the next part of the body
+ * @param[in] n the number of bytes
+ *
+ * @return the number of bytes taken, or an error code: PN_OVERFLOW if
+ * there is no room for any, PN_STATE_ERR if no message is being
+ * streamed or the connection it was going over was lost
+ * @see error.h
+ */
+PN_EXTERN ssize_t pn_messenger_stream_write(pn_messenger_t *messenger, const char *bytes, size_t n);
+
+/** Writes part of the body of the message being streamed from a
+ * region of a file. The region is not read here but as it is sent,
+ * and over a plain TCP connection it goes from the file to the socket
+ * without being copied (see ::pn_transport_set_sendfile), so it takes
+ * no memory whatever its size. The file must stay open and the region
+ * unchanged until the message's status is final. Once a region is
+ * written only one carrying on from it in the same file can be written
+ * until it has gone out.
+ *
+ * @param[in] messenger the messenger
+ * @param[in] fd the file to send from
+ * @param[in] offset where in the file the region starts
+ * @param[in] n the number of bytes in the region
+ *
+ * @return the number of bytes taken, or an error code: PN_STATE_ERR if
+ * no message is being streamed, the connection it was going over was
+ * lost, or the region does not carry on from one still pending
+ * @see error.h
+ */
+PN_EXTERN ssize_t pn_messenger_stream_write_fd(pn_messenger_t *messenger, int fd, off_t offset, size_t n);
+
+/** Finishes the message being streamed once its whole body has been
+ * written. Like ::pn_messenger_put this does not wait for the rest of
+ * it to be sent.
+ *
+ * @param[in] messenger the messenger
+ *
+ * @return an error code or zero on success, PN_STATE_ERR if no message
+ * is being streamed or not all of its body has been written
+ * @see error.h
+ */
+PN_EXTERN int pn_messenger_stream_end(pn_messenger_t *messenger);
+
+/** Sets how many bytes of a streamed message may wait to be sent, and
+ * so how much memory streaming takes whatever the size of the message.
+ * The default is 64KiB. It applies from the next stream begun.
+ *
+ * @param[in] messenger the messenger
+ * @param[in] bytes the high water mark
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_messenger_set_stream_high_water(pn_messenger_t *messenger, size_t bytes);
+
 /** Find the current delivery status of the outgoing message
  * associated with this tracker, as long as the message is still
  * within your outgoing window.within your outgoing window.
@@ -351,6 +634,25 @@ PN_EXTERN bool pn_messenger_buffered(pn_messenger_t *messenger, pn_tracker_t tra
  */
 PN_EXTERN int pn_messenger_settle(pn_messenger_t *messenger, pn_tracker_t tracker, int flags);
 
+/** Registers a callback to learn the outcome of outgoing messages
+ * without polling pn_messenger_status. The callback is invoked with
+ * the tracker and its new status whenever a message within the
+ * outgoing window is accepted, rejected, released, modified, aborted
+ * or settled by the peer. It is invoked from within the calls that
+ * do I/O, e.g. pn_messenger_send and pn_messenger_work, once the
+ * messenger is done updating its state. The callback may put and
+ * settle messages but must not call any of the calls that do I/O.
+ *
+ * @param[in] messenger the messenger
+ * @param[in] callback the callback or NULL to stop notifications
+ * @param[in] context passed through to the callback
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_messenger_set_tracker_callback(pn_messenger_t *messenger,
+                                                pn_tracker_callback_t callback,
+                                                void *context);
+
 /** Returns a tracker for the outgoing message most recently given
  * to pn_messenger_put.  Use this tracker with pn_messenger_status
  * to determine the delivery status of the message, as long as the
@@ -456,6 +758,21 @@ PN_EXTERN int pn_messenger_receiving(pn_messenger_t *messenger);
  */
 PN_EXTERN int pn_messenger_get(pn_messenger_t *messenger, pn_message_t *msg);
 
+/** Pop up to max of the oldest messages off your incoming message
+ * queue, as if by calling pn_messenger_get for each entry of msgs.
+ * Afterwards the incoming tracker refers to the last message popped.
+ *
+ * @param[in] messenger the messenger
+ * @param[out] msgs upon return the first entries contain the messages
+ * popped
+ * @param[in] max the number of entries in msgs
+ *
+ * @return the number of messages popped, PN_EOS if there were none,
+ * or an error code if the first could not be decoded
+ * @see error.h
+ */
+PN_EXTERN int pn_messenger_get_batch(pn_messenger_t *messenger, pn_message_t **msgs, int max);
+
 /** Returns a tracker for the message most recently fetched by
  * pn_messenger_get.  The tracker allows you to accept or reject its
  * message, or its message plus all prior messages that are still within
@@ -525,6 +842,64 @@ PN_EXTERN int pn_messenger_outgoing(pn_messenger_t *messenger);
  */
 PN_EXTERN int pn_messenger_incoming(pn_messenger_t *messenger);
 
+/** Returns the encoded size of the messages in the outgoing queue
+ * that have not yet been handed to a link.
+ *
+ * @param[in] messenger the Messenger
+ *
+ * @return the outgoing queue size in bytes
+ */
+PN_EXTERN size_t pn_messenger_outgoing_bytes(pn_messenger_t *messenger);
+
+/** Returns the encoded size of the messages received but not yet
+ * taken off the incoming queue with ::pn_messenger_get.
+ *
+ * @param[in] messenger the Messenger
+ *
+ * @return the incoming queue size in bytes
+ */
+PN_EXTERN size_t pn_messenger_incoming_bytes(pn_messenger_t *messenger);
+
+/** Limits the outgoing queue to the given number of messages and
+ * bytes, zero meaning no limit; there is none by default. A put to a
+ * full queue waits or fails, see ::pn_messenger_put. The byte limit
+ * is checked before a message is added, so the last message put may
+ * take the queue past it.
+ *
+ * @param[in] messenger the Messenger
+ * @param[in] messages the most messages queued
+ * @param[in] bytes the most bytes queued
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_messenger_set_outgoing_limit(pn_messenger_t *messenger, size_t messages, size_t bytes);
+
+/** Limits the incoming queue to the given number of messages and
+ * bytes, zero meaning no limit; there is none by default. The
+ * messenger never grants more credit than the queue has room for, so
+ * a sender is held back until messages are taken off the queue. As
+ * the size of a message is not known before it arrives, the byte
+ * limit may be overshot by the credit already granted.
+ *
+ * @param[in] messenger the Messenger
+ * @param[in] messages the most messages queued
+ * @param[in] bytes the most bytes queued
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_messenger_set_incoming_limit(pn_messenger_t *messenger, size_t messages, size_t bytes);
+
+/** Limits the messages and bytes queued for any one address, in
+ * either direction, on top of the limits on the queues as a whole.
+ *
+ * @param[in] messenger the Messenger
+ * @param[in] messages the most messages queued per address
+ * @param[in] bytes the most bytes queued per address
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_messenger_set_address_limit(pn_messenger_t *messenger, size_t messages, size_t bytes);
+
 //! Adds a routing rule to a Messenger's internal routing table.
 //!
 //! The route procedure may be used to influence how a messenger will
@@ -124,6 +124,21 @@ PN_EXTERN void pn_sasl_server(pn_sasl_t *sasl);
  */
 PN_EXTERN void pn_sasl_plain(pn_sasl_t *sasl, const char *username, const char *password);
 
+/** Allow a client to pipeline its connection setup.
+ *
+ * When enabled and the client is configured with a single step
+ * mechanism (ANONYMOUS, PLAIN or EXTERNAL), the AMQP header and any
+ * pending open, begin and attach frames are written directly after
+ * the SASL init frame instead of waiting for the server's outcome.
+ * This saves a round trip per connection. If the server rejects the
+ * credentials, the pipelined frames are discarded by the server and
+ * the transport fails with an error. Disabled by default.
+ *
+ * @param[in] sasl the client SASL layer
+ * @param[in] pipeline true to enable pipelining
+ */
+PN_EXTERN void pn_sasl_pipeline(pn_sasl_t *sasl, bool pipeline);
+
 /** Determine the size of the bytes available via pn_sasl_recv().
  *
  * Returns the size in bytes available via pn_sasl_recv().
@@ -0,0 +1,153 @@
+#ifndef PROTON_SHARDED_H
+#define PROTON_SHARDED_H 1
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <proton/import_export.h>
+#include <proton/messenger.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @file
+ * A messenger spread over several worker threads.
+ *
+ * Each shard is an ordinary messenger with its own driver, queues and
+ * connections, run by a thread of its own. Messages put from any
+ * thread are handed to the shard chosen by a hash of their address,
+ * so that every message for an address goes through the same shard
+ * and in the order it was put. Messages received by the shards are
+ * handed back for ::pn_sharded_get. Both hand offs go through lock
+ * free queues.
+ *
+ * Puts are fire and forget: there are no trackers, and a shard
+ * settles what it sends according to its own outgoing window. A
+ * message a shard cannot put or send is counted, see
+ * ::pn_sharded_failed.
+ */
+
+typedef struct pn_sharded_t pn_sharded_t; /**< Sharded messenger */
+
+/** The most shards a sharded messenger can have. */
+#define PN_SHARDS_MAX (64)
+
+/** Construct a sharded messenger. Its shards are named after it,
+ * with the shard number appended.
+ *
+ * @param[in] name the name of the messenger or NULL
+ * @param[in] shards the number of shards, 1 up to PN_SHARDS_MAX
+ *
+ * @return the new sharded messenger, or NULL if the number of shards
+ * is out of range or memory ran out
+ */
+PN_EXTERN pn_sharded_t *pn_sharded(const char *name, int shards);
+
+/** Stops the sharded messenger if it is running and frees it, along
+ * with any messages not yet taken with ::pn_sharded_get.
+ *
+ * @param[in] sharded the sharded messenger to free
+ */
+PN_EXTERN void pn_sharded_free(pn_sharded_t *sharded);
+
+/** The messenger of a shard, for configuration before
+ * ::pn_sharded_start. It must not be used once the shards are
+ * running.
+ *
+ * @param[in] sharded the sharded messenger
+ * @param[in] shard the shard number
+ *
+ * @return the shard's messenger, or NULL if there is no such shard
+ */
+PN_EXTERN pn_messenger_t *pn_sharded_messenger(pn_sharded_t *sharded, int shard);
+
+/** Subscribes the shard the source hashes to, as with
+ * ::pn_messenger_subscribe. Subscribe before ::pn_sharded_start.
+ *
+ * @param[in] sharded the sharded messenger
+ * @param[in] source the source address
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_sharded_subscribe(pn_sharded_t *sharded, const char *source);
+
+/** Starts a thread for each shard. Messages put before this are
+ * sent once the shards are running.
+ *
+ * @param[in] sharded the sharded messenger
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_sharded_start(pn_sharded_t *sharded);
+
+/** Stops the shards. Each shard sends whatever has been put, within
+ * the timeout of its messenger, then stops its messenger, and its
+ * thread is joined.
+ *
+ * @param[in] sharded the sharded messenger
+ *
+ * @return an error code or zero on success
+ */
+PN_EXTERN int pn_sharded_stop(pn_sharded_t *sharded);
+
+/** Hands a message to the shard for its address. The message is
+ * encoded on the calling thread and may be reused as soon as this
+ * returns. Safe to call from any number of threads at once.
+ *
+ * @param[in] sharded the sharded messenger
+ * @param[in] msg the message
+ *
+ * @return an error code or zero on success, PN_OVERFLOW if the
+ * shard already has too many messages waiting for it
+ */
+PN_EXTERN int pn_sharded_put(pn_sharded_t *sharded, pn_message_t *msg);
+
+/** The number of messages accepted by ::pn_sharded_put that were
+ * lost since: a shard failed to put them into its messenger, or its
+ * messenger could not send them before stopping. A full outgoing
+ * queue (see ::pn_messenger_set_outgoing_limit) only holds messages
+ * back. Safe to call from any thread.
+ *
+ * @param[in] sharded the sharded messenger
+ *
+ * @return the number of messages lost
+ */
+PN_EXTERN int pn_sharded_failed(pn_sharded_t *sharded);
+
+/** Takes the next message received by any of the shards, waiting up
+ * to the given number of milliseconds for one, or for ever if the
+ * timeout is negative. Only one thread at a time may get messages.
+ *
+ * @param[in] sharded the sharded messenger
+ * @param[out] msg the message to decode into
+ * @param[in] timeout how long to wait in milliseconds
+ *
+ * @return an error code or zero on success, PN_EOS if no message
+ * arrived in time
+ */
+PN_EXTERN int pn_sharded_get(pn_sharded_t *sharded, pn_message_t *msg, int timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* sharded.h */
@@ -0,0 +1,160 @@
+#ifndef PROTON_STATS_H
+#define PROTON_STATS_H 1
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+
+#include <proton/import_export.h>
+#include <proton/engine.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @file
+ * Performance counters for the proton Engine.
+ *
+ * Every connection, session and link keeps a small set of counters
+ * that are updated with plain increments as the engine runs, so they
+ * may be left on permanently. A snapshot of the counters is copied
+ * into a caller provided struct with ::pn_connection_stats,
+ * ::pn_session_stats and ::pn_link_stats. All times are in
+ * microseconds.
+ */
+
+/** Performatives counted by ::pn_connection_stats_t. */
+typedef enum {
+  PN_PERF_OPEN = 0,
+  PN_PERF_BEGIN = 1,
+  PN_PERF_ATTACH = 2,
+  PN_PERF_FLOW = 3,
+  PN_PERF_TRANSFER = 4,
+  PN_PERF_DISPOSITION = 5,
+  PN_PERF_DETACH = 6,
+  PN_PERF_END = 7,
+  PN_PERF_CLOSE = 8
+} pn_performative_t;
+
+#define PN_PERF_CT (PN_PERF_CLOSE + 1)
+
+typedef struct {
+  uint64_t frames_input[PN_PERF_CT];  /**< frames read, by performative */
+  uint64_t frames_output[PN_PERF_CT]; /**< frames written, by performative */
+  uint64_t bytes_input[PN_PERF_CT];   /**< frame bytes read, headers included */
+  uint64_t bytes_output[PN_PERF_CT];  /**< frame bytes written, headers included */
+  size_t input_high_water;            /**< most input buffered by the transport */
+  size_t output_high_water;           /**< most output buffered by the transport */
+  uint64_t process_count;             /**< engine processing passes */
+  uint64_t process_time;              /**< time spent in those passes */
+} pn_connection_stats_t;
+
+typedef struct {
+  uint64_t deliveries_sent;
+  uint64_t deliveries_received;
+  uint64_t deliveries_settled;        /**< deliveries settled locally */
+  uint64_t window_stalls;             /**< output held by the remote incoming window */
+  uint64_t window_stall_time;         /**< time spent held, including any current stall */
+} pn_session_stats_t;
+
+typedef struct {
+  uint64_t deliveries_sent;
+  uint64_t deliveries_received;
+  uint64_t deliveries_settled;        /**< deliveries settled locally */
+  uint64_t credit_stalls;             /**< output held for lack of link credit */
+  uint64_t credit_stall_time;         /**< time spent held, including any current stall */
+} pn_link_stats_t;
+
+/** Take a snapshot of the counters of a connection. The frame, byte
+ * and buffer counters cover every transport the connection has been
+ * bound to.
+ *
+ * @param[in] connection the connection
+ * @param[out] stats filled in with the current counters
+ * @return 0 on success, PN_ARG_ERR if either argument is NULL
+ */
+PN_EXTERN int pn_connection_stats(pn_connection_t *connection, pn_connection_stats_t *stats);
+
+/** Take a snapshot of the counters of a session.
+ *
+ * @param[in] session the session
+ * @param[out] stats filled in with the current counters
+ * @return 0 on success, PN_ARG_ERR if either argument is NULL
+ */
+PN_EXTERN int pn_session_stats(pn_session_t *session, pn_session_stats_t *stats);
+
+/** Take a snapshot of the counters of a link.
+ *
+ * @param[in] link the link
+ * @param[out] stats filled in with the current counters
+ * @return 0 on success, PN_ARG_ERR if either argument is NULL
+ */
+PN_EXTERN int pn_link_stats(pn_link_t *link, pn_link_stats_t *stats);
+
+/** When the first transfer frame of an outgoing delivery was written,
+ * in microseconds of a monotonic clock that is only meaningful
+ * relative to other such times.
+ *
+ * @param[in] delivery the delivery
+ * @return the time, or zero if nothing has been written yet
+ */
+PN_EXTERN uint64_t pn_delivery_transferred(pn_delivery_t *delivery);
+
+/** Number of buckets in a ::pn_histogram_t. Values below 16 each have
+ * a bucket of their own; above that every power of two range is split
+ * into 16 buckets, so a bucket is never wider than 1/16th of the values
+ * it counts. Values of 2^36 and over share the last bucket.
+ */
+#define PN_HISTOGRAM_BUCKETS (528)
+
+/** A histogram of recorded values, in the manner of HdrHistogram:
+ * buckets are narrow for small values and grow with them so that the
+ * relative error stays the same across the range.
+ */
+typedef struct {
+  uint64_t count;                         /**< values recorded */
+  uint64_t min;                           /**< smallest value, zero if none */
+  uint64_t max;                           /**< largest value, zero if none */
+  uint64_t total;                         /**< sum of the values */
+  uint64_t buckets[PN_HISTOGRAM_BUCKETS]; /**< values counted by bucket */
+} pn_histogram_t;
+
+/** The smallest value counted by a bucket of a ::pn_histogram_t.
+ *
+ * @param[in] bucket the index of the bucket
+ * @return the value
+ */
+PN_EXTERN uint64_t pn_histogram_bucket_value(int bucket);
+
+/** The value that a given percentage of the recorded values do not
+ * exceed, to within the width of its bucket.
+ *
+ * @param[in] histogram the histogram
+ * @param[in] percentile the percentage, from 0 to 100
+ * @return the value, zero if nothing was recorded
+ */
+PN_EXTERN uint64_t pn_histogram_percentile(const pn_histogram_t *histogram, double percentile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* stats.h */
@@ -273,6 +273,39 @@ pn_bytes_t pn_buffer_bytes(pn_buffer_t *buf)
   }
 }
 
+pn_bytes_t pn_buffer_space(pn_buffer_t *buf)
+{
+  pn_buffer_defrag(buf);
+  return pn_bytes(buf->capacity - buf->size, buf->bytes + buf->size);
+}
+
+int pn_buffer_commit(pn_buffer_t *buf, size_t size)
+{
+  if (size > pn_buffer_available(buf)) return PN_OVERFLOW;
+  buf->size += size;
+  return 0;
+}
+
+void pn_buffer_swap(pn_buffer_t *a, pn_buffer_t *b)
+{
+  pn_buffer_t tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+int pn_buffer_slices(pn_buffer_t *buf, pn_bytes_t *slices, int max)
+{
+  if (!buf || !buf->size || max <= 0) return 0;
+
+  slices[0] = pn_bytes(pn_buffer_head_size(buf), buf->bytes + pn_buffer_head(buf));
+  size_t tail = pn_buffer_tail_size(buf);
+  if (tail && max > 1) {
+    slices[1] = pn_bytes(tail, buf->bytes);
+    return 2;
+  }
+  return 1;
+}
+
 int pn_buffer_print(pn_buffer_t *buf)
 {
   printf("pn_buffer(\"");
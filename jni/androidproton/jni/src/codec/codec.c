@@ -361,15 +361,17 @@ pn_data_t *pn_data(size_t capacity)
   data->capacity = capacity;
   data->size = 0;
   data->nodes = capacity ? (pni_node_t *) malloc(capacity * sizeof(pni_node_t)) : NULL;
-  data->buf = pn_buffer(64);
+  data->buf = pn_buffer(0);
   data->parent = 0;
   data->current = 0;
   data->base_parent = 0;
   data->base_current = 0;
-  data->decoder = pn_decoder();
-  data->encoder = pn_encoder();
+  // the codec and scratch string are created on first use, most data
+  // objects hanging off endpoints are never encoded or inspected
+  data->decoder = NULL;
+  data->encoder = NULL;
   data->error = pn_error();
-  data->str = pn_string(NULL);
+  data->str = NULL;
   return data;
 }
 
@@ -1065,9 +1067,15 @@ int pn_data_scan(pn_data_t *data, const char *fmt, ...)
   return err;
 }
 
+static pn_string_t *pni_data_str(pn_data_t *data)
+{
+  if (!data->str) data->str = pn_string(NULL);
+  return data->str;
+}
+
 static int pni_data_inspectify(pn_data_t *data)
 {
-  int err = pn_string_set(data->str, "");
+  int err = pn_string_set(pni_data_str(data), "");
   if (err) return err;
   return pn_data_inspect(data, data->str);
 }
@@ -1351,7 +1359,7 @@ void pn_data_dump(pn_data_t *data)
   for (unsigned i = 0; i < data->size; i++)
   {
     pni_node_t *node = &data->nodes[i];
-    pn_string_set(data->str, "");
+    pn_string_set(pni_data_str(data), "");
     pni_inspect_atom((pn_atom_t *) &node->atom, data->str);
     printf("Node %i: prev=%" PN_ZI ", next=%" PN_ZI ", parent=%" PN_ZI ", down=%" PN_ZI 
            ", children=%" PN_ZI ", type=%s (%s)\n",
@@ -1415,11 +1423,13 @@ pni_node_t *pn_data_add(pn_data_t *data)
 
 ssize_t pn_data_encode(pn_data_t *data, char *bytes, size_t size)
 {
+  if (!data->encoder) data->encoder = pn_encoder();
   return pn_encoder_encode(data->encoder, data, bytes, size);
 }
 
 ssize_t pn_data_decode(pn_data_t *data, const char *bytes, size_t size)
 {
+  if (!data->decoder) data->decoder = pn_decoder();
   return pn_decoder_decode(data->decoder, bytes, size, data);
 }
 
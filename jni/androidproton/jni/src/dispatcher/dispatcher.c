@@ -20,14 +20,18 @@
  */
 
 #include <stdlib.h>
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
 #include <proton/framing.h>
 #include <proton/engine.h>
 #include <proton/buffer.h>
 #include "dispatcher.h"
 #include "protocol.h"
+#include "../engine/engine-internal.h"
 #include "../util.h"
+#include "../platform.h"
 #include "../platform_fmt.h"
 
 pn_dispatcher_t *pn_dispatcher(uint8_t frame_type, pn_transport_t *transport)
@@ -38,21 +42,21 @@ pn_dispatcher_t *pn_dispatcher(uint8_t frame_type, pn_transport_t *transport)
   disp->transport = transport;
   disp->trace = PN_TRACE_OFF;
 
-  disp->input = pn_buffer(1024);
-  disp->fragment = 0;
-
   disp->channel = 0;
   disp->code = 0;
-  disp->args = pn_data(16);
+  disp->args = pn_data(0);
   disp->payload = NULL;
   disp->size = 0;
 
-  disp->output_args = pn_data(16);
-  disp->frame = pn_buffer( 4*1024 );
-  // XXX
-  disp->capacity = 4*1024;
-  disp->output = (char *) malloc(disp->capacity);
+  disp->output_args = pn_data(0);
+  // output buffers are allocated by the first frame posted
+  disp->frame = NULL;
+  disp->capacity = 0;
+  disp->output = NULL;
   disp->available = 0;
+  disp->files_head = NULL;
+  disp->files_tail = NULL;
+  disp->files_at = 0;
 
   disp->halt = false;
   disp->batch = true;
@@ -65,19 +69,54 @@ pn_dispatcher_t *pn_dispatcher(uint8_t frame_type, pn_transport_t *transport)
 void pn_dispatcher_free(pn_dispatcher_t *disp)
 {
   if (disp) {
-    pn_buffer_free(disp->input);
     pn_data_free(disp->args);
     pn_data_free(disp->output_args);
     pn_buffer_free(disp->frame);
     free(disp->output);
+    while (disp->files_head) {
+      pn_file_segment_t *next = disp->files_head->next;
+      free(disp->files_head);
+      disp->files_head = next;
+    }
     pn_free(disp->scratch);
     free(disp);
   }
 }
 
+#define PN_DISPATCHER_BUFFER_SIZE (4*1024)
+
+static void pni_dispatcher_prepare(pn_dispatcher_t *disp)
+{
+  if (!disp->frame) {
+    disp->frame = pn_buffer(PN_DISPATCHER_BUFFER_SIZE);
+  }
+  if (!disp->output) {
+    disp->capacity = PN_DISPATCHER_BUFFER_SIZE;
+    disp->output = (char *) malloc(disp->capacity);
+  }
+}
+
+// hand back the output buffers once everything posted has been
+// written out, e.g. when the connection goes idle
+void pn_dispatcher_release(pn_dispatcher_t *disp)
+{
+  if (disp->available || disp->files_head) return;
+  pn_buffer_free(disp->frame);
+  disp->frame = NULL;
+  free(disp->output);
+  disp->output = NULL;
+  disp->capacity = 0;
+  // the scratch trees keep the nodes of the largest frame seen
+  pn_data_free(disp->args);
+  disp->args = pn_data(0);
+  pn_data_free(disp->output_args);
+  disp->output_args = pn_data(0);
+}
+
 void pn_dispatcher_action(pn_dispatcher_t *disp, uint8_t code,
                           pn_action_t *action)
 {
+  assert(code < PN_DISPATCHER_ACTIONS);
   disp->actions[code] = action;
 }
 
@@ -101,6 +140,22 @@ static void pn_do_trace(pn_dispatcher_t *disp, uint16_t ch, pn_dir_t dir,
   }
 }
 
+// per performative frame and byte counts of the bound connection
+static void pn_dispatcher_count(pn_dispatcher_t *disp, uint64_t code, size_t size, pn_dir_t dir)
+{
+  pn_connection_t *connection = disp->transport->connection;
+  if (!connection || code < OPEN || code > CLOSE) return;
+
+  pn_connection_stats_t *stats = &connection->stats;
+  if (dir == OUT) {
+    stats->frames_output[code - OPEN]++;
+    stats->bytes_output[code - OPEN] += size;
+  } else {
+    stats->frames_input[code - OPEN]++;
+    stats->bytes_input[code - OPEN] += size;
+  }
+}
+
 int pn_dispatch_frame(pn_dispatcher_t *disp, pn_frame_t frame)
 {
   if (frame.size == 0) { // ignore null frames
@@ -139,9 +194,16 @@ int pn_dispatch_frame(pn_dispatcher_t *disp, pn_frame_t frame)
     disp->payload = frame.payload + dsize;
 
   pn_do_trace(disp, disp->channel, IN, disp->args, disp->payload, disp->size);
-
-  pn_action_t *action = disp->actions[code];
-  int err = action(disp);
+  pn_dispatcher_count(disp, lcode, AMQP_HEADER_SIZE + frame.ex_size + frame.size, IN);
+
+  pn_action_t *action = code < PN_DISPATCHER_ACTIONS ? disp->actions[code] : NULL;
+  int err;
+  if (action) {
+    err = action(disp);
+  } else {
+    pn_transport_logf(disp->transport, "Unknown performative: 0x%02x", code);
+    err = PN_ERR;
+  }
 
   disp->channel = 0;
   disp->code = 0;
@@ -192,7 +254,7 @@ void pn_set_payload(pn_dispatcher_t *disp, const char *data, size_t size)
   disp->output_size = size;
 }
 
-int pn_post_frame(pn_dispatcher_t *disp, uint16_t ch, const char *fmt, ...)
+int pn_post_frame(pn_dispatcher_t *disp, uint16_t ch, uint64_t code, const char *fmt, ...)
 {
   va_list ap;
   va_start(ap, fmt);
@@ -207,6 +269,7 @@ int pn_post_frame(pn_dispatcher_t *disp, uint16_t ch, const char *fmt, ...)
   }
 
   pn_do_trace(disp, ch, OUT, disp->output_args, disp->output_payload, disp->output_size);
+  pni_dispatcher_prepare(disp);
 
  encode_performatives:
   pn_buffer_clear( disp->frame );
@@ -235,6 +298,7 @@ int pn_post_frame(pn_dispatcher_t *disp, uint16_t ch, const char *fmt, ...)
     disp->output = (char *) realloc(disp->output, disp->capacity);
   }
   disp->output_frames_ct += 1;
+  pn_dispatcher_count(disp, code, n, OUT);
   if (disp->trace & PN_TRACE_RAW) {
     pn_string_set(disp->scratch, "RAW: \"");
     pn_quote(disp->scratch, disp->output + disp->available, n);
@@ -248,7 +312,15 @@ int pn_post_frame(pn_dispatcher_t *disp, uint16_t ch, const char *fmt, ...)
 
 ssize_t pn_dispatcher_output(pn_dispatcher_t *disp, char *bytes, size_t size)
 {
+  if (!disp->available) return 0;
   int n = disp->available < size ? disp->available : size;
+  // stop where a file payload is due
+  if (disp->files_head) {
+    if (!disp->files_head->before) return 0;
+    if ((size_t) n > disp->files_head->before) n = disp->files_head->before;
+    disp->files_head->before -= n;
+    disp->files_at -= n;
+  }
   memmove(bytes, disp->output, n);
   memmove(disp->output, disp->output + n, disp->available - n);
   disp->available -= n;
@@ -269,6 +341,8 @@ int pn_post_transfer_frame(pn_dispatcher_t *disp, uint16_t ch,
   bool more_flag = more;
   int framecount = 0;
 
+  pni_dispatcher_prepare(disp);
+
   // create preformatives, assuming 'more' flag need not change
 
  compute_performatives:
@@ -343,6 +417,7 @@ int pn_post_transfer_frame(pn_dispatcher_t *disp, uint16_t ch,
       disp->output = (char *) realloc(disp->output, disp->capacity);
     }
     disp->output_frames_ct += 1;
+    pn_dispatcher_count(disp, TRANSFER, n, OUT);
     framecount++;
     if (disp->trace & PN_TRACE_RAW) {
       pn_string_set(disp->scratch, "RAW: \"");
@@ -356,3 +431,160 @@ int pn_post_transfer_frame(pn_dispatcher_t *disp, uint16_t ch,
   disp->output_payload = NULL;
   return framecount;
 }
+
+// file payloads go out in frames no larger than this even when the
+// peer allows more, so that other links get a turn
+#define PN_FILE_FRAME_MAX (1024*1024)
+
+int pn_post_transfer_file(pn_dispatcher_t *disp, uint16_t ch,
+                          uint32_t handle,
+                          pn_sequence_t id,
+                          const pn_bytes_t *tag,
+                          uint32_t message_format,
+                          bool settled,
+                          bool more,
+                          int fd,
+                          off_t offset,
+                          size_t size,
+                          size_t *posted,
+                          pn_sequence_t frame_limit)
+{
+  int framecount = 0;
+  *posted = 0;
+
+  pni_dispatcher_prepare(disp);
+
+  while (size > 0 && framecount < frame_limit) {
+    size_t chunk = size < PN_FILE_FRAME_MAX ? size : PN_FILE_FRAME_MAX;
+    bool more_flag = more || chunk < size;
+    pn_bytes_t buf;
+    ssize_t wr;
+
+  compute_performatives:
+    pn_data_clear(disp->output_args);
+    int err = pn_data_fill(disp->output_args, "DL[IIzIoo]", TRANSFER,
+                           handle, id, tag->size, tag->start,
+                           message_format,
+                           settled, more_flag);
+    if (err) {
+      pn_transport_logf(disp->transport,
+                        "error posting transfer frame: %s: %s", pn_code(err),
+                        pn_error_text(pn_data_error(disp->output_args)));
+      return PN_ERR;
+    }
+
+  encode_performatives:
+    pn_buffer_clear( disp->frame );
+    buf = pn_buffer_bytes( disp->frame );
+    buf.size = pn_buffer_available( disp->frame );
+    wr = pn_data_encode(disp->output_args, buf.start, buf.size);
+    if (wr < 0) {
+      if (wr == PN_OVERFLOW) {
+        pn_buffer_ensure( disp->frame, pn_buffer_available( disp->frame ) * 2 );
+        goto encode_performatives;
+      }
+      pn_transport_logf(disp->transport, "error posting frame: %s", pn_code(wr));
+      return PN_ERR;
+    }
+
+    if (disp->remote_max_frame && chunk + wr > disp->remote_max_frame - 8) {
+      chunk = disp->remote_max_frame - 8 - wr;
+      if (!more_flag) {
+        more_flag = true;
+        goto compute_performatives;
+      }
+    }
+
+    pn_file_segment_t *segment = (pn_file_segment_t *) malloc(sizeof(pn_file_segment_t));
+    if (!segment) return PN_ERR;
+
+    pn_do_trace(disp, ch, OUT, disp->output_args, NULL, 0);
+
+    // frame the performative alone, then size the frame to take in the
+    // payload that follows it from the file
+    pn_frame_t frame = {disp->frame_type};
+    frame.channel = ch;
+    frame.payload = buf.start;
+    frame.size = wr;
+    size_t n;
+    while (!(n = pn_write_frame(disp->output + disp->available,
+                                disp->capacity - disp->available, frame))) {
+      disp->capacity *= 2;
+      disp->output = (char *) realloc(disp->output, disp->capacity);
+    }
+    uint32_t total = n + chunk;
+    uint8_t *header = (uint8_t *) disp->output + disp->available;
+    header[0] = 0xFF & (total >> 24);
+    header[1] = 0xFF & (total >> 16);
+    header[2] = 0xFF & (total >>  8);
+    header[3] = 0xFF & (total      );
+    disp->output_frames_ct += 1;
+    pn_dispatcher_count(disp, TRANSFER, total, OUT);
+    disp->available += n;
+
+    segment->before = disp->available - disp->files_at;
+    segment->fd = fd;
+    segment->offset = offset;
+    segment->size = chunk;
+    segment->next = NULL;
+    if (disp->files_tail) {
+      disp->files_tail->next = segment;
+    } else {
+      disp->files_head = segment;
+    }
+    disp->files_tail = segment;
+    disp->files_at = disp->available;
+
+    offset += chunk;
+    size -= chunk;
+    *posted += chunk;
+    framecount++;
+  }
+
+  return framecount;
+}
+
+// the file payload due for output, if the bytes ahead of it are out
+pn_file_segment_t *pn_dispatcher_file(pn_dispatcher_t *disp)
+{
+  if (disp->files_head && !disp->files_head->before) {
+    return disp->files_head;
+  }
+  return NULL;
+}
+
+void pn_dispatcher_pop_file(pn_dispatcher_t *disp, size_t n)
+{
+  pn_file_segment_t *segment = pn_dispatcher_file(disp);
+  assert(segment && n <= segment->size);
+  segment->offset += n;
+  segment->size -= n;
+  if (!segment->size) {
+    disp->files_head = segment->next;
+    if (!disp->files_head) {
+      disp->files_tail = NULL;
+    }
+    free(segment);
+  }
+}
+
+// copies a due file payload, for when it cannot go to the socket
+// directly
+ssize_t pn_dispatcher_read_file(pn_dispatcher_t *disp, char *bytes, size_t size)
+{
+  pn_file_segment_t *segment = pn_dispatcher_file(disp);
+  if (!segment) return 0;
+  if (size > segment->size) size = segment->size;
+  ssize_t n = pn_i_pread(segment->fd, bytes, size, segment->offset);
+  if (n < 0) {
+    pn_transport_logf(disp->transport, "error reading file payload: %s",
+                      strerror(errno));
+    return PN_ERR;
+  }
+  if (n == 0) {
+    pn_transport_logf(disp->transport, "file payload truncated");
+    return PN_ERR;
+  }
+  pn_dispatcher_pop_file(disp, n);
+  return n;
+}
@@ -30,18 +30,29 @@
 #include <proton/codec.h>
 
 typedef struct pn_dispatcher_t pn_dispatcher_t;
+typedef struct pn_file_segment_t pn_file_segment_t;
 
 typedef int (pn_action_t)(pn_dispatcher_t *disp);
 
 #define SCRATCH (1024)
 #define CODEC_LIMIT (1024)
+// performative codes are small, 0x10-0x18 for AMQP and 0x40-0x44 for SASL
+#define PN_DISPATCHER_ACTIONS (0x50)
+
+// a transfer payload that stays in a file, framed into the output
+// but only read, or handed to sendfile, when its turn comes
+struct pn_file_segment_t {
+  size_t before; // output bytes due ahead of the segment
+  int fd;
+  off_t offset;
+  size_t size;
+  pn_file_segment_t *next;
+};
 
 struct pn_dispatcher_t {
-  pn_action_t *actions[256];
+  pn_action_t *actions[PN_DISPATCHER_ACTIONS];
   uint8_t frame_type;
   pn_trace_t trace;
-  pn_buffer_t *input;
-  size_t fragment;
   uint16_t channel;
   uint8_t code;
   pn_data_t *args;
@@ -55,6 +66,9 @@ struct pn_dispatcher_t {
   size_t capacity;
   size_t available; /* number of raw bytes pending output */
   char *output;
+  pn_file_segment_t *files_head;
+  pn_file_segment_t *files_tail;
+  size_t files_at; /* output bytes up to the last segment */
   pn_transport_t *transport;
   bool halt;
   bool batch;
@@ -69,9 +83,12 @@ void pn_dispatcher_action(pn_dispatcher_t *disp, uint8_t code,
                           pn_action_t *action);
 int pn_scan_args(pn_dispatcher_t *disp, const char *fmt, ...);
 void pn_set_payload(pn_dispatcher_t *disp, const char *data, size_t size);
-int pn_post_frame(pn_dispatcher_t *disp, uint16_t ch, const char *fmt, ...);
+// code is the performative's descriptor, as passed in the arguments,
+// for the frame counts
+int pn_post_frame(pn_dispatcher_t *disp, uint16_t ch, uint64_t code, const char *fmt, ...);
 ssize_t pn_dispatcher_input(pn_dispatcher_t *disp, const char *bytes, size_t available);
 ssize_t pn_dispatcher_output(pn_dispatcher_t *disp, char *bytes, size_t size);
+void pn_dispatcher_release(pn_dispatcher_t *disp);
 int pn_post_transfer_frame(pn_dispatcher_t *disp,
                            uint16_t local_channel,
                            uint32_t handle,
@@ -81,4 +98,20 @@ int pn_post_transfer_frame(pn_dispatcher_t *disp,
                            bool settled,
                            bool more,
                            pn_sequence_t frame_limit);
+int pn_post_transfer_file(pn_dispatcher_t *disp,
+                          uint16_t local_channel,
+                          uint32_t handle,
+                          pn_sequence_t delivery_id,
+                          const pn_bytes_t *delivery_tag,
+                          uint32_t message_format,
+                          bool settled,
+                          bool more,
+                          int fd,
+                          off_t offset,
+                          size_t size,
+                          size_t *posted,
+                          pn_sequence_t frame_limit);
+pn_file_segment_t *pn_dispatcher_file(pn_dispatcher_t *disp);
+void pn_dispatcher_pop_file(pn_dispatcher_t *disp, size_t n);
+ssize_t pn_dispatcher_read_file(pn_dispatcher_t *disp, char *bytes, size_t size);
 #endif /* dispatcher.h */
@@ -25,6 +25,8 @@
 #include <proton/object.h>
 #include <proton/buffer.h>
 #include <proton/engine.h>
+#include <proton/event.h>
+#include <proton/stats.h>
 #include <proton/types.h>
 #include "../dispatcher/dispatcher.h"
 #include "../util.h"
@@ -114,6 +116,7 @@ struct pn_transport_t {
   size_t header_count;
   pn_sasl_t *sasl;
   pn_ssl_t *ssl;
+  bool sendfile; // the driver writes file payloads itself
   pn_connection_t *connection;
   pn_dispatcher_t *disp;
   bool open_sent;
@@ -128,6 +131,7 @@ struct pn_transport_t {
   pn_data_t *disp_data;
   //#define PN_DEFAULT_MAX_FRAME_SIZE (16*1024)
 #define PN_DEFAULT_MAX_FRAME_SIZE (0)  /* for now, allow unlimited size */
+#define PN_TRANSPORT_BUFFER_SIZE (16*1024)  /* initial size of each io buffer */
   uint32_t   local_max_frame;
   uint32_t   remote_max_frame;
   pn_condition_t remote_condition;
@@ -156,6 +160,12 @@ struct pn_transport_t {
   /* statistics */
   uint64_t bytes_input;
   uint64_t bytes_output;
+  uint64_t process_start; // when the current processing pass began
+
+  /* io buffers are released while the transport is idle */
+  uint64_t idle_bytes_input;
+  uint64_t idle_bytes_output;
+  int idle_polls;
 
   /* output buffered for send */
   size_t output_size;
@@ -167,6 +177,7 @@ struct pn_transport_t {
   size_t input_pending;
   char *input_buf;
   bool tail_closed;      // input stream closed by driver
+  bool reprocess;        // a layer holding input back has moved on
 
   void *context;
 };
@@ -183,11 +194,16 @@ struct pn_connection_t {
   pn_delivery_t *work_tail;
   pn_delivery_t *tpwork_head;
   pn_delivery_t *tpwork_tail;
+  // settled deliveries of any link, recycled by pn_delivery
+  pn_delivery_t *settled_head;
+  pn_delivery_t *settled_tail;
   pn_string_t *container;
   pn_string_t *hostname;
   pn_data_t *offered_capabilities;
   pn_data_t *desired_capabilities;
   pn_data_t *properties;
+  pn_collector_t *collector;
+  pn_connection_stats_t stats;
   void *context;
 };
 
@@ -201,6 +217,8 @@ struct pn_session_t {
   pn_sequence_t outgoing_bytes;
   pn_sequence_t incoming_deliveries;
   pn_sequence_t outgoing_deliveries;
+  pn_session_stats_t stats;
+  uint64_t window_stall_start; // zero unless stalled
   pn_session_state_t state;
 };
 
@@ -229,8 +247,6 @@ struct pn_link_t {
   pn_delivery_t *unsettled_head;
   pn_delivery_t *unsettled_tail;
   pn_delivery_t *current;
-  pn_delivery_t *settled_head;
-  pn_delivery_t *settled_tail;
   uint8_t snd_settle_mode;
   uint8_t rcv_settle_mode;
   uint8_t remote_snd_settle_mode;
@@ -242,6 +258,9 @@ struct pn_link_t {
   bool drain_flag_mode; // receiver only
   bool drain;
   int drained; // number of drained credits
+  pn_link_stats_t stats;
+  uint64_t credit_stall_start; // zero unless stalled
+  size_t high_water;  // most unsent bytes pn_link_send buffers, zero for no limit
   void *context;
   pn_link_state_t state;
 };
@@ -258,9 +277,13 @@ struct pn_disposition_t {
   bool settled;
 };
 
+#define PN_INLINE_TAG_SIZE (32)
+
 struct pn_delivery_t {
   pn_link_t *link;
-  pn_buffer_t *tag;
+  size_t tag_size;
+  char tag_bytes[PN_INLINE_TAG_SIZE];  // small tags are stored inline
+  pn_buffer_t *tag;                    // otherwise here, on demand
   pn_disposition_t local;
   pn_disposition_t remote;
   bool updated;
@@ -275,9 +298,14 @@ struct pn_delivery_t {
   pn_delivery_t *tpwork_next;
   pn_delivery_t *tpwork_prev;
   bool tpwork;
+  pn_event_t *event; // pending PN_DELIVERY event, if any
   pn_buffer_t *bytes;
+  int file; // region of a file sent after the bytes, see pn_link_send_fd
+  off_t file_offset;
+  size_t file_size;
   bool done;
   void *context;
+  uint64_t transferred; // when its first transfer frame was written, zero until then
   pn_delivery_state_t state;
 };
 
@@ -298,10 +326,15 @@ pn_timestamp_t pn_io_layer_tick_passthru(pn_io_layer_t *, pn_timestamp_t);
 
 void pn_condition_init(pn_condition_t *condition);
 void pn_condition_tini(pn_condition_t *condition);
-void pn_modified(pn_connection_t *connection, pn_endpoint_t *endpoint);
+void pn_modified(pn_connection_t *connection, pn_endpoint_t *endpoint, bool emit);
 void pn_real_settle(pn_delivery_t *delivery);
+pn_bytes_t pn_delivery_tag_bytes(pn_delivery_t *delivery);
 void pn_clear_tpwork(pn_delivery_t *delivery);
 void pn_work_update(pn_connection_t *connection, pn_delivery_t *delivery);
 void pn_clear_modified(pn_connection_t *connection, pn_endpoint_t *endpoint);
 
+void pn_collector_put(pn_collector_t *collector, pn_event_type_t type, void *context);
+void pn_collector_purge(pn_collector_t *collector, void *object);
+void pn_collector_forget(pn_collector_t *collector, pn_delivery_t *delivery);
+
 #endif /* engine-internal.h */
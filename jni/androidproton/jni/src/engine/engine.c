@@ -51,20 +51,20 @@ pn_connection_t *pn_ep_get_connection(pn_endpoint_t *endpoint)
   return NULL;
 }
 
-void pn_modified(pn_connection_t *connection, pn_endpoint_t *endpoint);
+void pn_modified(pn_connection_t *connection, pn_endpoint_t *endpoint, bool emit);
 
 void pn_open(pn_endpoint_t *endpoint)
 {
   // TODO: do we care about the current state?
   PN_SET_LOCAL(endpoint->state, PN_LOCAL_ACTIVE);
-  pn_modified(pn_ep_get_connection(endpoint), endpoint);
+  pn_modified(pn_ep_get_connection(endpoint), endpoint, true);
 }
 
 void pn_close(pn_endpoint_t *endpoint)
 {
   // TODO: do we care about the current state?
   PN_SET_LOCAL(endpoint->state, PN_LOCAL_CLOSED);
-  pn_modified(pn_ep_get_connection(endpoint), endpoint);
+  pn_modified(pn_ep_get_connection(endpoint), endpoint, true);
 }
 
 void pn_connection_reset(pn_connection_t *connection)
@@ -106,7 +106,7 @@ void pn_condition_init(pn_condition_t *condition)
 {
   condition->name = pn_string(NULL);
   condition->description = pn_string(NULL);
-  condition->info = pn_data(16);
+  condition->info = pn_data(0);
 }
 
 void pn_condition_tini(pn_condition_t *condition)
@@ -145,8 +145,10 @@ void pn_session_close(pn_session_t *session)
 
 void pn_session_free(pn_session_t *session)
 {
-  if (session && session->connection)
+  if (session && session->connection) {
+    pn_collector_purge(session->connection->collector, session);
     pn_remove_session(session->connection, session);
+  }
 }
 
 void *pn_session_get_context(pn_session_t *session)
@@ -194,6 +196,7 @@ void pn_terminus_free(pn_terminus_t *terminus)
 void pn_link_free(pn_link_t *link)
 {
   if (link && link->session) {
+    pn_collector_purge(link->session->connection->collector, link);
     pn_remove_link(link->session, link);
     pn_endpoint_t *endpoint = (pn_endpoint_t *) link;
     LL_REMOVE(pn_ep_get_connection(endpoint), endpoint, endpoint);
@@ -237,7 +240,13 @@ void pn_endpoint_tini(pn_endpoint_t *endpoint)
 static void pn_connection_finalize(void *object)
 {
   pn_connection_t *conn = (pn_connection_t *) object;
+  pn_collector_purge(conn->collector, conn);
   pn_free(conn->sessions);
+  while (conn->settled_head) {
+    pn_delivery_t *d = conn->settled_head;
+    LL_POP(conn, settled, pn_delivery_t);
+    pn_free(d);
+  }
   pn_free(conn->container);
   pn_free(conn->hostname);
   pn_free(conn->offered_capabilities);
@@ -269,11 +278,15 @@ pn_connection_t *pn_connection()
   conn->work_tail = NULL;
   conn->tpwork_head = NULL;
   conn->tpwork_tail = NULL;
+  conn->settled_head = NULL;
+  conn->settled_tail = NULL;
   conn->container = pn_string(NULL);
   conn->hostname = pn_string(NULL);
-  conn->offered_capabilities = pn_data(16);
-  conn->desired_capabilities = pn_data(16);
-  conn->properties = pn_data(16);
+  conn->offered_capabilities = pn_data(0);
+  conn->desired_capabilities = pn_data(0);
+  conn->properties = pn_data(0);
+  conn->collector = NULL;
+  memset(&conn->stats, 0, sizeof(conn->stats));
 
   return conn;
 }
@@ -423,7 +436,7 @@ void pn_add_tpwork(pn_delivery_t *delivery)
     LL_ADD(connection, tpwork, delivery);
     delivery->tpwork = true;
   }
-  pn_modified(connection, &connection->endpoint);
+  pn_modified(connection, &connection->endpoint, true);
 }
 
 void pn_clear_tpwork(pn_delivery_t *delivery)
@@ -449,12 +462,16 @@ void pn_dump(pn_connection_t *conn)
   printf("\n");
 }
 
-void pn_modified(pn_connection_t *connection, pn_endpoint_t *endpoint)
+void pn_modified(pn_connection_t *connection, pn_endpoint_t *endpoint, bool emit)
 {
   if (!endpoint->modified) {
     LL_ADD(connection, transport, endpoint);
     endpoint->modified = true;
   }
+
+  if (emit && connection->transport) {
+    pn_collector_put(connection->collector, PN_TRANSPORT, connection->transport);
+  }
 }
 
 void pn_clear_modified(pn_connection_t *connection, pn_endpoint_t *endpoint)
@@ -573,6 +590,8 @@ pn_session_t *pn_session(pn_connection_t *conn)
   ssn->outgoing_bytes = 0;
   ssn->incoming_deliveries = 0;
   ssn->outgoing_deliveries = 0;
+  memset(&ssn->stats, 0, sizeof(ssn->stats));
+  ssn->window_stall_start = 0;
 
   // begin transport state
   memset(&ssn->state, 0, sizeof(ssn->state));
@@ -631,10 +650,10 @@ void pn_terminus_init(pn_terminus_t *terminus, pn_terminus_type_t type)
   terminus->timeout = 0;
   terminus->dynamic = false;
   terminus->distribution_mode = PN_DIST_MODE_UNSPECIFIED;
-  terminus->properties = pn_data(16);
-  terminus->capabilities = pn_data(16);
-  terminus->outcomes = pn_data(16);
-  terminus->filter = pn_data(16);
+  terminus->properties = pn_data(0);
+  terminus->capabilities = pn_data(0);
+  terminus->outcomes = pn_data(0);
+  terminus->filter = pn_data(0);
 }
 
 static void pn_link_finalize(void *object)
@@ -645,11 +664,6 @@ static void pn_link_finalize(void *object)
   pn_terminus_free(&link->target);
   pn_terminus_free(&link->remote_source);
   pn_terminus_free(&link->remote_target);
-  while (link->settled_head) {
-    pn_delivery_t *d = link->settled_head;
-    LL_POP(link, settled, pn_delivery_t);
-    pn_free(d);
-  }
   while (link->unsettled_head) {
     pn_delivery_t *d = link->unsettled_head;
     LL_POP(link, unsettled, pn_delivery_t);
@@ -677,7 +691,6 @@ pn_link_t *pn_link_new(int type, pn_session_t *session, const char *name)
   pn_terminus_init(&link->target, PN_TARGET);
   pn_terminus_init(&link->remote_source, PN_UNSPECIFIED);
   pn_terminus_init(&link->remote_target, PN_UNSPECIFIED);
-  link->settled_head = link->settled_tail = NULL;
   link->unsettled_head = link->unsettled_tail = link->current = NULL;
   link->unsettled_count = 0;
   link->available = 0;
@@ -686,6 +699,9 @@ pn_link_t *pn_link_new(int type, pn_session_t *session, const char *name)
   link->drain = false;
   link->drain_flag_mode = true;
   link->drained = 0;
+  memset(&link->stats, 0, sizeof(link->stats));
+  link->credit_stall_start = 0;
+  link->high_water = 0;
   link->context = 0;
   link->snd_settle_mode = PN_SND_MIXED;
   link->rcv_settle_mode = PN_RCV_FIRST;
@@ -910,8 +926,8 @@ static void pn_delivery_finalize(void *object)
 
 static void pn_disposition_init(pn_disposition_t *ds)
 {
-  ds->data = pn_data(16);
-  ds->annotations = pn_data(16);
+  ds->data = pn_data(0);
+  ds->annotations = pn_data(0);
   pn_condition_init(&ds->condition);
 }
 
@@ -936,22 +952,31 @@ static void pn_disposition_clear(pn_disposition_t *ds)
 pn_delivery_t *pn_delivery(pn_link_t *link, pn_delivery_tag_t tag)
 {
   assert(link);
-  pn_delivery_t *delivery = link->settled_head;
-  LL_POP(link, settled, pn_delivery_t);
+  pn_connection_t *conn = link->session->connection;
+  pn_delivery_t *delivery = conn->settled_head;
+  LL_POP(conn, settled, pn_delivery_t);
   if (!delivery) {
     static pn_class_t clazz = PN_CLASS(pn_delivery);
     delivery = (pn_delivery_t *) pn_new(sizeof(pn_delivery_t), &clazz);
     if (!delivery) return NULL;
-    delivery->tag = pn_buffer(16);
+    delivery->tag = NULL;
     delivery->bytes = pn_buffer(64);
     pn_disposition_init(&delivery->local);
     pn_disposition_init(&delivery->remote);
+    delivery->event = NULL;
   } else {
     assert(!delivery->tpwork);
+    assert(!delivery->event);
   }
   delivery->link = link;
-  pn_buffer_clear(delivery->tag);
-  pn_buffer_append(delivery->tag, tag.bytes, tag.size);
+  delivery->tag_size = tag.size;
+  if (tag.size <= PN_INLINE_TAG_SIZE) {
+    memcpy(delivery->tag_bytes, tag.bytes, tag.size);
+  } else {
+    if (!delivery->tag) delivery->tag = pn_buffer(tag.size);
+    pn_buffer_clear(delivery->tag);
+    pn_buffer_append(delivery->tag, tag.bytes, tag.size);
+  }
   pn_disposition_clear(&delivery->local);
   pn_disposition_clear(&delivery->remote);
   delivery->updated = false;
@@ -964,8 +989,12 @@ pn_delivery_t *pn_delivery(pn_link_t *link, pn_delivery_tag_t tag)
   delivery->tpwork_prev = NULL;
   delivery->tpwork = false;
   pn_buffer_clear(delivery->bytes);
+  delivery->file = -1;
+  delivery->file_offset = 0;
+  delivery->file_size = 0;
   delivery->done = false;
   delivery->context = NULL;
+  delivery->transferred = 0;
 
   // begin delivery state
   delivery->state.init = false;
@@ -991,7 +1020,8 @@ bool pn_delivery_buffered(pn_delivery_t *delivery)
     if (state->sent) {
       return false;
     } else {
-      return delivery->done || (pn_buffer_size(delivery->bytes) > 0);
+      return delivery->done || (pn_buffer_size(delivery->bytes) > 0) ||
+        delivery->file_size > 0;
     }
   } else {
     return false;
@@ -1030,7 +1060,7 @@ bool pn_is_current(pn_delivery_t *delivery)
 void pn_delivery_dump(pn_delivery_t *d)
 {
   char tag[1024];
-  pn_bytes_t bytes = pn_buffer_bytes(d->tag);
+  pn_bytes_t bytes = pn_delivery_tag_bytes(d);
   pn_quote_data(tag, 1024, bytes.start, bytes.size);
   printf("{tag=%s, local.type=%" PRIu64 ", remote.type=%" PRIu64 ", local.settled=%u, "
          "remote.settled=%u, updated=%u, current=%u, writable=%u, readable=%u, "
@@ -1124,10 +1154,19 @@ pn_condition_t *pn_disposition_condition(pn_disposition_t *disposition)
   return &disposition->condition;
 }
 
+pn_bytes_t pn_delivery_tag_bytes(pn_delivery_t *delivery)
+{
+  if (delivery->tag_size <= PN_INLINE_TAG_SIZE) {
+    return pn_bytes(delivery->tag_size, delivery->tag_bytes);
+  } else {
+    return pn_buffer_bytes(delivery->tag);
+  }
+}
+
 pn_delivery_tag_t pn_delivery_tag(pn_delivery_t *delivery)
 {
   if (delivery) {
-    pn_bytes_t tag = pn_buffer_bytes(delivery->tag);
+    pn_bytes_t tag = pn_delivery_tag_bytes(delivery);
     return pn_dtag(tag.start, tag.size);
   } else {
     return pn_dtag(0, 0);
@@ -1249,9 +1288,11 @@ void pn_link_set_rcv_settle_mode(pn_link_t *link, pn_rcv_settle_mode_t mode)
 void pn_real_settle(pn_delivery_t *delivery)
 {
   pn_link_t *link = delivery->link;
+  pn_connection_t *conn = link->session->connection;
+  pn_collector_forget(conn->collector, delivery);
   LL_REMOVE(link, unsettled, delivery);
-  LL_ADD(link, settled, delivery);
-  pn_buffer_clear(delivery->tag);
+  LL_ADD(conn, settled, delivery);
+  delivery->tag_size = 0;
   pn_buffer_clear(delivery->bytes);
   delivery->settled = true;
 }
@@ -1267,6 +1308,9 @@ void pn_delivery_settle(pn_delivery_t *delivery)
 
   link->unsettled_count--;
   delivery->local.settled = true;
+  link->stats.deliveries_settled++;
+  link->session->stats.deliveries_settled++;
+  pn_collector_forget(link->session->connection->collector, delivery);
   pn_add_tpwork(delivery);
   pn_work_update(delivery->link->session->connection, delivery);
 }
@@ -1280,12 +1324,69 @@ ssize_t pn_link_send(pn_link_t *sender, const char *bytes, size_t n)
 {
   pn_delivery_t *current = pn_link_current(sender);
   if (!current) return PN_EOS;
+  if (current->file_size) return PN_STATE_ERR;
+  if (sender->high_water) {
+    size_t buffered = pn_buffer_size(current->bytes);
+    n = buffered < sender->high_water ? pn_min(n, sender->high_water - buffered) : 0;
+    if (!n) return 0;
+  }
   pn_buffer_append(current->bytes, bytes, n);
   sender->session->outgoing_bytes += n;
   pn_add_tpwork(current);
   return n;
 }
 
+void pn_link_set_high_water(pn_link_t *sender, size_t bytes)
+{
+  assert(sender);
+  sender->high_water = bytes;
+}
+
+size_t pn_link_get_high_water(pn_link_t *sender)
+{
+  assert(sender);
+  return sender->high_water;
+}
+
+ssize_t pn_link_send_fd(pn_link_t *sender, int fd, off_t offset, size_t size)
+{
+  pn_delivery_t *current = pn_link_current(sender);
+  if (!current) return PN_EOS;
+  if (fd < 0 || offset < 0) return PN_ARG_ERR;
+  if (current->file_size) {
+    // only a region carrying on from the one still pending can be added
+    if (fd != current->file ||
+        offset != current->file_offset + (off_t) current->file_size) {
+      return PN_STATE_ERR;
+    }
+  } else {
+    current->file = fd;
+    current->file_offset = offset;
+  }
+  current->file_size += size;
+  sender->session->outgoing_bytes += size;
+  pn_add_tpwork(current);
+  return size;
+}
+
+ssize_t pn_link_send_buffer(pn_link_t *sender, pn_buffer_t *bytes)
+{
+  pn_delivery_t *current = pn_link_current(sender);
+  if (!current) return PN_EOS;
+  if (current->file_size) return PN_STATE_ERR;
+  size_t n = pn_buffer_size(bytes);
+  if (pn_buffer_size(current->bytes)) {
+    pn_bytes_t b = pn_buffer_bytes(bytes);
+    pn_buffer_append(current->bytes, b.start, b.size);
+    pn_buffer_clear(bytes);
+  } else {
+    pn_buffer_swap(current->bytes, bytes);
+  }
+  sender->session->outgoing_bytes += n;
+  pn_add_tpwork(current);
+  return n;
+}
+
 int pn_link_drained(pn_link_t *link)
 {
   assert(link);
@@ -1295,7 +1396,7 @@ int pn_link_drained(pn_link_t *link)
     if (link->drain && link->credit > 0) {
       link->drained = link->credit;
       link->credit = 0;
-      pn_modified(link->session->connection, &link->endpoint);
+      pn_modified(link->session->connection, &link->endpoint, true);
       drained = link->drained;
     }
   } else {
@@ -1328,12 +1429,71 @@ ssize_t pn_link_recv(pn_link_t *receiver, char *bytes, size_t n)
   }
 }
 
+ssize_t pn_link_recv_buffer(pn_link_t *receiver, pn_buffer_t *bytes)
+{
+  if (!receiver || !bytes) return PN_ARG_ERR;
+
+  pn_delivery_t *delivery = receiver->current;
+  if (!delivery) return PN_STATE_ERR;
+
+  size_t size = pn_buffer_size(delivery->bytes);
+  if (!size) return delivery->done ? PN_EOS : 0;
+
+  if (pn_buffer_size(bytes)) {
+    pn_bytes_t b = pn_buffer_bytes(delivery->bytes);
+    pn_buffer_append(bytes, b.start, b.size);
+    pn_buffer_clear(delivery->bytes);
+  } else {
+    pn_buffer_swap(delivery->bytes, bytes);
+  }
+  receiver->session->incoming_bytes -= size;
+  if (!receiver->session->state.incoming_window) {
+    pn_add_tpwork(delivery);
+  }
+  return size;
+}
+
+int pn_link_recv_slices(pn_link_t *receiver, pn_bytes_t *out, int max)
+{
+  if (!receiver || !out) return PN_ARG_ERR;
+
+  pn_delivery_t *delivery = receiver->current;
+  if (!delivery) return PN_STATE_ERR;
+
+  // hand out the ring segments in place rather than defragging
+  int count = pn_buffer_slices(delivery->bytes, out, max);
+  if (!count && delivery->done) return PN_EOS;
+  return count;
+}
+
+ssize_t pn_link_recv_release(pn_link_t *receiver, size_t n)
+{
+  if (!receiver) return PN_ARG_ERR;
+
+  pn_delivery_t *delivery = receiver->current;
+  if (!delivery) return PN_STATE_ERR;
+
+  size_t size = pn_buffer_size(delivery->bytes);
+  if (n > size) n = size;
+  if (n) {
+    pn_buffer_trim(delivery->bytes, n, 0);
+    // once drained, restart at the front so later frames land in a
+    // single contiguous slice
+    if (n == size) pn_buffer_clear(delivery->bytes);
+    receiver->session->incoming_bytes -= n;
+    if (!receiver->session->state.incoming_window) {
+      pn_add_tpwork(delivery);
+    }
+  }
+  return n;
+}
+
 void pn_link_flow(pn_link_t *receiver, int credit)
 {
   assert(receiver);
   assert(pn_link_is_receiver(receiver));
   receiver->credit += credit;
-  pn_modified(receiver->session->connection, &receiver->endpoint);
+  pn_modified(receiver->session->connection, &receiver->endpoint, true);
   if (!receiver->drain_flag_mode) {
     pn_link_set_drain(receiver, false);
     receiver->drain_flag_mode = false;
@@ -1354,7 +1514,7 @@ void pn_link_set_drain(pn_link_t *receiver, bool drain)
   assert(receiver);
   assert(pn_link_is_receiver(receiver));
   receiver->drain = drain;
-  pn_modified(receiver->session->connection, &receiver->endpoint);
+  pn_modified(receiver->session->connection, &receiver->endpoint, true);
   receiver->drain_flag_mode = true;
 }
 
@@ -1438,7 +1598,7 @@ bool pn_delivery_readable(pn_delivery_t *delivery)
 
 size_t pn_delivery_pending(pn_delivery_t *delivery)
 {
-  return pn_buffer_size(delivery->bytes);
+  return pn_buffer_size(delivery->bytes) + delivery->file_size;
 }
 
 bool pn_delivery_partial(pn_delivery_t *delivery)
@@ -1446,6 +1606,38 @@ bool pn_delivery_partial(pn_delivery_t *delivery)
   return !delivery->done;
 }
 
+int pn_connection_stats(pn_connection_t *connection, pn_connection_stats_t *stats)
+{
+  if (!connection || !stats) return PN_ARG_ERR;
+  *stats = connection->stats;
+  return 0;
+}
+
+int pn_session_stats(pn_session_t *session, pn_session_stats_t *stats)
+{
+  if (!session || !stats) return PN_ARG_ERR;
+  *stats = session->stats;
+  if (session->window_stall_start) {
+    stats->window_stall_time += pn_i_micros() - session->window_stall_start;
+  }
+  return 0;
+}
+
+int pn_link_stats(pn_link_t *link, pn_link_stats_t *stats)
+{
+  if (!link || !stats) return PN_ARG_ERR;
+  *stats = link->stats;
+  if (link->credit_stall_start) {
+    stats->credit_stall_time += pn_i_micros() - link->credit_stall_start;
+  }
+  return 0;
+}
+
+uint64_t pn_delivery_transferred(pn_delivery_t *delivery)
+{
+  return delivery ? delivery->transferred : 0;
+}
+
 pn_condition_t *pn_connection_condition(pn_connection_t *connection)
 {
   assert(connection);
@@ -0,0 +1,261 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <proton/object.h>
+#include <proton/event.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "../engine/engine-internal.h"
+
+struct pn_event_t {
+  pn_event_type_t type;
+  pn_connection_t *connection;
+  pn_session_t *session;
+  pn_link_t *link;
+  pn_delivery_t *delivery;
+  pn_transport_t *transport;
+  pn_event_t *event_next;
+  pn_event_t *event_prev;
+};
+
+struct pn_collector_t {
+  pn_event_t *event_head;
+  pn_event_t *event_tail;
+  // retired events are kept for reuse so that steady state traffic
+  // does not touch the allocator
+  pn_event_t *free_head;
+};
+
+static void pn_collector_finalize(void *object)
+{
+  pn_collector_t *collector = (pn_collector_t *) object;
+  while (pn_collector_pop(collector));
+  while (collector->free_head) {
+    pn_event_t *event = collector->free_head;
+    collector->free_head = event->event_next;
+    free(event);
+  }
+}
+
+#define pn_collector_initialize NULL
+#define pn_collector_hashcode NULL
+#define pn_collector_compare NULL
+#define pn_collector_inspect NULL
+
+pn_collector_t *pn_collector(void)
+{
+  static pn_class_t clazz = PN_CLASS(pn_collector);
+  pn_collector_t *collector = (pn_collector_t *) pn_new(sizeof(pn_collector_t), &clazz);
+  if (!collector) return NULL;
+  collector->event_head = NULL;
+  collector->event_tail = NULL;
+  collector->free_head = NULL;
+  return collector;
+}
+
+void pn_collector_free(pn_collector_t *collector)
+{
+  pn_free(collector);
+}
+
+static void pn_collector_remove(pn_collector_t *collector, pn_event_t *event)
+{
+  LL_REMOVE(collector, event, event);
+  if (event->delivery && event->delivery->event == event) {
+    event->delivery->event = NULL;
+  }
+  event->event_next = collector->free_head;
+  collector->free_head = event;
+}
+
+void pn_collector_put(pn_collector_t *collector, pn_event_type_t type, void *context)
+{
+  if (!collector) return;
+  assert(context);
+
+  pn_connection_t *connection = NULL;
+  pn_session_t *session = NULL;
+  pn_link_t *link = NULL;
+  pn_delivery_t *delivery = NULL;
+  pn_transport_t *transport = NULL;
+
+  switch (type) {
+  case PN_CONNECTION_STATE:
+    connection = (pn_connection_t *) context;
+    break;
+  case PN_SESSION_STATE:
+    session = (pn_session_t *) context;
+    connection = session->connection;
+    break;
+  case PN_LINK_STATE:
+  case PN_LINK_FLOW:
+    link = (pn_link_t *) context;
+    session = link->session;
+    connection = session->connection;
+    break;
+  case PN_DELIVERY:
+    delivery = (pn_delivery_t *) context;
+    // a delivery has at most one pending event, the consumer looks
+    // at its current state when the event is popped; once settled
+    // locally it is of no further interest to the application
+    if (delivery->event || delivery->local.settled) return;
+    link = delivery->link;
+    session = link->session;
+    connection = session->connection;
+    break;
+  case PN_TRANSPORT:
+    transport = (pn_transport_t *) context;
+    connection = transport->connection;
+    break;
+  default:
+    assert(false);
+    return;
+  }
+
+  pn_event_t *tail = collector->event_tail;
+  if (tail && tail->type == type && tail->connection == connection &&
+      tail->session == session && tail->link == link &&
+      tail->transport == transport && !delivery) {
+    return;
+  }
+
+  pn_event_t *event = collector->free_head;
+  if (event) {
+    collector->free_head = event->event_next;
+  } else {
+    event = (pn_event_t *) malloc(sizeof(pn_event_t));
+    if (!event) return;
+  }
+
+  event->type = type;
+  event->connection = connection;
+  event->session = session;
+  event->link = link;
+  event->delivery = delivery;
+  event->transport = transport;
+  LL_ADD(collector, event, event);
+  if (delivery) delivery->event = event;
+}
+
+void pn_collector_purge(pn_collector_t *collector, void *object)
+{
+  if (!collector || !object) return;
+
+  pn_event_t *event = collector->event_head;
+  while (event) {
+    pn_event_t *next = event->event_next;
+    if ((void *) event->connection == object ||
+        (void *) event->session == object ||
+        (void *) event->link == object ||
+        (void *) event->transport == object) {
+      pn_collector_remove(collector, event);
+    }
+    event = next;
+  }
+}
+
+void pn_collector_forget(pn_collector_t *collector, pn_delivery_t *delivery)
+{
+  if (collector && delivery->event) {
+    pn_collector_remove(collector, delivery->event);
+  }
+}
+
+pn_event_t *pn_collector_peek(pn_collector_t *collector)
+{
+  assert(collector);
+  return collector->event_head;
+}
+
+bool pn_collector_pop(pn_collector_t *collector)
+{
+  assert(collector);
+  pn_event_t *event = collector->event_head;
+  if (!event) return false;
+  pn_collector_remove(collector, event);
+  return true;
+}
+
+void pn_connection_collect(pn_connection_t *connection, pn_collector_t *collector)
+{
+  assert(connection);
+  if (connection->collector == collector) return;
+  pn_collector_purge(connection->collector, connection);
+  connection->collector = collector;
+}
+
+const char *pn_event_type_name(pn_event_type_t type)
+{
+  switch (type) {
+  case PN_EVENT_NONE:
+    return "PN_EVENT_NONE";
+  case PN_CONNECTION_STATE:
+    return "PN_CONNECTION_STATE";
+  case PN_SESSION_STATE:
+    return "PN_SESSION_STATE";
+  case PN_LINK_STATE:
+    return "PN_LINK_STATE";
+  case PN_LINK_FLOW:
+    return "PN_LINK_FLOW";
+  case PN_DELIVERY:
+    return "PN_DELIVERY";
+  case PN_TRANSPORT:
+    return "PN_TRANSPORT";
+  }
+
+  return "<unrecognized>";
+}
+
+pn_event_type_t pn_event_type(pn_event_t *event)
+{
+  return event ? event->type : PN_EVENT_NONE;
+}
+
+pn_connection_t *pn_event_connection(pn_event_t *event)
+{
+  assert(event);
+  return event->connection;
+}
+
+pn_session_t *pn_event_session(pn_event_t *event)
+{
+  assert(event);
+  return event->session;
+}
+
+pn_link_t *pn_event_link(pn_event_t *event)
+{
+  assert(event);
+  return event->link;
+}
+
+pn_delivery_t *pn_event_delivery(pn_event_t *event)
+{
+  assert(event);
+  return event->delivery;
+}
+
+pn_transport_t *pn_event_transport(pn_event_t *event)
+{
+  assert(event);
+  return event->transport;
+}
@@ -1051,6 +1051,65 @@ JNIEXPORT void JNICALL Java_org_apache_qpid_proton_jni_ProtonJNI_pn_1bytes_1from
 #endif
 
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the proxies SWIG generates for pn_message_t keep the pointer in a
+// private swigCPtr field
+static pn_message_t *message_from_proxy(JNIEnv *jenv, jobject proxy)
+{
+    if (!proxy) return NULL;
+    jclass cls = (*jenv)->GetObjectClass(jenv, proxy);
+    jfieldID fid = (*jenv)->GetFieldID(jenv, cls, "swigCPtr", "J");
+    jlong ptr = (*jenv)->GetLongField(jenv, proxy, fid);
+    (*jenv)->DeleteLocalRef(jenv, cls);
+    return *(pn_message_t **)&ptr;
+}
+
+static pn_message_t **messages_from_array(JNIEnv *jenv, jobjectArray array, jsize n)
+{
+    pn_message_t **msgs = (pn_message_t **) malloc((n ? n : 1)*sizeof(pn_message_t *));
+    if (!msgs) return NULL;
+    jsize i = 0;
+    for(i=0;i<n;i++)
+    {
+      jobject proxy = (*jenv)->GetObjectArrayElement(jenv, array, i);
+      msgs[i] = message_from_proxy(jenv, proxy);
+      (*jenv)->DeleteLocalRef(jenv, proxy);
+    }
+    return msgs;
+}
+
+JNIEXPORT jint JNICALL Java_org_apache_qpid_proton_jni_ProtonJNI_pn_1messenger_1put_1batch(JNIEnv *jenv, jclass jcls,
+                                                              jlong jarg1, jobjectArray jarg2)
+{
+    pn_messenger_t *m = *(pn_messenger_t **)&jarg1;
+    jsize n = jarg2 ? get_array_length(jenv, jarg2) : 0;
+    pn_message_t **msgs = messages_from_array(jenv, jarg2, n);
+    if (!msgs) return PN_ERR;
+    jint rval = pn_messenger_put_batch(m, msgs, n);
+    free(msgs);
+    return rval;
+}
+
+JNIEXPORT jint JNICALL Java_org_apache_qpid_proton_jni_ProtonJNI_pn_1messenger_1get_1batch(JNIEnv *jenv, jclass jcls,
+                                                              jlong jarg1, jobjectArray jarg2)
+{
+    pn_messenger_t *m = *(pn_messenger_t **)&jarg1;
+    jsize n = jarg2 ? get_array_length(jenv, jarg2) : 0;
+    pn_message_t **msgs = messages_from_array(jenv, jarg2, n);
+    if (!msgs) return PN_ERR;
+    jint rval = pn_messenger_get_batch(m, msgs, n);
+    free(msgs);
+    return rval;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+
 
   pn_delivery_t *wrap_pn_delivery(pn_link_t *link, char *STRING, size_t LENGTH) {
     return pn_delivery(link, pn_dtag(STRING, LENGTH));
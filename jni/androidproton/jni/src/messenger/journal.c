@@ -0,0 +1,597 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <proton/error.h>
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../util.h"
+#include "../platform.h"
+#include "../platform_fmt.h"
+#include "journal.h"
+
+// The journal is a sequence of memory mapped segment files, each
+// holding a header followed by records appended back to back. A put
+// record carries an encoded message and its address, a settle record
+// (tombstone) retires a run of consecutive ids. Segments are only ever
+// appended to, recovery starts a fresh one, and they are deleted oldest
+// first once nothing in them is live, so a put never outlives the
+// tombstone that retires it.
+//
+// Deleting oldest first means one long lived put pins every segment
+// after its own. Moving live puts forward would lift that, but needs
+// the live ids of each segment and a recovery that copes with ids out
+// of order and copied twice, so for now the disk used is bounded only
+// by the oldest unsettled message.
+
+#define PNI_JOURNAL_MAGIC (0x4a4e5050)
+#define PNI_JOURNAL_SEGMENT (4*1024*1024)
+#define PNI_JOURNAL_LATENCY (10)
+#define PNI_JOURNAL_SYNC_SIZE (1024*1024)
+
+#define PNI_RECORD_PUT (1)
+#define PNI_RECORD_SETTLE (2)
+
+typedef struct {
+  uint32_t magic;
+  uint32_t sequence;
+} pni_segment_header_t;
+
+typedef struct {
+  uint32_t size;      // of the record, zero past the last, padded to 8
+  uint32_t checksum;  // over the rest of the record
+  uint64_t id;
+  uint16_t type;
+  uint16_t priority;  // of the message in a put
+  uint32_t count;     // address length of a put, ids retired by a settle
+} pni_record_t;
+
+#define pni_pad(SIZE) (((SIZE) + 7) & ~((size_t) 7))
+
+typedef struct pni_segment_t pni_segment_t;
+
+struct pni_segment_t {
+  uint32_t sequence;
+  uint64_t first;     // first id put here, zero if none
+  size_t live;        // puts not yet settled
+  int fd;
+  char *map;          // only the segment being appended to is mapped
+  size_t size;
+  size_t offset;
+  size_t synced;
+  pni_segment_t *segment_next;
+  pni_segment_t *segment_prev;
+};
+
+struct pni_journal_t {
+  pn_error_t *error;
+  char *directory;
+  pni_segment_t *segment_head;  // oldest first, the tail is appended to
+  pni_segment_t *segment_tail;
+  uint32_t sequence;
+  uint64_t next_id;
+  uint64_t settle_first;        // run of settled ids not yet written
+  uint32_t settle_count;
+  int latency;
+  size_t sync_size;
+  size_t dirty;
+  pn_timestamp_t dirty_since;
+};
+
+pni_journal_t *pni_journal(void)
+{
+  pni_journal_t *journal = (pni_journal_t *) malloc(sizeof(pni_journal_t));
+  if (!journal) return NULL;
+  journal->error = pn_error();
+  journal->directory = NULL;
+  journal->segment_head = NULL;
+  journal->segment_tail = NULL;
+  journal->sequence = 0;
+  journal->next_id = 1;
+  journal->settle_first = 0;
+  journal->settle_count = 0;
+  journal->latency = PNI_JOURNAL_LATENCY;
+  journal->sync_size = PNI_JOURNAL_SYNC_SIZE;
+  journal->dirty = 0;
+  journal->dirty_since = 0;
+  return journal;
+}
+
+static void pni_segment_path(pni_journal_t *journal, uint32_t sequence,
+                             char *path, size_t size)
+{
+  snprintf(path, size, "%s/%08x.pnj", journal->directory, sequence);
+}
+
+static void pni_segment_close(pni_segment_t *segment)
+{
+  if (segment->map) {
+    munmap(segment->map, segment->size);
+    segment->map = NULL;
+  }
+  if (segment->fd >= 0) {
+    close(segment->fd);
+    segment->fd = -1;
+  }
+}
+
+static void pni_journal_clear(pni_journal_t *journal)
+{
+  while (journal->segment_head) {
+    pni_segment_t *segment = journal->segment_head;
+    LL_REMOVE(journal, segment, segment);
+    pni_segment_close(segment);
+    free(segment);
+  }
+}
+
+void pni_journal_free(pni_journal_t *journal)
+{
+  if (!journal) return;
+  if (journal->directory) pni_journal_commit(journal, 0, true);
+  pni_journal_clear(journal);
+  free(journal->directory);
+  pn_error_free(journal->error);
+  free(journal);
+}
+
+pn_error_t *pni_journal_error(pni_journal_t *journal)
+{
+  assert(journal);
+  return journal->error;
+}
+
+void pni_journal_set_sync(pni_journal_t *journal, int latency, size_t size)
+{
+  assert(journal);
+  journal->latency = latency;
+  journal->sync_size = size;
+}
+
+static uint32_t pni_checksum(const char *bytes, size_t size)
+{
+  // FNV-1a a word at a time, enough to spot a record torn by a crash
+  uint64_t hash = 14695981039346656037u;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+    hash ^= word;
+    hash *= 1099511628211u;
+  }
+  for (; i < size; i++) {
+    hash ^= (unsigned char) bytes[i];
+    hash *= 1099511628211u;
+  }
+  return (uint32_t) (hash ^ (hash >> 32));
+}
+
+#define pni_record_checksum(R) \
+  pni_checksum((const char *) &(R)->id, (R)->size - 2*sizeof(uint32_t))
+
+static int pni_segment_sync(pni_journal_t *journal, pni_segment_t *segment)
+{
+  if (segment->synced == segment->offset) return 0;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t start = segment->synced & ~(page - 1);
+  if (msync(segment->map + start, segment->offset - start, MS_SYNC)) {
+    return pn_i_error_from_errno(journal->error, "msync");
+  }
+  segment->synced = segment->offset;
+  return 0;
+}
+
+// start a new segment big enough for at least a record of the given
+// size, the current one is synced and unmapped
+static int pni_journal_roll(pni_journal_t *journal, size_t needed)
+{
+  pni_segment_t *tail = journal->segment_tail;
+  if (tail) {
+    int err = pni_segment_sync(journal, tail);
+    if (err) return err;
+    pni_segment_close(tail);
+  }
+
+  pni_segment_t *segment = (pni_segment_t *) malloc(sizeof(pni_segment_t));
+  if (!segment) return pn_error_set(journal->error, PN_ERR, "unable to allocate segment");
+  segment->sequence = journal->sequence++;
+  segment->first = 0;
+  segment->live = 0;
+  segment->size = pn_max(PNI_JOURNAL_SEGMENT, needed + sizeof(pni_segment_header_t));
+  segment->offset = sizeof(pni_segment_header_t);
+  segment->synced = 0;
+  segment->map = NULL;
+
+  char path[1024];
+  pni_segment_path(journal, segment->sequence, path, sizeof(path));
+  segment->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (segment->fd < 0 || ftruncate(segment->fd, segment->size)) {
+    int err = pn_i_error_from_errno(journal->error, path);
+    pni_segment_close(segment);
+    free(segment);
+    return err;
+  }
+  void *map = mmap(NULL, segment->size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+  if (map == MAP_FAILED) {
+    int err = pn_i_error_from_errno(journal->error, "mmap");
+    pni_segment_close(segment);
+    unlink(path);
+    free(segment);
+    return err;
+  }
+  segment->map = (char *) map;
+
+  pni_segment_header_t *header = (pni_segment_header_t *) segment->map;
+  header->magic = PNI_JOURNAL_MAGIC;
+  header->sequence = segment->sequence;
+  LL_ADD(journal, segment, segment);
+  return 0;
+}
+
+static pni_record_t *pni_journal_reserve(pni_journal_t *journal, size_t size)
+{
+  pni_segment_t *tail = journal->segment_tail;
+  if (!tail || tail->offset + size > tail->size) {
+    if (pni_journal_roll(journal, size)) return NULL;
+    tail = journal->segment_tail;
+  }
+  pni_record_t *record = (pni_record_t *) (tail->map + tail->offset);
+  tail->offset += size;
+  if (!journal->dirty) journal->dirty_since = pn_i_now();
+  journal->dirty += size;
+  return record;
+}
+
+static int pni_journal_tombstone(pni_journal_t *journal)
+{
+  if (!journal->settle_count) return 0;
+  pni_record_t *record = pni_journal_reserve(journal, sizeof(pni_record_t));
+  if (!record) return pn_error_code(journal->error);
+  record->size = sizeof(pni_record_t);
+  record->id = journal->settle_first;
+  record->type = PNI_RECORD_SETTLE;
+  record->priority = 0;
+  record->count = journal->settle_count;
+  record->checksum = pni_record_checksum(record);
+  journal->settle_count = 0;
+  return 0;
+}
+
+int pni_journal_append(pni_journal_t *journal, const char *address,
+                       uint8_t priority, pn_bytes_t bytes, uint64_t *id)
+{
+  assert(journal && journal->directory);
+  size_t length = strlen(address);
+  size_t size = sizeof(pni_record_t) + length + bytes.size;
+  pni_record_t *record = pni_journal_reserve(journal, pni_pad(size));
+  if (!record) return pn_error_code(journal->error);
+
+  char *data = (char *) (record + 1);
+  memcpy(data, address, length);
+  memcpy(data + length, bytes.start, bytes.size);
+  record->size = size;
+  record->id = journal->next_id++;
+  record->type = PNI_RECORD_PUT;
+  record->priority = priority;
+  record->count = length;
+  record->checksum = pni_record_checksum(record);
+
+  pni_segment_t *tail = journal->segment_tail;
+  if (!tail->first) tail->first = record->id;
+  tail->live++;
+  *id = record->id;
+  return pni_journal_commit(journal, pn_i_now(), false);
+}
+
+// drop the oldest segments once nothing in them is live
+static void pni_journal_reclaim(pni_journal_t *journal)
+{
+  pni_segment_t *segment;
+  while ((segment = journal->segment_head) && segment != journal->segment_tail &&
+         !segment->live) {
+    char path[1024];
+    pni_segment_path(journal, segment->sequence, path, sizeof(path));
+    LL_REMOVE(journal, segment, segment);
+    pni_segment_close(segment);
+    unlink(path);
+    free(segment);
+  }
+}
+
+void pni_journal_settle(pni_journal_t *journal, uint64_t id)
+{
+  assert(journal);
+
+  // segments hold ascending runs of ids
+  pni_segment_t *segment = journal->segment_tail;
+  while (segment && !(segment->first && segment->first <= id)) {
+    segment = segment->segment_prev;
+  }
+  if (!segment || !segment->live) return;
+  segment->live--;
+
+  if (journal->settle_count && journal->settle_first + journal->settle_count == id) {
+    journal->settle_count++;
+  } else {
+    // a failure here costs a redelivery after a restart, nothing more
+    pni_journal_tombstone(journal);
+    journal->settle_first = id;
+    journal->settle_count = 1;
+  }
+
+  if (!segment->live) pni_journal_reclaim(journal);
+}
+
+int pni_journal_commit(pni_journal_t *journal, pn_timestamp_t now, bool force)
+{
+  assert(journal);
+  int err = pni_journal_tombstone(journal);
+  if (err) return err;
+  if (!journal->dirty) return 0;
+  if (force || journal->dirty >= journal->sync_size ||
+      now - journal->dirty_since >= journal->latency) {
+    err = pni_segment_sync(journal, journal->segment_tail);
+    if (err) return err;
+    journal->dirty = 0;
+    journal->dirty_since = 0;
+  }
+  return 0;
+}
+
+pn_timestamp_t pni_journal_deadline(pni_journal_t *journal)
+{
+  assert(journal);
+  if (!journal->dirty) return 0;
+  return journal->dirty_since + journal->latency;
+}
+
+typedef struct {
+  uint64_t id;
+  pni_segment_t *segment;
+  pni_record_t *record;
+  bool settled;
+} pni_recovered_t;
+
+typedef struct {
+  pni_recovered_t *puts;
+  size_t size;
+  size_t capacity;
+} pni_recovery_t;
+
+static int pni_recovery_put(pni_journal_t *journal, pni_recovery_t *recovery,
+                            pni_segment_t *segment, pni_record_t *record)
+{
+  if (recovery->size == recovery->capacity) {
+    size_t capacity = recovery->capacity ? 2*recovery->capacity : 1024;
+    pni_recovered_t *puts = (pni_recovered_t *)
+      realloc(recovery->puts, capacity*sizeof(pni_recovered_t));
+    if (!puts) return pn_error_set(journal->error, PN_ERR, "unable to allocate recovery");
+    recovery->puts = puts;
+    recovery->capacity = capacity;
+  }
+  pni_recovered_t *put = &recovery->puts[recovery->size++];
+  put->id = record->id;
+  put->segment = segment;
+  put->record = record;
+  put->settled = false;
+  if (!segment->first) segment->first = record->id;
+  segment->live++;
+  return 0;
+}
+
+static void pni_recovery_settle(pni_recovery_t *recovery, uint64_t first, uint32_t count)
+{
+  // puts are recorded in ascending id order
+  size_t lo = 0, hi = recovery->size;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo)/2;
+    if (recovery->puts[mid].id < first) lo = mid + 1;
+    else hi = mid;
+  }
+  for (size_t i = lo; i < recovery->size && recovery->puts[i].id < first + count; i++) {
+    pni_recovered_t *put = &recovery->puts[i];
+    if (!put->settled) {
+      put->settled = true;
+      put->segment->live--;
+    }
+  }
+}
+
+// map an existing segment and index its records, stopping at the
+// first one that is torn
+static int pni_journal_scan(pni_journal_t *journal, pni_recovery_t *recovery,
+                            pni_segment_t *segment, const char *path)
+{
+  segment->fd = open(path, O_RDONLY);
+  struct stat st;
+  if (segment->fd < 0 || fstat(segment->fd, &st)) {
+    return pn_i_error_from_errno(journal->error, path);
+  }
+  segment->size = st.st_size;
+  if (segment->size < sizeof(pni_segment_header_t)) return 0;
+  void *map = mmap(NULL, segment->size, PROT_READ, MAP_PRIVATE, segment->fd, 0);
+  if (map == MAP_FAILED) {
+    return pn_i_error_from_errno(journal->error, "mmap");
+  }
+  segment->map = (char *) map;
+
+  pni_segment_header_t *header = (pni_segment_header_t *) segment->map;
+  if (header->magic != PNI_JOURNAL_MAGIC) {
+    return pn_error_format(journal->error, PN_ERR, "%s: not a journal segment", path);
+  }
+
+  size_t offset = sizeof(pni_segment_header_t);
+  while (offset + sizeof(pni_record_t) <= segment->size) {
+    pni_record_t *record = (pni_record_t *) (segment->map + offset);
+    if (record->size < sizeof(pni_record_t) ||
+        pni_pad(record->size) > segment->size - offset ||
+        record->checksum != pni_record_checksum(record)) {
+      break;
+    }
+    if (record->type == PNI_RECORD_PUT) {
+      if (record->count > record->size - sizeof(pni_record_t)) break;
+      int err = pni_recovery_put(journal, recovery, segment, record);
+      if (err) return err;
+    } else if (record->type == PNI_RECORD_SETTLE) {
+      pni_recovery_settle(recovery, record->id, record->count);
+    }
+    uint64_t next = record->id + (record->type == PNI_RECORD_SETTLE ? record->count : 1);
+    if (next > journal->next_id) journal->next_id = next;
+    offset += pni_pad(record->size);
+  }
+  return 0;
+}
+
+static int pni_sequence_compare(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *) a;
+  uint32_t y = *(const uint32_t *) b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static int pni_journal_recover(pni_journal_t *journal, pni_recovery_t *recovery,
+                               pni_journal_recover_t recover, void *context)
+{
+  DIR *dir = opendir(journal->directory);
+  if (!dir) return pn_i_error_from_errno(journal->error, journal->directory);
+
+  uint32_t *sequences = NULL;
+  size_t count = 0, capacity = 0;
+  struct dirent *ent;
+  while ((ent = readdir(dir))) {
+    unsigned int sequence;
+    char suffix[8];
+    if (sscanf(ent->d_name, "%8x.%3s", &sequence, suffix) != 2 ||
+        strcmp(suffix, "pnj") || strlen(ent->d_name) != 12) continue;
+    if (count == capacity) {
+      capacity = capacity ? 2*capacity : 16;
+      uint32_t *more = (uint32_t *) realloc(sequences, capacity*sizeof(uint32_t));
+      if (!more) {
+        free(sequences);
+        closedir(dir);
+        return pn_error_set(journal->error, PN_ERR, "unable to allocate recovery");
+      }
+      sequences = more;
+    }
+    sequences[count++] = sequence;
+  }
+  closedir(dir);
+  if (count) qsort(sequences, count, sizeof(uint32_t), pni_sequence_compare);
+
+  int err = 0;
+  for (size_t i = 0; i < count && !err; i++) {
+    pni_segment_t *segment = (pni_segment_t *) malloc(sizeof(pni_segment_t));
+    if (!segment) {
+      err = pn_error_set(journal->error, PN_ERR, "unable to allocate segment");
+      break;
+    }
+    segment->sequence = sequences[i];
+    segment->first = 0;
+    segment->live = 0;
+    segment->fd = -1;
+    segment->map = NULL;
+    segment->size = 0;
+    segment->offset = 0;
+    segment->synced = 0;
+    LL_ADD(journal, segment, segment);
+    journal->sequence = sequences[i] + 1;
+
+    char path[1024];
+    pni_segment_path(journal, segment->sequence, path, sizeof(path));
+    err = pni_journal_scan(journal, recovery, segment, path);
+  }
+  free(sequences);
+
+  for (size_t i = 0; i < recovery->size && !err; i++) {
+    pni_recovered_t *put = &recovery->puts[i];
+    if (put->settled) continue;
+    pni_record_t *record = put->record;
+    char *data = (char *) (record + 1);
+    size_t size = record->size - sizeof(pni_record_t) - record->count;
+    // the address is not terminated in the record
+    char *address = pn_strndup(data, record->count);
+    if (!address) {
+      err = pn_error_set(journal->error, PN_ERR, "unable to allocate address");
+      break;
+    }
+    err = recover(context, put->id, address, record->priority,
+                  pn_bytes(size, data + record->count));
+    free(address);
+    if (err) pn_error_format(journal->error, err, "recovery of message %" PRIu64 " failed", put->id);
+  }
+
+  pni_segment_t *segment = journal->segment_head;
+  while (segment) {
+    pni_segment_close(segment);
+    segment = segment->segment_next;
+  }
+  return err;
+}
+
+int pni_journal_open(pni_journal_t *journal, const char *directory,
+                     pni_journal_recover_t recover, void *context)
+{
+  assert(journal);
+  if (journal->directory) return pn_error_set(journal->error, PN_STATE_ERR, "journal already open");
+  if (mkdir(directory, 0700) && errno != EEXIST) {
+    return pn_i_error_from_errno(journal->error, directory);
+  }
+  journal->directory = pn_strdup(directory);
+  if (!journal->directory) return pn_error_set(journal->error, PN_ERR, "unable to allocate directory");
+
+  pni_recovery_t recovery = {NULL, 0, 0};
+  int err = pni_journal_recover(journal, &recovery, recover, context);
+  free(recovery.puts);
+  if (!err) err = pni_journal_roll(journal, 0);
+  if (err) {
+    pni_journal_clear(journal);
+    free(journal->directory);
+    journal->directory = NULL;
+    return err;
+  }
+  pni_journal_reclaim(journal);
+  return 0;
+}
+
+static int pni_journal_backend_append(void *context, const char *address,
+                                      uint8_t priority, pn_bytes_t bytes,
+                                      uint64_t *id)
+{
+  return pni_journal_append((pni_journal_t *) context, address, priority,
+                            bytes, id);
+}
+
+static void pni_journal_backend_settle(void *context, uint64_t id)
+{
+  pni_journal_settle((pni_journal_t *) context, id);
+}
+
+const pni_store_backend_t pni_journal_backend = {
+  pni_journal_backend_append,
+  pni_journal_backend_settle
+};
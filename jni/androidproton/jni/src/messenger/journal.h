@@ -0,0 +1,53 @@
+#ifndef _PROTON_JOURNAL_H
+#define _PROTON_JOURNAL_H 1
+
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <proton/engine.h>
+#include <proton/error.h>
+#include <proton/messenger.h>
+#include "store.h"
+
+typedef struct pni_journal_t pni_journal_t;
+
+// called in order for each message still unsettled when a journal is
+// opened, a non zero return abandons the open
+typedef int (*pni_journal_recover_t)(void *context, uint64_t id,
+                                     const char *address, uint8_t priority,
+                                     pn_bytes_t bytes);
+
+pni_journal_t *pni_journal(void);
+void pni_journal_free(pni_journal_t *journal);
+pn_error_t *pni_journal_error(pni_journal_t *journal);
+int pni_journal_open(pni_journal_t *journal, const char *directory,
+                     pni_journal_recover_t recover, void *context);
+void pni_journal_set_sync(pni_journal_t *journal, int latency, size_t size);
+int pni_journal_append(pni_journal_t *journal, const char *address,
+                       uint8_t priority, pn_bytes_t bytes, uint64_t *id);
+void pni_journal_settle(pni_journal_t *journal, uint64_t id);
+int pni_journal_commit(pni_journal_t *journal, pn_timestamp_t now, bool force);
+pn_timestamp_t pni_journal_deadline(pni_journal_t *journal);
+
+// the journal as a backend for pni_store_set_backend
+extern const pni_store_backend_t pni_journal_backend;
+
+#endif /* journal.h */
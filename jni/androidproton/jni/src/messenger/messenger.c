@@ -21,11 +21,13 @@
 
 #include <proton/messenger.h>
 #include <proton/driver.h>
+#include <proton/event.h>
 #include <proton/util.h>
 #include <proton/ssl.h>
 #include <proton/object.h>
 #include <assert.h>
 #include <ctype.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -33,8 +35,10 @@
 #include "../platform.h"
 #include "../platform_fmt.h"
 #include "store.h"
+#include "journal.h"
 #include "transform.h"
 #include "subscription.h"
+#include "messenger.h"
 
 #ifdef __ANDROID__
 /*android headers
@@ -47,6 +51,8 @@
 #endif
 
 typedef struct pn_link_ctx_t pn_link_ctx_t;
+typedef struct pn_connection_ctx_t pn_connection_ctx_t;
+typedef struct pni_redial_t pni_redial_t;
 
 typedef struct {
   pn_string_t *text;
@@ -59,6 +65,20 @@ typedef struct {
   char *name;
 } pn_address_t;
 
+// receivers waiting for credit, holding credit, or being asked to
+// hand back what they hold
+typedef struct {
+  pn_link_ctx_t *credit_head;
+  pn_link_ctx_t *credit_tail;
+  int size;
+} pni_credit_queue_t;
+
+// a status change waiting to be handed to the tracker callback
+typedef struct {
+  pn_tracker_t tracker;
+  pn_status_t status;
+} pni_completion_t;
+
 // algorithm for granting credit to receivers
 typedef  enum {
   // pn_messenger_recv( X ), where:
@@ -66,6 +86,9 @@ typedef  enum {
   LINK_CREDIT_AUTO   // X == -1
 } pn_link_credit_mode_t;
 
+// default for the bytes of a streamed message waiting to be sent
+#define PNI_STREAM_HIGH_WATER (64*1024)
+
 struct pn_messenger_t {
   char *name;
   char *certificate;
@@ -75,17 +98,31 @@ struct pn_messenger_t {
   int timeout;
   bool blocking;
   pn_driver_t *driver;
+  pn_collector_t *collector;
   int send_threshold;
   pn_link_credit_mode_t credit_mode;
   int credit_batch;  // when LINK_CREDIT_AUTO
   int credit;        // available
   int distributed;   // credit
   int receivers;     // # receiver links
-  int draining;      // # links in drain state
-  pn_list_t *credited;
-  pn_list_t *blocked;
+  int weights;       // sum of receiver weights
+  pni_credit_queue_t blocked;
+  pni_credit_queue_t credited;
+  pni_credit_queue_t draining;
+  int drain_latency;
   pn_timestamp_t next_drain;
+  // connections with local work to push out, or recently busy ones
+  // still winding down
+  pn_connection_ctx_t *pending_head;
+  pn_connection_ctx_t *pending_tail;
+  pn_tracker_callback_t tracker_callback;
+  void *tracker_context;
+  pni_completion_t *completed;
+  size_t completed_size;
+  size_t completed_capacity;
+  pni_journal_t *journal;
   uint64_t next_tag;
+  size_t encoded_size; // of the last put, sizes the next buffer
   pni_store_t *outgoing;
   pni_store_t *incoming;
   pn_list_t *subscriptions;
@@ -98,8 +135,25 @@ struct pn_messenger_t {
   pn_tracker_t incoming_tracker;
   pn_string_t *original;
   pn_string_t *rewritten;
+  pn_string_t *room_address; // a blocked put is waiting to go to
+  pni_entry_t *stream;       // the message being streamed, if any
+  size_t stream_left;        // bytes of its body still to be written
+  size_t stream_high_water;
+  int stripes;
+  pn_stripe_mode_t stripe_mode;
+  int next_stripe;
+  pn_string_t *stripe_key;
+  pn_string_t *link_key;
+  int reconnect_delay;  // before the first attempt, zero for none
+  int reconnect_max;
+  uint32_t jitter;
+  pni_redial_t *redial_head;
+  pni_redial_t *redial_tail;
+  pn_string_t *redial_key;
   bool worked;
   int connection_error;
+  pn_map_t *resolved;
+  pn_string_t *resolve_key;
 };
 
 typedef struct {
@@ -155,7 +209,7 @@ static void pn_listener_ctx_free(pn_listener_t *lnr)
   pn_listener_set_context(lnr, NULL);
 }
 
-typedef struct {
+struct pn_connection_ctx_t {
   char *address;
   char *scheme;
   char *user;
@@ -163,7 +217,15 @@ typedef struct {
   char *host;
   char *port;
   pn_connector_t *connector;
-} pn_connection_ctx_t;
+  int stripe;   // which of the connections to its destination
+  int attempts; // dialled since the peer was last seen
+  bool stopped; // closed by the messenger, not to be redialled
+  bool redial;  // lost, its links are put back on a new connection
+  bool pending;
+  int idle;     // rounds processed since the last local work
+  pn_connection_ctx_t *pending_next;
+  pn_connection_ctx_t *pending_prev;
+};
 
 static pn_connection_ctx_t *pn_connection_ctx(pn_connection_t *conn,
                                               pn_connector_t *connector,
@@ -182,6 +244,14 @@ static pn_connection_ctx_t *pn_connection_ctx(pn_connection_t *conn,
   ctx->host = pn_strdup(host);
   ctx->port = pn_strdup(port);
   ctx->connector = connector;
+  ctx->stripe = 0;
+  ctx->attempts = 0;
+  ctx->stopped = false;
+  ctx->redial = false;
+  ctx->pending = false;
+  ctx->idle = 0;
+  ctx->pending_next = NULL;
+  ctx->pending_prev = NULL;
   pn_connection_set_context(conn, ctx);
   return ctx;
 }
@@ -198,6 +268,44 @@ static void pn_connection_ctx_free(pn_connection_t *conn)
   pn_connection_set_context(conn, NULL);
 }
 
+// processing a connection this many times with nothing left to do is
+// enough for its transport to notice and release its buffers
+#define PNI_CONNECTION_IDLE_ROUNDS (10)
+
+// note local work on the connection, it will be processed on the
+// next pass instead of waiting for the driver to report it
+static void pni_connection_pending(pn_messenger_t *messenger, pn_connection_t *conn)
+{
+  pn_connection_ctx_t *ctx = (pn_connection_ctx_t *) pn_connection_get_context(conn);
+  if (!ctx) return;
+  ctx->idle = 0;
+  if (!ctx->pending) {
+    LL_ADD(messenger, pending, ctx);
+    ctx->pending = true;
+  }
+}
+
+// nothing left for the connection's transport to write, including
+// deliveries still queued on its sessions
+static bool pni_connection_quiet(pn_connection_t *conn, pn_transport_t *transport)
+{
+  if (transport && !pn_transport_quiesced(transport)) return false;
+  for (pn_session_t *ssn = pn_session_head(conn, 0); ssn; ssn = pn_session_next(ssn, 0)) {
+    if (pn_session_outgoing_bytes(ssn)) return false;
+  }
+  return true;
+}
+
+static void pni_connection_unpend(pn_messenger_t *messenger, pn_connection_ctx_t *ctx)
+{
+  if (ctx->pending) {
+    LL_REMOVE(messenger, pending, ctx);
+    ctx->pending_next = NULL;
+    ctx->pending_prev = NULL;
+    ctx->pending = false;
+  }
+}
+
 #define OUTGOING (0x0000000000000000)
 #define INCOMING (0x1000000000000000)
 
@@ -216,8 +324,164 @@ static char *build_name(const char *name)
 
 struct pn_link_ctx_t {
   pn_subscription_t *subscription;
+  pn_link_t *link;
+  int weight;
+  pni_credit_queue_t *queue;
+  pn_link_ctx_t *credit_next;
+  pn_link_ctx_t *credit_prev;
+  // senders only, the addresses of messages held in the outgoing
+  // store until the link has credit for them
+  pn_list_t *waiting;
+};
+
+// an address already resolved to a connection and its links, so that
+// repeat puts to the same address skip routing, parsing and the
+// connector/link scans
+typedef struct {
+  pn_string_t *address;
+  pn_connection_t *connection;
+  pn_link_t *sender;
+  pn_link_t *receiver;
+} pni_resolved_t;
+
+static void pni_resolved_finalize(void *object)
+{
+  pni_resolved_t *resolved = (pni_resolved_t *) object;
+  pn_decref(resolved->address);
+}
+
+#define pni_resolved_initialize NULL
+#define pni_resolved_hashcode NULL
+#define pni_resolved_compare NULL
+#define pni_resolved_inspect NULL
+
+static pni_resolved_t *pni_resolved_get(pn_messenger_t *messenger, const char *address)
+{
+  if (!address) return NULL;
+  pn_string_set(messenger->resolve_key, address);
+  return (pni_resolved_t *) pn_map_get(messenger->resolved, messenger->resolve_key);
+}
+
+static void pni_resolved_put(pn_messenger_t *messenger, const char *address,
+                             pn_connection_t *connection, pn_link_t *link)
+{
+  static pn_class_t clazz = PN_CLASS(pni_resolved);
+
+  if (!address) return;
+  pni_resolved_t *resolved = pni_resolved_get(messenger, address);
+  if (resolved && resolved->connection != connection) {
+    pn_map_del(messenger->resolved, messenger->resolve_key);
+    resolved = NULL;
+  }
+  if (!resolved) {
+    resolved = (pni_resolved_t *) pn_new(sizeof(pni_resolved_t), &clazz);
+    if (!resolved) return;
+    resolved->address = pn_string(address);
+    resolved->connection = connection;
+    resolved->sender = NULL;
+    resolved->receiver = NULL;
+    pn_map_put(messenger->resolved, resolved->address, resolved);
+    pn_decref(resolved);
+  }
+
+  if (pn_link_is_sender(link)) {
+    resolved->sender = link;
+  } else {
+    resolved->receiver = link;
+  }
+}
+
+// drop every resolution going through the given connection or link
+static void pni_resolved_purge(pn_messenger_t *messenger, void *endpoint)
+{
+  pn_map_t *map = messenger->resolved;
+  pn_handle_t entry = pn_map_head(map);
+  while (entry) {
+    pni_resolved_t *resolved = (pni_resolved_t *) pn_map_value(map, entry);
+    if ((void *) resolved->connection == endpoint ||
+        (void *) resolved->sender == endpoint ||
+        (void *) resolved->receiver == endpoint) {
+      pn_map_del(map, resolved->address);
+      // the slot may have been refilled from its collision chain
+      if (pn_map_key(map, entry)) continue;
+    }
+    entry = pn_map_next(map, entry);
+  }
+}
+
+// a lost connection waiting to be dialled again, with the resolved
+// keys of the links to reopen on it; until then its destination is
+// not dialled by anything else, see pni_destination
+struct pni_redial_t {
+  pn_string_t *destination;
+  pn_list_t *senders;
+  pn_list_t *receivers;
+  pn_list_t *subscriptions; // of the receivers, kept across the redial
+  int attempts;
+  pn_timestamp_t due;
+  pni_redial_t *redial_next;
+  pni_redial_t *redial_prev;
 };
 
+static void pni_redial_free(pni_redial_t *redial)
+{
+  pn_free(redial->destination);
+  pn_free(redial->senders);
+  pn_free(redial->receivers);
+  pn_free(redial->subscriptions);
+  free(redial);
+}
+
+static void pni_redial_clear(pn_messenger_t *messenger)
+{
+  while (messenger->redial_head) {
+    pni_redial_t *redial = messenger->redial_head;
+    LL_REMOVE(messenger, redial, redial);
+    pni_redial_free(redial);
+  }
+}
+
+// connections are told apart by where they go and by stripe
+static const char *pni_destination(pn_string_t *dst, const char *scheme,
+                                   const char *user, const char *host,
+                                   const char *port, int stripe)
+{
+  pn_string_format(dst, "%s://%s%s%s:%s\x1f%d", scheme ? scheme : "",
+                   user ? user : "", user ? "@" : "", host ? host : "",
+                   port ? port : "", stripe);
+  return pn_string_get(dst);
+}
+
+static pni_redial_t *pni_redial_find(pn_messenger_t *messenger, const char *destination)
+{
+  for (pni_redial_t *r = messenger->redial_head; r; r = r->redial_next) {
+    if (!strcmp(pn_string_get(r->destination), destination)) return r;
+  }
+  return NULL;
+}
+
+// have the redial reopen a link, once
+static void pni_redial_add(pni_redial_t *redial, bool sender, const char *key,
+                           pn_subscription_t *subscription)
+{
+  pn_list_t *keys = sender ? redial->senders : redial->receivers;
+  for (size_t i = 0; i < pn_list_size(keys); i++) {
+    if (!strcmp(pn_string_get((pn_string_t *) pn_list_get(keys, i)), key)) return;
+  }
+  pn_string_t *copy = pn_string(key);
+  pn_list_add(keys, copy);
+  pn_decref(copy);
+  if (!sender) pn_list_add(redial->subscriptions, subscription);
+}
+
+static void pni_resolved_clear(pn_messenger_t *messenger)
+{
+  pn_handle_t entry;
+  while ((entry = pn_map_head(messenger->resolved))) {
+    pn_map_del(messenger->resolved, pn_map_key(messenger->resolved, entry));
+  }
+}
+
 // compute the maximum amount of credit each receiving link is
 // entitled to.  The actual credit given to the link depends on what
 // amount of credit is actually available.
@@ -228,6 +492,36 @@ static int per_link_credit( pn_messenger_t *messenger )
   return pn_max(total/messenger->receivers, 1);
 }
 
+static void pni_credit_move(pni_credit_queue_t *queue, pn_link_ctx_t *ctx)
+{
+  if (ctx->queue) {
+    LL_REMOVE(ctx->queue, credit, ctx);
+    ctx->queue->size--;
+  }
+  if (queue) {
+    LL_ADD(queue, credit, ctx);
+    queue->size++;
+  }
+  ctx->queue = queue;
+}
+
+// pick up the current weight of the receiver's subscription
+static void pni_link_reweigh(pn_messenger_t *messenger, pn_link_ctx_t *ctx)
+{
+  int weight = ctx->subscription ? pn_subscription_get_weight(ctx->subscription) : 1;
+  messenger->weights += weight - ctx->weight;
+  ctx->weight = weight;
+}
+
+// the share of the total credit a receiver is entitled to, in
+// proportion to its weight
+static int pni_link_credit(pn_messenger_t *messenger, pn_link_ctx_t *ctx)
+{
+  if (messenger->weights <= 0) return 0;
+  int64_t total = messenger->credit + messenger->distributed;
+  return pn_max((int) (total * ctx->weight / messenger->weights), 1);
+}
+
 static void link_ctx_setup( pn_messenger_t *messenger,
                             pn_connection_t *connection,
                             pn_link_t *link )
@@ -238,7 +532,16 @@ static void link_ctx_setup( pn_messenger_t *messenger,
     assert( ctx );
     assert( !pn_link_get_context(link) );
     pn_link_set_context( link, ctx );
-    pn_list_add(messenger->blocked, link);
+    ctx->link = link;
+    ctx->weight = 1;
+    messenger->weights++;
+    pni_credit_move(&messenger->blocked, ctx);
+  } else {
+    pn_link_ctx_t *ctx = (pn_link_ctx_t *) calloc(1, sizeof(pn_link_ctx_t));
+    assert( ctx );
+    assert( !pn_link_get_context(link) );
+    pn_link_set_context( link, ctx );
+    ctx->link = link;
   }
 }
 
@@ -251,11 +554,15 @@ static void link_ctx_release( pn_messenger_t *messenger, pn_link_t *link )
     assert( ctx );
     if (pn_link_get_drain(link)) {
       pn_link_set_drain(link, false);
-      assert( messenger->draining > 0 );
-      messenger->draining--;
     }
-    pn_list_remove(messenger->credited, link);
-    pn_list_remove(messenger->blocked, link);
+    pni_credit_move(NULL, ctx);
+    messenger->weights -= ctx->weight;
+    pn_link_set_context( link, NULL );
+    free( ctx );
+  } else {
+    pn_link_ctx_t *ctx = (pn_link_ctx_t *) pn_link_get_context( link );
+    if (!ctx) return;
+    pn_free(ctx->waiting);
     pn_link_set_context( link, NULL );
     free( ctx );
   }
@@ -274,16 +581,28 @@ pn_messenger_t *pn_messenger(const char *name)
     m->timeout = -1;
     m->blocking = true;
     m->driver = pn_driver();
+    m->collector = pn_collector();
     m->credit_mode = LINK_CREDIT_EXPLICIT;
     m->credit_batch = 1024;
     m->credit = 0;
     m->distributed = 0;
     m->receivers = 0;
-    m->draining = 0;
-    m->credited = pn_list(0, 0);
-    m->blocked = pn_list(0, 0);
+    m->weights = 0;
+    memset(&m->blocked, 0, sizeof(m->blocked));
+    memset(&m->credited, 0, sizeof(m->credited));
+    memset(&m->draining, 0, sizeof(m->draining));
+    m->drain_latency = 250;
     m->next_drain = 0;
+    m->pending_head = NULL;
+    m->pending_tail = NULL;
+    m->tracker_callback = NULL;
+    m->tracker_context = NULL;
+    m->completed = NULL;
+    m->completed_size = 0;
+    m->completed_capacity = 0;
+    m->journal = NULL;
     m->next_tag = 0;
+    m->encoded_size = 0;
     m->outgoing = pni_store();
     m->incoming = pni_store();
     m->subscriptions = pn_list(0, PN_REFCOUNT);
@@ -296,6 +615,24 @@ pn_messenger_t *pn_messenger(const char *name)
     m->address.text = pn_string(NULL);
     m->original = pn_string(NULL);
     m->rewritten = pn_string(NULL);
+    m->room_address = pn_string(NULL);
+    m->stream = NULL;
+    m->stream_left = 0;
+    m->stream_high_water = PNI_STREAM_HIGH_WATER;
+    m->stripes = 1;
+    m->stripe_mode = PN_STRIPE_ROUND_ROBIN;
+    m->next_stripe = 0;
+    m->stripe_key = pn_string(NULL);
+    m->link_key = pn_string(NULL);
+    m->reconnect_delay = 0;
+    m->reconnect_max = 0;
+    m->jitter = (uint32_t) pn_i_now() ^ (uint32_t) (uintptr_t) m;
+    if (!m->jitter) m->jitter = 1;
+    m->redial_head = NULL;
+    m->redial_tail = NULL;
+    m->redial_key = pn_string(NULL);
+    m->resolved = pn_map(0, 0.75, PN_REFCOUNT);
+    m->resolve_key = pn_string(NULL);
     m->connection_error = 0;
   }
 
@@ -408,6 +745,9 @@ void pn_messenger_free(pn_messenger_t *messenger)
   if (messenger) {
     pn_free(messenger->rewritten);
     pn_free(messenger->original);
+    pn_free(messenger->room_address);
+    pn_free(messenger->stripe_key);
+    pn_free(messenger->link_key);
     pn_free(messenger->address.text);
     free(messenger->name);
     free(messenger->certificate);
@@ -416,14 +756,20 @@ void pn_messenger_free(pn_messenger_t *messenger)
     free(messenger->trusted_certificates);
     pni_driver_reclaim(messenger, messenger->driver);
     pn_driver_free(messenger->driver);
+    pni_redial_clear(messenger);
+    pn_free(messenger->redial_key);
+    pn_free(messenger->resolved);
+    pn_free(messenger->resolve_key);
+    pn_collector_free(messenger->collector);
     pn_error_free(messenger->error);
+    free(messenger->completed);
+    if (messenger->stream) pn_decref(messenger->stream);
     pni_store_free(messenger->incoming);
     pni_store_free(messenger->outgoing);
+    pni_journal_free(messenger->journal);
     pn_free(messenger->subscriptions);
     pn_free(messenger->rewrites);
     pn_free(messenger->routes);
-    pn_free(messenger->credited);
-    pn_free(messenger->blocked);
     free(messenger);
   }
 }
@@ -443,6 +789,18 @@ pn_error_t *pn_messenger_error(pn_messenger_t *messenger)
   return messenger->error;
 }
 
+// credit the incoming queue has room for beyond what is already out,
+// for the messenger as a whole and for the receiver's own address
+static int pni_incoming_room(pn_messenger_t *messenger, pn_link_t *receiver)
+{
+  pni_store_t *store = messenger->incoming;
+  const char *address = pn_terminus_get_address(pn_link_source(receiver));
+  int64_t room = (int64_t) pni_store_room(store, NULL) - messenger->distributed;
+  int64_t mine = (int64_t) pni_store_room(store, address) - pn_link_remote_credit(receiver);
+  room = pn_min(room, mine);
+  return room > 0 ? (int) pn_min(room, INT_MAX) : 0;
+}
+
 // Run the credit scheduler, grant flow as needed.  Return True if
 // credit allocation for any link has changed.
 bool pn_messenger_flow(pn_messenger_t *messenger)
@@ -459,79 +817,78 @@ bool pn_messenger_flow(pn_messenger_t *messenger)
   }
 
   // account for any credit left over after draining links has completed
-  if (messenger->draining > 0) {
-    for (size_t i = 0; i < pn_list_size(messenger->credited); i++) {
-      pn_link_t *link = (pn_link_t *) pn_list_get(messenger->credited, i);
-      if (pn_link_get_drain(link)) {
-        if (!pn_link_draining(link)) {
-          // drain completed!
-          int drained = pn_link_drained(link);
-          //          printf("%s: drained %i from %p\n", messenger->name, drained, (void *) ctx->link);
-          messenger->distributed -= drained;
-          messenger->credit += drained;
-          pn_link_set_drain(link, false);
-          messenger->draining--;
-          pn_list_remove(messenger->credited, link);
-          pn_list_add(messenger->blocked, link);
-        }
-      }
+  pn_link_ctx_t *ctx = messenger->draining.credit_head;
+  while (ctx) {
+    pn_link_ctx_t *next = ctx->credit_next;
+    pn_link_t *link = ctx->link;
+    if (!pn_link_draining(link)) {
+      // drain completed!
+      int drained = pn_link_drained(link);
+      messenger->distributed -= drained;
+      messenger->credit += drained;
+      pn_link_set_drain(link, false);
+      pni_credit_move(&messenger->blocked, ctx);
     }
+    ctx = next;
   }
 
+  // serve blocked receivers in turn, each to its weighted share
   const int batch = per_link_credit(messenger);
-  while (messenger->credit > 0 && pn_list_size(messenger->blocked)) {
-    pn_link_t *link = (pn_link_t *) pn_list_get(messenger->blocked, 0);
-    pn_list_del(messenger->blocked, 0, 1);
-
-    const int more = pn_min( messenger->credit, batch );
+  ctx = messenger->blocked.credit_head;
+  while (messenger->credit > 0 && ctx) {
+    pn_link_ctx_t *next = ctx->credit_next;
+    pn_link_t *link = ctx->link;
+
+    pni_link_reweigh(messenger, ctx);
+    int more = pn_min( messenger->credit, pni_link_credit(messenger, ctx) );
+    more = pn_min( more, pni_incoming_room(messenger, link) );
+    // one with its address full stays blocked until messages are taken
+    // off the queue, the others are still served
+    if (!more) {
+      ctx = next;
+      continue;
+    }
     messenger->distributed += more;
     messenger->credit -= more;
-    //    printf("%s: flowing %i to %p\n", messenger->name, more, (void *) ctx->link);
     pn_link_flow(link, more);
-    pn_list_add(messenger->credited, link);
+    pni_credit_move(&messenger->credited, ctx);
     pn_connection_t *conn = pn_session_connection(pn_link_session(link));
     pn_connection_ctx_t *cctx;
     cctx = (pn_connection_ctx_t *)pn_connection_get_context(conn);
     // flow changed, must process it
     pn_connector_process( cctx->connector );
     updated = true;
+    ctx = next;
   }
 
-  if (!pn_list_size(messenger->blocked)) {
+  if (!messenger->blocked.credit_head) {
     messenger->next_drain = 0;
-  } else {
+  } else if (!messenger->draining.size) {
     // not enough credit for all links
-    if (!messenger->draining) {
-      //      printf("%s: let's drain\n", messenger->name);
-      if (messenger->next_drain == 0) {
-        messenger->next_drain = pn_i_now() + 250;
-        //        printf("%s: initializing next_drain\n", messenger->name);
-      } else if (messenger->next_drain <= pn_i_now()) {
-        // initiate drain, free up at most enough to satisfy blocked
-        messenger->next_drain = 0;
-        int needed = pn_list_size(messenger->blocked) * batch;
-        for (size_t i = 0; i < pn_list_size(messenger->credited); i++) {
-          pn_link_t *link = (pn_link_t *) pn_list_get(messenger->credited, i);
-          if (!pn_link_get_drain(link)) {
-            //            printf("%s: initiating drain from %p\n", messenger->name, (void *) ctx->link);
-            pn_link_set_drain(link, true);
-            needed -= pn_link_remote_credit(link);
-            messenger->draining++;
-            pn_connection_t *conn =
-              pn_session_connection(pn_link_session(link));
-            pn_connection_ctx_t *cctx;
-            cctx = (pn_connection_ctx_t *)pn_connection_get_context(conn);
-            // drain requested on link, must process it
-            pn_connector_process( cctx->connector );
-            updated = true;
-          }
-
-          if (needed <= 0) {
-            break;
-          }
-        }
-      } else {
-        //        printf("%s: delaying\n", messenger->name);
+    pn_timestamp_t now = pn_i_now();
+    if (messenger->next_drain == 0) {
+      messenger->next_drain = now + messenger->drain_latency;
+    }
+    if (messenger->next_drain <= now) {
+      // initiate drain, free up at most enough to satisfy blocked,
+      // longest credited first
+      messenger->next_drain = 0;
+      int needed = messenger->blocked.size * batch;
+      ctx = messenger->credited.credit_head;
+      while (ctx && needed > 0) {
+        pn_link_ctx_t *next = ctx->credit_next;
+        pn_link_t *link = ctx->link;
+        pn_link_set_drain(link, true);
+        needed -= pn_link_remote_credit(link);
+        pni_credit_move(&messenger->draining, ctx);
+        pn_connection_t *conn =
+          pn_session_connection(pn_link_session(link));
+        pn_connection_ctx_t *cctx;
+        cctx = (pn_connection_ctx_t *)pn_connection_get_context(conn);
+        // drain requested on link, must process it
+        pn_connector_process( cctx->connector );
+        updated = true;
+        ctx = next;
       }
     }
   }
@@ -590,6 +947,7 @@ static int pn_transport_config(pn_messenger_t *messenger,
     pn_sasl_mechanisms(sasl, "ANONYMOUS");
     pn_sasl_client(sasl);
   }
+  pn_sasl_pipeline(sasl, true);
 
   return 0;
 }
@@ -613,30 +971,33 @@ static void pn_condition_report(const char *pfx, pn_condition_t *condition)
 
 int pni_pump_in(pn_messenger_t *messenger, const char *address, pn_link_t *receiver)
 {
+  // a message sent in several transfers is taken once it is whole
   pn_delivery_t *d = pn_link_current(receiver);
-  if (!pn_delivery_readable(d) && !pn_delivery_partial(d)) {
+  if (!pn_delivery_readable(d) || pn_delivery_partial(d)) {
     return 0;
   }
 
-  pni_entry_t *entry = pni_store_put(messenger->incoming, address);
+  pni_entry_t *entry = pni_store_put(messenger->incoming, address, PN_DEFAULT_PRIORITY);
   pn_buffer_t *buf = pni_entry_bytes(entry);
   pni_entry_set_delivery(entry, d);
 
   pn_link_ctx_t *ctx = (pn_link_ctx_t *) pn_link_get_context( receiver );
   pni_entry_set_context(entry, ctx ? ctx->subscription : NULL);
 
+  // the entry adopts the bytes the transport assembled, the delivery
+  // is left with storage of the same size for the next message
   size_t pending = pn_delivery_pending(d);
-  int err = pn_buffer_ensure(buf, pending + 1);
+  int err = pn_buffer_ensure(buf, pending);
   if (err) return pn_error_format(messenger->error, err, "get: error growing buffer");
-  char *encoded = pn_buffer_bytes(buf).start;
-  ssize_t n = pn_link_recv(receiver, encoded, pending);
+  ssize_t n = pn_link_recv_buffer(receiver, buf);
   if (n != (ssize_t) pending) {
     return pn_error_format(messenger->error, n,
                            "didn't receive pending bytes: %" PN_ZI " %" PN_ZI,
                            n, pending);
   }
-  n = pn_link_recv(receiver, encoded + pending, 1);
+  n = pn_link_recv_buffer(receiver, buf);
   pn_link_advance(receiver);
+  pni_entry_account(entry);
 
   // account for the used credit
   assert( ctx );
@@ -645,37 +1006,54 @@ int pni_pump_in(pn_messenger_t *messenger, const char *address, pn_link_t *recei
 
   pn_link_t *link = receiver;
   // replenish if low (< 20% maximum batch) and credit available
-  if (!pn_link_get_drain(link) && pn_list_size(messenger->blocked) == 0 && messenger->credit > 0) {
-    const int max = per_link_credit(messenger);
+  if (!pn_link_get_drain(link) && !messenger->blocked.credit_head && messenger->credit > 0) {
+    const int max = pni_link_credit(messenger, ctx);
     const int lo_thresh = (int)(max * 0.2 + 0.5);
     if (pn_link_remote_credit(link) < lo_thresh) {
-      const int more = pn_min(messenger->credit, max - pn_link_remote_credit(link));
-      messenger->credit -= more;
-      messenger->distributed += more;
-      pn_link_flow(link, more);
+      int more = pn_min(messenger->credit, max - pn_link_remote_credit(link));
+      more = pn_min(more, pni_incoming_room(messenger, link));
+      if (more > 0) {
+        messenger->credit -= more;
+        messenger->distributed += more;
+        pn_link_flow(link, more);
+      }
     }
   }
   // check if blocked
-  if (pn_list_index(messenger->blocked, link) < 0 && pn_link_remote_credit(link) == 0) {
-    pn_list_remove(messenger->credited, link);
+  if (ctx->queue != &messenger->blocked && pn_link_remote_credit(link) == 0) {
     if (pn_link_get_drain(link)) {
       pn_link_set_drain(link, false);
-      assert( messenger->draining > 0 );
-      messenger->draining--;
     }
-    pn_list_add(messenger->blocked, link);
+    pni_credit_move(&messenger->blocked, ctx);
   }
 
   if (n != PN_EOS) {
     return pn_error_format(messenger->error, n, "PN_EOS expected");
   }
-  pn_buffer_append(buf, encoded, pending); // XXX
 
   return 0;
 }
 
+int pni_bump_out(pn_messenger_t *messenger, const char *address);
+
 void pni_messenger_reclaim_link(pn_messenger_t *messenger, pn_link_t *link)
 {
+  pn_connection_t *conn = pn_session_connection(pn_link_session(link));
+  pn_connection_ctx_t *cctx = (pn_connection_ctx_t *) pn_connection_get_context(conn);
+  bool redial = cctx && cctx->redial;
+
+  // messages still waiting for credit go the same way as those
+  // buffered on the link, unless they can wait for the redial
+  pn_link_ctx_t *ctx = (pn_link_ctx_t *) pn_link_get_context(link);
+  if (!redial && pn_link_is_sender(link) && ctx && ctx->waiting) {
+    for (size_t i = 0; i < pn_list_size(ctx->waiting); i++) {
+      const char *address = pn_string_get((pn_string_t *) pn_list_get(ctx->waiting, i));
+      while (pni_store_get(messenger->outgoing, address)) {
+        pni_bump_out(messenger, address);
+      }
+    }
+  }
+
   if (pn_link_is_receiver(link) && pn_link_credit(link) > 0) {
     int credit = pn_link_credit(link);
     messenger->credit += credit;
@@ -687,7 +1065,9 @@ void pni_messenger_reclaim_link(pn_messenger_t *messenger, pn_link_t *link)
     pni_entry_t *e = (pni_entry_t *) pn_delivery_get_context(d);
     if (e) {
       pni_entry_set_delivery(e, NULL);
-      if (pn_delivery_buffered(d)) {
+      // with the outcome unknown it goes again on the new link
+      bool requeued = redial && !pni_entry_requeue(e);
+      if (!requeued && pn_delivery_buffered(d)) {
         pni_entry_set_status(e, PN_STATUS_ABORTED);
       }
     }
@@ -699,60 +1079,80 @@ void pni_messenger_reclaim_link(pn_messenger_t *messenger, pn_link_t *link)
 
 int pni_pump_out(pn_messenger_t *messenger, const char *address, pn_link_t *sender);
 
-void pn_messenger_endpoints(pn_messenger_t *messenger, pn_connection_t *conn, pn_connector_t *ctor)
-{
-  if (pn_connection_state(conn) & PN_LOCAL_UNINIT) {
-    pn_connection_open(conn);
-  }
-
-  pn_delivery_t *d = pn_work_head(conn);
-  while (d) {
-    pn_link_t *link = pn_delivery_link(d);
-    if (pn_delivery_updated(d)) {
-      if (pn_link_is_sender(link)) {
-        pn_delivery_update(d, pn_delivery_remote_state(d));
-      }
-      pni_entry_t *e = (pni_entry_t *) pn_delivery_get_context(d);
-      if (e) pni_entry_updated(e);
+static void pni_link_wait(pn_link_t *sender, const char *address);
+
+// credit for a sender goes to whatever has been waiting for it
+static void pni_pump_waiting(pn_messenger_t *messenger, pn_link_t *sender)
+{
+  // until a streamed message on the link ends, see pn_messenger_stream_end
+  if (pn_link_current(sender)) return;
+  pn_link_ctx_t *ctx = (pn_link_ctx_t *) pn_link_get_context(sender);
+  pn_list_t *waiting = ctx ? ctx->waiting : NULL;
+  while (waiting && pn_list_size(waiting) && pn_link_credit(sender) > 0) {
+    // an address still short of credit is put back by the pump
+    pn_string_t *address = (pn_string_t *) pn_list_get(waiting, 0);
+    pn_incref(address);
+    pn_list_del(waiting, 0, 1);
+    int err = pni_pump_out(messenger, pn_string_get(address), sender);
+    if (err && pni_store_get(messenger->outgoing, pn_string_get(address))) {
+      // what it did not get out still waits for the link
+      pni_link_wait(sender, pn_string_get(address));
     }
-    pn_delivery_clear(d);
-    if (pn_delivery_readable(d)) {
-      int err = pni_pump_in(messenger, pn_terminus_get_address(pn_link_source(link)), link);
-      if (err) {
-        fprintf(stderr, "%s\n", pn_error_text(messenger->error));
-      }
-    }
-    d = pn_work_next(d);
+    pn_decref(address);
+    if (err) return;
   }
-
-  if (pn_work_head(conn)) {
-    return;
+  if (pn_link_credit(sender) > 0) {
+    pn_link_drained(sender);
   }
+}
 
-  pn_session_t *ssn = pn_session_head(conn, PN_LOCAL_UNINIT);
-  while (ssn) {
-    pn_session_open(ssn);
-    ssn = pn_session_next(ssn, PN_LOCAL_UNINIT);
+static void pni_messenger_delivery(pn_messenger_t *messenger, pn_delivery_t *d)
+{
+  pn_link_t *link = pn_delivery_link(d);
+  if (pn_delivery_updated(d)) {
+    if (pn_link_is_sender(link)) {
+      pn_delivery_update(d, pn_delivery_remote_state(d));
+    }
+    pni_entry_t *e = (pni_entry_t *) pn_delivery_get_context(d);
+    if (e) pni_entry_updated(e);
+  }
+  pn_delivery_clear(d);
+  if (pn_delivery_readable(d)) {
+    const char *address = pn_terminus_get_address(pn_link_source(link));
+    int err = pni_pump_in(messenger, address, link);
+    // deliveries that completed while queued behind this one have
+    // already had their event, pick them up now they are current
+    d = pn_link_current(link);
+    while (!err && d && !pn_delivery_partial(d)) {
+      err = pni_pump_in(messenger, address, link);
+      d = pn_link_current(link);
+    }
+    if (err) {
+      fprintf(stderr, "%s\n", pn_error_text(messenger->error));
+    }
   }
+}
 
-  pn_link_t *link = pn_link_head(conn, PN_LOCAL_UNINIT);
-  while (link) {
+static void pni_messenger_link(pn_messenger_t *messenger, pn_link_t *link)
+{
+  if (pn_link_state(link) & PN_LOCAL_UNINIT) {
+    pn_connection_t *conn = pn_session_connection(pn_link_session(link));
+    pn_connection_ctx_t *cctx = (pn_connection_ctx_t *) pn_connection_get_context(conn);
     pn_terminus_copy(pn_link_source(link), pn_link_remote_source(link));
     pn_terminus_copy(pn_link_target(link), pn_link_remote_target(link));
     link_ctx_setup( messenger, conn, link );
     pn_link_open(link);
     if (pn_link_is_receiver(link)) {
-      pn_listener_t *listener = pn_connector_listener(ctor);
+      pn_listener_t *listener = pn_connector_listener(cctx->connector);
       pn_listener_ctx_t *ctx = (pn_listener_ctx_t *) pn_listener_context(listener);
       ((pn_link_ctx_t *)pn_link_get_context(link))->subscription = ctx ? ctx->subscription : NULL;
     }
-    link = pn_link_next(link, PN_LOCAL_UNINIT);
   }
 
-  link = pn_link_head(conn, PN_LOCAL_ACTIVE | PN_REMOTE_ACTIVE);
-  while (link) {
+  pn_state_t state = pn_link_state(link);
+  if ((state & PN_LOCAL_ACTIVE) && (state & PN_REMOTE_ACTIVE)) {
     if (pn_link_is_sender(link)) {
-      pni_pump_out(messenger, pn_terminus_get_address(pn_link_target(link)), link);
+      pni_pump_waiting(messenger, link);
     } else {
       pn_link_ctx_t *ctx = (pn_link_ctx_t *) pn_link_get_context(link);
       if (ctx) {
@@ -762,52 +1162,225 @@ void pn_messenger_endpoints(pn_messenger_t *messenger, pn_connection_t *conn, pn
         }
       }
     }
-    link = pn_link_next(link, PN_LOCAL_ACTIVE | PN_REMOTE_ACTIVE);
+  } else if ((state & PN_LOCAL_ACTIVE) && (state & PN_REMOTE_CLOSED)) {
+    pn_condition_report("LINK", pn_link_remote_condition(link));
+    pn_link_close(link);
+    pni_messenger_reclaim_link(messenger, link);
+    pni_resolved_purge(messenger, link);
+    pn_link_free(link);
   }
+}
 
-  ssn = pn_session_head(conn, PN_LOCAL_ACTIVE | PN_REMOTE_CLOSED);
-  while (ssn) {
-    pn_condition_report("SESSION", pn_session_remote_condition(ssn));
-    pn_session_close(ssn);
-    ssn = pn_session_next(ssn, PN_LOCAL_ACTIVE | PN_REMOTE_CLOSED);
+static void pni_messenger_connection(pn_messenger_t *messenger, pn_connection_t *conn)
+{
+  pn_connection_ctx_t *cctx = (pn_connection_ctx_t *) pn_connection_get_context(conn);
+  // the peer answered, a later loss starts the backoff over
+  if (cctx && (pn_connection_state(conn) & PN_REMOTE_ACTIVE)) {
+    cctx->attempts = 0;
   }
+  if (pn_connection_state(conn) != (PN_LOCAL_ACTIVE | PN_REMOTE_CLOSED)) return;
 
-  link = pn_link_head(conn, PN_REMOTE_CLOSED);
-  while (link) {
-    if (PN_LOCAL_ACTIVE & pn_link_state(link)) {
-      pn_condition_report("LINK", pn_link_remote_condition(link));
-      pn_link_close(link);
-      pni_messenger_reclaim_link(messenger, link);
-      pn_link_free(link);
+  pn_connector_t *ctor = cctx->connector;
+  pn_condition_t *condition = pn_connection_remote_condition(conn);
+  pn_condition_report("CONNECTION", condition);
+  pn_connection_close(conn);
+  if (pn_condition_is_redirect(condition)) {
+    const char *host = pn_condition_redirect_host(condition);
+    char buf[1024];
+    sprintf(buf, "%i", pn_condition_redirect_port(condition));
+
+    pn_connector_process(ctor);
+    pn_connector_set_connection(ctor, NULL);
+    pn_driver_t *driver = messenger->driver;
+    pn_connector_t *connector = pn_connector(driver, host, buf, NULL);
+    pn_transport_unbind(pn_connector_transport(ctor));
+    pn_connection_reset(conn);
+    pn_transport_config(messenger, connector, conn);
+    pn_connector_set_connection(connector, conn);
+    cctx->connector = connector;
+    pni_connection_pending(messenger, conn);
+  }
+}
+
+// Drain the events recorded for all of the messenger's connections,
+// doing only the work implied by what actually changed.
+static void pni_messenger_events(pn_messenger_t *messenger)
+{
+  pn_event_t *event;
+  while ((event = pn_collector_peek(messenger->collector))) {
+    pn_event_type_t type = pn_event_type(event);
+    pn_connection_t *conn = pn_event_connection(event);
+    pn_session_t *ssn = pn_event_session(event);
+    pn_link_t *link = pn_event_link(event);
+    pn_delivery_t *d = pn_event_delivery(event);
+    // the handlers below may free the endpoint an event refers to,
+    // which discards that endpoint's events, so retire this one first
+    pn_collector_pop(messenger->collector);
+
+    switch (type) {
+    case PN_CONNECTION_STATE:
+      pni_messenger_connection(messenger, conn);
+      break;
+    case PN_SESSION_STATE:
+      if (pn_session_state(ssn) & PN_LOCAL_UNINIT) {
+        pn_session_open(ssn);
+      } else if (pn_session_state(ssn) == (PN_LOCAL_ACTIVE | PN_REMOTE_CLOSED)) {
+        pn_condition_report("SESSION", pn_session_remote_condition(ssn));
+        pn_session_close(ssn);
+      }
+      break;
+    case PN_LINK_STATE:
+      pni_messenger_link(messenger, link);
+      break;
+    case PN_LINK_FLOW:
+      if (pn_link_is_sender(link) &&
+          pn_link_state(link) == (PN_LOCAL_ACTIVE | PN_REMOTE_ACTIVE)) {
+        pni_pump_waiting(messenger, link);
+      }
+      break;
+    case PN_DELIVERY:
+      pni_messenger_delivery(messenger, d);
+      break;
+    case PN_TRANSPORT:
+      pni_connection_pending(messenger, conn);
+      break;
+    case PN_EVENT_NONE:
+      break;
     }
-    link = pn_link_next(link, PN_REMOTE_CLOSED);
   }
+}
 
-  if (pn_connection_state(conn) == (PN_LOCAL_ACTIVE | PN_REMOTE_CLOSED)) {
-    pn_condition_t *condition = pn_connection_remote_condition(conn);
-    pn_condition_report("CONNECTION", condition);
-    pn_connection_close(conn);
-    if (pn_condition_is_redirect(condition)) {
-      const char *host = pn_condition_redirect_host(condition);
-      char buf[1024];
-      sprintf(buf, "%i", pn_condition_redirect_port(condition));
-
-      pn_connector_process(ctor);
-      pn_connector_set_connection(ctor, NULL);
-      pn_driver_t *driver = messenger->driver;
-      pn_connector_t *connector = pn_connector(driver, host, buf, NULL);
-      pn_transport_unbind(pn_connector_transport(ctor));
-      pn_connection_reset(conn);
-      pn_transport_config(messenger, connector, conn);
-      pn_connector_set_connection(connector, conn);
-    }
-  } else if (pn_connector_closed(ctor) && !(pn_connection_state(conn) & PN_REMOTE_CLOSED)) {
+void pn_messenger_endpoints(pn_messenger_t *messenger, pn_connection_t *conn, pn_connector_t *ctor)
+{
+  if (pn_connection_state(conn) & PN_LOCAL_UNINIT) {
+    pn_connection_open(conn);
+  }
+
+  pni_messenger_events(messenger);
+
+  if (pn_connector_closed(ctor) && !(pn_connection_state(conn) & PN_REMOTE_CLOSED)) {
     pn_error_report("CONNECTION", "connection aborted");
   }
 
   pn_messenger_flow(messenger);
 }
 
+// xorshift, only good for spreading out redials
+static uint32_t pni_jitter(pn_messenger_t *messenger)
+{
+  uint32_t x = messenger->jitter;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  messenger->jitter = x;
+  return x;
+}
+
+static void pni_redial_schedule(pn_messenger_t *messenger, pni_redial_t *redial,
+                                int attempts)
+{
+  int64_t delay = messenger->reconnect_delay;
+  for (int i = 1; i < attempts && delay < messenger->reconnect_max; i++) {
+    delay *= 2;
+  }
+  delay = pn_min(delay, (int64_t) messenger->reconnect_max);
+  delay = delay/2 + pni_jitter(messenger) % (delay/2 + 1);
+  redial->attempts = attempts;
+  redial->due = pn_i_now() + delay;
+  LL_ADD(messenger, redial, redial);
+}
+
+// a lost outgoing connection is dialled again later, along with the
+// links resolved through it
+static void pni_messenger_schedule(pn_messenger_t *messenger, pn_connection_t *conn)
+{
+  pn_connection_ctx_t *ctx = (pn_connection_ctx_t *) pn_connection_get_context(conn);
+  if (!messenger->reconnect_delay || !ctx || !ctx->host || ctx->stopped) return;
+
+  // a destination already waiting keeps its one redial and its backoff
+  const char *destination = pni_destination(messenger->redial_key, ctx->scheme,
+                                            ctx->user, ctx->host, ctx->port,
+                                            ctx->stripe);
+  pni_redial_t *redial = pni_redial_find(messenger, destination);
+  bool scheduled = redial;
+  if (!redial) {
+    redial = (pni_redial_t *) malloc(sizeof(pni_redial_t));
+    if (!redial) return;
+    redial->destination = pn_string(destination);
+    redial->senders = pn_list(0, PN_REFCOUNT);
+    redial->receivers = pn_list(0, PN_REFCOUNT);
+    redial->subscriptions = pn_list(0, PN_REFCOUNT);
+  }
+
+  pn_map_t *map = messenger->resolved;
+  for (pn_handle_t entry = pn_map_head(map); entry; entry = pn_map_next(map, entry)) {
+    pni_resolved_t *resolved = (pni_resolved_t *) pn_map_value(map, entry);
+    if (resolved->connection != conn) continue;
+    const char *key = pn_string_get(resolved->address);
+    if (resolved->sender) {
+      pni_redial_add(redial, true, key, NULL);
+    }
+    if (resolved->receiver) {
+      pn_link_ctx_t *lctx = (pn_link_ctx_t *) pn_link_get_context(resolved->receiver);
+      pni_redial_add(redial, false, key, lctx ? lctx->subscription : NULL);
+    }
+  }
+
+  if (scheduled) {
+    ctx->redial = true;
+    return;
+  }
+  if (!pn_list_size(redial->senders) && !pn_list_size(redial->receivers)) {
+    pni_redial_free(redial);
+    return;
+  }
+  ctx->redial = true;
+  pni_redial_schedule(messenger, redial, ctx->attempts + 1);
+}
+
+// when the next redial is due, zero if none is waiting
+static pn_timestamp_t pni_redial_deadline(pn_messenger_t *messenger)
+{
+  pn_timestamp_t deadline = 0;
+  for (pni_redial_t *r = messenger->redial_head; r; r = r->redial_next) {
+    if (!deadline || r->due < deadline) deadline = r->due;
+  }
+  return deadline;
+}
+
+static void pni_messenger_redial(pn_messenger_t *messenger);
+
+// Process the connections with local work pending rather than every
+// connector, the driver reports the others once they are ready.
+static void pni_messenger_process(pn_messenger_t *messenger)
+{
+  pni_messenger_redial(messenger);
+  pni_messenger_events(messenger);
+  pn_messenger_flow(messenger);
+  pni_messenger_events(messenger);
+
+  pn_connection_ctx_t *ctx = messenger->pending_head;
+  while (ctx) {
+    pn_connection_ctx_t *next = ctx->pending_next;
+    pn_connection_t *conn = pn_connector_connection(ctx->connector);
+    if (pn_connection_state(conn) & PN_LOCAL_UNINIT) {
+      pn_connection_open(conn);
+    }
+    pn_connector_process(ctx->connector);
+    // one with output it could not write yet stays, see pn_messenger_sent
+    if (++ctx->idle >= PNI_CONNECTION_IDLE_ROUNDS &&
+        pni_connection_quiet(conn, pn_connector_transport(ctx->connector))) {
+      pni_connection_unpend(messenger, ctx);
+    }
+    ctx = next;
+  }
+
+  if (messenger->journal &&
+      pni_journal_commit(messenger->journal, pn_i_now(), false)) {
+    pn_error_report("JOURNAL", pn_error_text(pni_journal_error(messenger->journal)));
+  }
+}
+
 void pni_messenger_reclaim(pn_messenger_t *messenger, pn_connection_t *conn)
 {
   if (!conn) return;
@@ -818,6 +1391,8 @@ void pni_messenger_reclaim(pn_messenger_t *messenger, pn_connection_t *conn)
     link = pn_link_next(link, 0);
   }
 
+  pni_resolved_purge(messenger, conn);
+  pni_connection_unpend(messenger, (pn_connection_ctx_t *) pn_connection_get_context(conn));
   pn_connection_ctx_free(conn);
   pn_connection_free(conn);
 }
@@ -836,18 +1411,17 @@ pn_connection_t *pn_messenger_connection(pn_messenger_t *messenger,
 
   pn_connection_set_container(connection, messenger->name);
   pn_connection_set_hostname(connection, host);
+  pn_connection_collect(connection, messenger->collector);
+  pni_connection_pending(messenger, connection);
   return connection;
 }
 
+static void pni_messenger_complete(pn_messenger_t *messenger);
+
 int pn_messenger_tsync(pn_messenger_t *messenger, bool (*predicate)(pn_messenger_t *), int timeout)
 {
-  pn_connector_t *ctor = pn_connector_head(messenger->driver);
-  while (ctor) {
-    pn_connection_t *conn = pn_connector_connection(ctor);
-    pn_messenger_endpoints(messenger, conn, ctor);
-    pn_connector_process(ctor);
-    ctor = pn_connector_next(ctor);
-  }
+  pni_messenger_process(messenger);
+  pni_messenger_complete(messenger);
 
   pn_timestamp_t now = pn_i_now();
   long int deadline = now + timeout;
@@ -858,9 +1432,10 @@ int pn_messenger_tsync(pn_messenger_t *messenger, bool (*predicate)(pn_messenger
     int remaining = deadline - now;
     if (pred || (timeout >= 0 && remaining < 0)) break;
 
-    // Update the credit scheduler. If the scheduler detects credit
-    // imbalance on the links, wake up in time to service credit drain
-    pn_messenger_flow(messenger);
+    // Update the credit scheduler and push out whatever the last
+    // round left pending. If the scheduler detects credit imbalance
+    // on the links, wake up in time to service credit drain
+    pni_messenger_process(messenger);
     if (messenger->next_drain) {
       if (now >= messenger->next_drain)
         remaining = 0;
@@ -869,6 +1444,27 @@ int pn_messenger_tsync(pn_messenger_t *messenger, bool (*predicate)(pn_messenger
         remaining = (remaining < 0) ? delay : pn_min( remaining, delay );
       }
     }
+    // and in time to commit the journal
+    pn_timestamp_t commit = messenger->journal ? pni_journal_deadline(messenger->journal) : 0;
+    if (commit) {
+      if (now >= commit)
+        remaining = 0;
+      else {
+        const int delay = commit - now;
+        remaining = (remaining < 0) ? delay : pn_min( remaining, delay );
+      }
+    }
+    // and to redial lost connections
+    pn_timestamp_t redial = pni_redial_deadline(messenger);
+    if (redial) {
+      pn_timestamp_t wake = pn_i_now();
+      if (wake >= redial)
+        remaining = 0;
+      else {
+        const int delay = redial - wake;
+        remaining = (remaining < 0) ? delay : pn_min( remaining, delay );
+      }
+    }
     int error = pn_driver_wait(messenger->driver, remaining);
     if (error && error != PN_INTR) return error;
 
@@ -902,12 +1498,15 @@ int pn_messenger_tsync(pn_messenger_t *messenger, bool (*predicate)(pn_messenger
       if (pn_connector_closed(c)) {
         pn_connector_free(c);
         if (conn) {
+          pni_messenger_schedule(messenger, conn);
           pni_messenger_reclaim(messenger, conn);
         }
       } else {
         pn_connector_process(c);
+        if (conn) pni_connection_pending(messenger, conn);
       }
     }
+    pni_messenger_complete(messenger);
 
     if (timeout >= 0) {
       now = pn_i_now();
@@ -951,9 +1550,12 @@ int pn_messenger_stop(pn_messenger_t *messenger)
 {
   if (!messenger) return PN_ARG_ERR;
 
+  pni_redial_clear(messenger);
   pn_connector_t *ctor = pn_connector_head(messenger->driver);
   while (ctor) {
     pn_connection_t *conn = pn_connector_connection(ctor);
+    pn_connection_ctx_t *ctx = (pn_connection_ctx_t *) pn_connection_get_context(conn);
+    if (ctx) ctx->stopped = true;
     pn_link_t *link = pn_link_head(conn, PN_LOCAL_ACTIVE);
     while (link) {
       pn_link_close(link);
@@ -1016,7 +1618,8 @@ static int pni_route(pn_messenger_t *messenger, const char *address)
   return 0;
 }
 
-pn_connection_t *pn_messenger_resolve(pn_messenger_t *messenger, const char *address, char **name)
+static pn_connection_t *pni_messenger_resolve(pn_messenger_t *messenger, const char *address,
+                                              char **name, int stripe, pni_redial_t **backoff)
 {
   assert(messenger);
   messenger->connection_error = 0;
@@ -1081,6 +1684,10 @@ pn_connection_t *pn_messenger_resolve(pn_messenger_t *messenger, const char *add
     pn_connection_t *connection = pn_connector_connection(ctor);
 
     pn_connection_ctx_t *ctx = (pn_connection_ctx_t *) pn_connection_get_context(connection);
+    if (ctx->stripe != stripe) {
+      ctor = pn_connector_next(ctor);
+      continue;
+    }
     if (pn_streq(scheme, ctx->scheme) && pn_streq(user, ctx->user) &&
         pn_streq(pass, ctx->pass) && pn_streq(host, ctx->host) &&
         pn_streq(port, ctx->port)) {
@@ -1095,6 +1702,15 @@ pn_connection_t *pn_messenger_resolve(pn_messenger_t *messenger, const char *add
     ctor = pn_connector_next(ctor);
   }
 
+  // a destination lost before is left alone until its redial is due
+  const char *destination = pni_destination(messenger->redial_key, scheme, user,
+                                            host, port, stripe);
+  pni_redial_t *redial = pni_redial_find(messenger, destination);
+  if (redial) {
+    if (backoff) *backoff = redial;
+    return NULL;
+  }
+
   pn_connector_t *connector = pn_connector(messenger->driver, host,
                                            port ? port : default_port(scheme),
                                            NULL);
@@ -1109,6 +1725,7 @@ pn_connection_t *pn_messenger_resolve(pn_messenger_t *messenger, const char *add
 
   pn_connection_t *connection =
     pn_messenger_connection(messenger, connector, scheme, user, pass, host, port);
+  ((pn_connection_ctx_t *) pn_connection_get_context(connection))->stripe = stripe;
   err = pn_transport_config(messenger, connector, connection);
   if (err) {
     pni_messenger_reclaim(messenger, connection);
@@ -1125,12 +1742,54 @@ pn_connection_t *pn_messenger_resolve(pn_messenger_t *messenger, const char *add
   return connection;
 }
 
-pn_link_t *pn_messenger_link(pn_messenger_t *messenger, const char *address, bool sender)
+pn_connection_t *pn_messenger_resolve(pn_messenger_t *messenger, const char *address, char **name)
+{
+  return pni_messenger_resolve(messenger, address, name, 0, NULL);
+}
+
+// the name a stripe of a destination goes by in the outgoing queue,
+// the journal and the resolved links: the address itself for the
+// first stripe, tagged with the stripe number for the others
+static const char *pni_stripe_key(pn_string_t *key, const char *address, int stripe)
+{
+  if (!stripe || !address) return address;
+  pn_string_format(key, "%s\x1f%d", address, stripe);
+  return pn_string_get(key);
+}
+
+// the address and stripe a key names, the address is the caller's
+// to free
+static char *pni_stripe_address(const char *key, int *stripe)
+{
+  const char *tag = strrchr(key, '\x1f');
+  *stripe = tag ? atoi(tag + 1) : 0;
+  return tag ? pn_strndup(key, tag - key) : pn_strdup(key);
+}
+
+static pn_link_t *pni_stripe_link(pn_messenger_t *messenger, const char *address,
+                                  bool sender, int stripe)
 {
   char *name = NULL;
 
-  pn_connection_t *connection = pn_messenger_resolve(messenger, address, &name);
-  if (!connection) return NULL;
+  const char *key = pni_stripe_key(messenger->link_key, address, stripe);
+  pni_resolved_t *resolved = pni_resolved_get(messenger, key);
+  if (resolved) {
+    pn_link_t *link = sender ? resolved->sender : resolved->receiver;
+    // links closed locally stay around until the remote end answers
+    if (link && (pn_link_state(link) & PN_LOCAL_ACTIVE)) {
+      messenger->connection_error = 0;
+      return link;
+    }
+  }
+
+  pni_redial_t *backoff = NULL;
+  pn_connection_t *connection = pni_messenger_resolve(messenger, address, &name,
+                                                      stripe, &backoff);
+  if (!connection) {
+    // the redial brings the link up along with the others
+    if (backoff) pni_redial_add(backoff, sender, key, NULL);
+    return NULL;
+  }
   pn_connection_ctx_t *cctx = (pn_connection_ctx_t *) pn_connection_get_context(connection);
 
   pn_link_t *link = pn_link_head(connection, PN_LOCAL_ACTIVE);
@@ -1139,8 +1798,10 @@ pn_link_t *pn_messenger_link(pn_messenger_t *messenger, const char *address, boo
       const char *terminus = pn_link_is_sender(link) ?
         pn_terminus_get_address(pn_link_target(link)) :
         pn_terminus_get_address(pn_link_source(link));
-      if (pn_streq(name, terminus))
+      if (pn_streq(name, terminus)) {
+        pni_resolved_put(messenger, key, connection, link);
         return link;
+      }
     }
     link = pn_link_next(link, PN_LOCAL_ACTIVE);
   }
@@ -1176,41 +1837,201 @@ pn_link_t *pn_messenger_link(pn_messenger_t *messenger, const char *address, boo
   }
 
   pn_link_open(link);
+  pni_resolved_put(messenger, key, connection, link);
   return link;
 }
 
-pn_link_t *pn_messenger_source(pn_messenger_t *messenger, const char *source)
+pn_link_t *pn_messenger_link(pn_messenger_t *messenger, const char *address, bool sender)
 {
-  return pn_messenger_link(messenger, source, false);
+  return pni_stripe_link(messenger, address, sender, 0);
 }
 
-pn_link_t *pn_messenger_target(pn_messenger_t *messenger, const char *target)
+// bytes waiting to go out on a stripe, queued or on its session
+static size_t pni_stripe_bytes(pn_messenger_t *messenger, const char *address, int stripe)
 {
-  return pn_messenger_link(messenger, target, true);
+  const char *key = pni_stripe_key(messenger->link_key, address, stripe);
+  size_t bytes = pni_store_stream_bytes(messenger->outgoing, key);
+  pni_resolved_t *resolved = pni_resolved_get(messenger, key);
+  if (resolved && resolved->sender) {
+    bytes += pn_session_outgoing_bytes(pn_link_session(resolved->sender));
+  }
+  return bytes;
 }
 
-pn_subscription_t *pn_messenger_subscribe(pn_messenger_t *messenger, const char *source)
+// pick the stripe for a message, those of a group always share one
+// so that they arrive in order
+static int pni_messenger_stripe(pn_messenger_t *messenger, pn_message_t *msg,
+                                const char *address)
 {
-  pni_route(messenger, source);
-  if (pn_error_code(messenger->error)) return NULL;
+  int stripes = messenger->stripes;
+  if (stripes == 1 || !address) return 0;
+  const char *group = pn_message_get_group_id(msg);
+  if (group) return pn_strhash(group) % stripes;
+  if (messenger->stripe_mode == PN_STRIPE_ROUND_ROBIN) {
+    int stripe = messenger->next_stripe;
+    messenger->next_stripe = (stripe + 1) % stripes;
+    return stripe;
+  }
+  int best = 0;
+  size_t least = pni_stripe_bytes(messenger, address, 0);
+  for (int i = 1; i < stripes && least; i++) {
+    size_t bytes = pni_stripe_bytes(messenger, address, i);
+    if (bytes < least) {
+      best = i;
+      least = bytes;
+    }
+  }
+  return best;
+}
 
-  bool passive = messenger->address.passive;
-  char *scheme = messenger->address.scheme;
-  char *host = messenger->address.host;
-  char *port = messenger->address.port;
+int pn_messenger_set_stripes(pn_messenger_t *messenger, int stripes, pn_stripe_mode_t mode)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (stripes < 1 || stripes > PN_STRIPES_MAX)
+    return pn_error_format(messenger->error, PN_ARG_ERR, "invalid stripe count: %d", stripes);
+  if (mode != PN_STRIPE_ROUND_ROBIN && mode != PN_STRIPE_LEAST_BYTES)
+    return pn_error_format(messenger->error, PN_ARG_ERR, "invalid stripe mode: %d", mode);
+  messenger->stripes = stripes;
+  messenger->stripe_mode = mode;
+  messenger->next_stripe = 0;
+  return 0;
+}
 
-  if (passive) {
-    pn_listener_t *lnr = pn_listener(messenger->driver, host,
-                                     port ? port : default_port(scheme), NULL);
-    if (lnr) {
-      pn_listener_ctx_t *ctx = pn_listener_ctx(lnr, messenger, scheme, host, port);
-      if (ctx) {
-        return ctx->subscription;
-      } else {
-        pn_listener_close(lnr);
-        pn_listener_free(lnr);
-        return NULL;
-      }
+// put the links of a lost connection back on a new one, false if it
+// could not even be dialled
+static bool pni_redial_links(pn_messenger_t *messenger, pni_redial_t *redial)
+{
+  bool linked = false;
+  for (size_t i = 0; i < pn_list_size(redial->senders); i++) {
+    const char *key = pn_string_get((pn_string_t *) pn_list_get(redial->senders, i));
+    int stripe;
+    char *address = pni_stripe_address(key, &stripe);
+    pn_link_t *link = pni_stripe_link(messenger, address, true, stripe);
+    free(address);
+    if (!link) continue;
+    linked = true;
+    pn_connection_t *conn = pn_session_connection(pn_link_session(link));
+    ((pn_connection_ctx_t *) pn_connection_get_context(conn))->attempts = redial->attempts;
+    // whatever was requeued waits for the new link's credit
+    pni_pump_out(messenger, key, link);
+  }
+
+  for (size_t i = 0; i < pn_list_size(redial->receivers); i++) {
+    const char *address = pn_string_get((pn_string_t *) pn_list_get(redial->receivers, i));
+    pn_subscription_t *sub = (pn_subscription_t *) pn_list_get(redial->subscriptions, i);
+    pn_link_t *link = pni_stripe_link(messenger, address, false, 0);
+    if (!link) continue;
+    linked = true;
+    pn_connection_t *conn = pn_session_connection(pn_link_session(link));
+    ((pn_connection_ctx_t *) pn_connection_get_context(conn))->attempts = redial->attempts;
+    // the application's subscription carries over to the new link
+    pn_link_ctx_t *ctx = (pn_link_ctx_t *) pn_link_get_context(link);
+    if (sub && ctx && ctx->subscription != sub) {
+      pn_subscription_t *fresh = ctx->subscription;
+      ctx->subscription = sub;
+      pni_link_reweigh(messenger, ctx);
+      pn_list_remove(messenger->subscriptions, fresh);
+    }
+  }
+
+  return linked;
+}
+
+static void pni_messenger_redial(pn_messenger_t *messenger)
+{
+  if (!messenger->redial_head) return;
+  pn_timestamp_t now = pn_i_now();
+  pni_redial_t *redial = messenger->redial_head;
+  while (redial) {
+    pni_redial_t *next = redial->redial_next;
+    if (redial->due <= now) {
+      LL_REMOVE(messenger, redial, redial);
+      if (pni_redial_links(messenger, redial)) {
+        pni_redial_free(redial);
+      } else {
+        // refused outright, the error is only of interest to the redial
+        pn_error_clear(messenger->error);
+        pni_redial_schedule(messenger, redial, redial->attempts + 1);
+      }
+    }
+    redial = next;
+  }
+}
+
+int pn_messenger_set_reconnect(pn_messenger_t *messenger, int delay, int max_delay)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (delay < 0 || max_delay < 0)
+    return pn_error_format(messenger->error, PN_ARG_ERR,
+                           "invalid reconnect delay: %d, %d", delay, max_delay);
+  messenger->reconnect_delay = delay;
+  messenger->reconnect_max = pn_max(delay, max_delay);
+  pni_store_set_retain(messenger->outgoing, delay > 0);
+  if (!delay) pni_redial_clear(messenger);
+  return 0;
+}
+
+int pn_messenger_set_latency(pn_messenger_t *messenger, bool enabled)
+{
+  if (!messenger) return PN_ARG_ERR;
+  pni_store_set_latency(messenger->outgoing, enabled);
+  pni_store_set_latency(messenger->incoming, enabled);
+  return 0;
+}
+
+int pn_messenger_latency(pn_messenger_t *messenger, const char *address,
+                         pn_latency_t step, pn_histogram_t *histogram)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (!histogram || step < 0 || step >= PN_LATENCY_CT)
+    return pn_error_format(messenger->error, PN_ARG_ERR, "invalid latency step: %d", step);
+  memset(histogram, 0, sizeof(pn_histogram_t));
+  if (step == PN_LATENCY_RECEIVE) {
+    pni_store_latency(messenger->incoming, address, step, histogram);
+  } else if (!address) {
+    pni_store_latency(messenger->outgoing, NULL, step, histogram);
+  } else {
+    // an address is stored under a key for each of its stripes
+    for (int i = 0; i < messenger->stripes; i++) {
+      const char *key = pni_stripe_key(messenger->stripe_key, address, i);
+      pni_store_latency(messenger->outgoing, key, step, histogram);
+    }
+  }
+  return 0;
+}
+
+pn_link_t *pn_messenger_source(pn_messenger_t *messenger, const char *source)
+{
+  return pn_messenger_link(messenger, source, false);
+}
+
+pn_link_t *pn_messenger_target(pn_messenger_t *messenger, const char *target)
+{
+  return pn_messenger_link(messenger, target, true);
+}
+
+pn_subscription_t *pn_messenger_subscribe(pn_messenger_t *messenger, const char *source)
+{
+  pni_route(messenger, source);
+  if (pn_error_code(messenger->error)) return NULL;
+
+  bool passive = messenger->address.passive;
+  char *scheme = messenger->address.scheme;
+  char *host = messenger->address.host;
+  char *port = messenger->address.port;
+
+  if (passive) {
+    pn_listener_t *lnr = pn_listener(messenger->driver, host,
+                                     port ? port : default_port(scheme), NULL);
+    if (lnr) {
+      pn_listener_ctx_t *ctx = pn_listener_ctx(lnr, messenger, scheme, host, port);
+      if (ctx) {
+        return ctx->subscription;
+      } else {
+        pn_listener_close(lnr);
+        pn_listener_free(lnr);
+        return NULL;
+      }
     } else {
       pn_error_format(messenger->error, PN_ERR,
                       "unable to subscribe to address %s: %s", source,
@@ -1247,6 +2068,85 @@ int pn_messenger_set_incoming_window(pn_messenger_t *messenger, int window)
   return 0;
 }
 
+int pn_messenger_get_drain_latency(pn_messenger_t *messenger)
+{
+  assert(messenger);
+  return messenger->drain_latency;
+}
+
+int pn_messenger_set_drain_latency(pn_messenger_t *messenger, int latency)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (latency < 0)
+    return pn_error_format(messenger->error, PN_ARG_ERR, "negative drain latency: %d", latency);
+  messenger->drain_latency = latency;
+  return 0;
+}
+
+// the store reports changes while the messenger is mid update, so
+// they are queued and handed over by pni_messenger_complete
+static void pni_messenger_tracked(void *context, pn_sequence_t id, pn_status_t status)
+{
+  pn_messenger_t *messenger = (pn_messenger_t *) context;
+  if (messenger->completed_size == messenger->completed_capacity) {
+    size_t capacity = messenger->completed_capacity ? 2*messenger->completed_capacity : 16;
+    pni_completion_t *completed = (pni_completion_t *)
+      realloc(messenger->completed, capacity*sizeof(pni_completion_t));
+    if (!completed) {
+      pn_error_report("TRACKER", "out of memory, outcome not reported");
+      return;
+    }
+    messenger->completed = completed;
+    messenger->completed_capacity = capacity;
+  }
+  pni_completion_t *c = &messenger->completed[messenger->completed_size++];
+  c->tracker = pn_tracker(OUTGOING, id);
+  c->status = status;
+}
+
+static void pni_messenger_complete(pn_messenger_t *messenger)
+{
+  // the queue is taken out before the callbacks run, as a callback may
+  // settle, queueing further changes, or work the messenger, which
+  // completes again from the top
+  while (messenger->completed_size) {
+    pni_completion_t *completed = messenger->completed;
+    size_t size = messenger->completed_size;
+    size_t capacity = messenger->completed_capacity;
+    messenger->completed = NULL;
+    messenger->completed_size = 0;
+    messenger->completed_capacity = 0;
+    for (size_t i = 0; i < size; i++) {
+      pni_completion_t c = completed[i];
+      if (messenger->tracker_callback) {
+        messenger->tracker_callback(messenger, c.tracker, c.status,
+                                    messenger->tracker_context);
+      }
+    }
+    // keep the larger array for next time
+    if (capacity > messenger->completed_capacity && !messenger->completed_size) {
+      free(messenger->completed);
+      messenger->completed = completed;
+      messenger->completed_capacity = capacity;
+    } else {
+      free(completed);
+    }
+  }
+}
+
+int pn_messenger_set_tracker_callback(pn_messenger_t *messenger,
+                                      pn_tracker_callback_t callback,
+                                      void *context)
+{
+  if (!messenger) return PN_ARG_ERR;
+  messenger->tracker_callback = callback;
+  messenger->tracker_context = context;
+  pni_store_set_notify(messenger->outgoing,
+                       callback ? pni_messenger_tracked : NULL, messenger);
+  if (!callback) messenger->completed_size = 0;
+  return 0;
+}
+
 static void outward_munge(pn_messenger_t *mng, pn_message_t *msg)
 {
   char stackbuf[256];
@@ -1284,36 +2184,69 @@ int pni_bump_out(pn_messenger_t *messenger, const char *address)
   return 0;
 }
 
+static void pni_link_wait(pn_link_t *sender, const char *address)
+{
+  pn_link_ctx_t *ctx = (pn_link_ctx_t *) pn_link_get_context(sender);
+  if (!ctx->waiting) ctx->waiting = pn_list(0, PN_REFCOUNT);
+  for (size_t i = 0; i < pn_list_size(ctx->waiting); i++) {
+    pn_string_t *waiting = (pn_string_t *) pn_list_get(ctx->waiting, i);
+    if (!strcmp(pn_string_get(waiting), address)) return;
+  }
+  pn_string_t *key = pn_string(address);
+  pn_list_add(ctx->waiting, key);
+  pn_decref(key);
+}
+
+// messages wait in the store until the link has credit for them, so
+// it is the store that decides, by priority, which one goes next
 int pni_pump_out(pn_messenger_t *messenger, const char *address, pn_link_t *sender)
 {
-  pni_entry_t *entry = pni_store_get(messenger->outgoing, address);
-  if (!entry) {
-    pn_link_drained(sender);
+  // a streamed message is still being written on the link
+  if (pn_link_current(sender)) {
+    if (pni_store_get(messenger->outgoing, address)) {
+      pni_link_wait(sender, address);
+    }
     return 0;
   }
 
-  pn_buffer_t *buf = pni_entry_bytes(entry);
-  pn_bytes_t bytes = pn_buffer_bytes(buf);
-  char *encoded = bytes.start;
-  size_t size = bytes.size;
+  while (pn_link_credit(sender) > 0) {
+    pni_entry_t *entry = pni_store_get(messenger->outgoing, address);
+    if (!entry) {
+      pn_link_drained(sender);
+      return 0;
+    }
 
-  // XXX: proper tag
-  char tag[8];
-  void *ptr = &tag;
-  uint64_t next = messenger->next_tag++;
-  *((uint64_t *) ptr) = next;
-  pn_delivery_t *d = pn_delivery(sender, pn_dtag(tag, 8));
-  pni_entry_set_delivery(entry, d);
-  ssize_t n = pn_link_send(sender, encoded, size);
-  if (n < 0) {
-    pni_entry_free(entry);
-    return pn_error_format(messenger->error, n, "send error: %s",
-                           pn_error_text(pn_link_error(sender)));
-  } else {
+    pn_buffer_t *buf = pni_entry_bytes(entry);
+
+    // XXX: proper tag
+    char tag[8];
+    void *ptr = &tag;
+    uint64_t next = messenger->next_tag++;
+    *((uint64_t *) ptr) = next;
+    pn_delivery_t *d = pn_delivery(sender, pn_dtag(tag, 8));
+    pni_entry_set_delivery(entry, d);
+    ssize_t n;
+    if (pni_entry_retained(entry)) {
+      // the entry keeps its bytes in case they have to be sent again
+      pn_bytes_t bytes = pn_buffer_bytes(buf);
+      n = pn_link_send(sender, bytes.start, bytes.size);
+    } else {
+      // the encoded message becomes the delivery's payload without a copy
+      n = pn_link_send_buffer(sender, buf);
+    }
+    if (n < 0) {
+      pni_entry_free(entry);
+      return pn_error_format(messenger->error, n, "send error: %s",
+                             pn_error_text(pn_link_error(sender)));
+    }
     pn_link_advance(sender);
     pni_entry_free(entry);
-    return 0;
   }
+
+  if (pni_store_get(messenger->outgoing, address)) {
+    pni_link_wait(sender, address);
+  }
+  return 0;
 }
 
 static void pni_default_rewrite(pn_messenger_t *messenger, const char *address,
@@ -1358,65 +2291,410 @@ static void pni_restore(pn_messenger_t *messenger, pn_message_t *msg)
   pn_message_set_address(msg, pn_string_get(messenger->original));
 }
 
-int pn_messenger_put(pn_messenger_t *messenger, pn_message_t *msg)
+static bool pni_messenger_room(pn_messenger_t *messenger)
+{
+  return pni_store_room(messenger->outgoing, pn_string_get(messenger->room_address)) > 0;
+}
+
+// a put to a full outgoing queue waits for it to drain if blocking,
+// and fails otherwise; this runs before the rewrite since a put made
+// from a callback during the wait reuses the messenger's buffers
+static int pni_messenger_wait_room(pn_messenger_t *messenger, pn_message_t *msg,
+                                   int stripe)
 {
-  if (!messenger) return PN_ARG_ERR;
-  if (!msg) return pn_error_set(messenger->error, PN_ARG_ERR, "null message");
-  outward_munge(messenger, msg);
   const char *address = pn_message_get_address(msg);
+  const char *key = pni_stripe_key(messenger->stripe_key, address, stripe);
+  if (pni_store_room(messenger->outgoing, key)) return 0;
+
+  int err = 0;
+  pn_string_t *outer = pn_string(pn_string_get(messenger->room_address));
+  pn_string_set(messenger->room_address, key);
+  if (messenger->blocking) {
+    pn_messenger_tsync(messenger, pni_messenger_room, messenger->timeout);
+  }
+  if (!pni_messenger_room(messenger)) {
+    err = pn_error_format(messenger->error, PN_OVERFLOW, "outgoing queue full: %s",
+                          pn_string_get(messenger->room_address));
+  }
+  // a put waiting further out keeps waiting on its own address
+  pn_string_set(messenger->room_address, pn_string_get(outer));
+  pn_free(outer);
+  return err;
+}
 
-  pni_entry_t *entry = pni_store_put(messenger->outgoing, address);
+// store the encoded message under its original address, the message
+// itself carries the rewritten one
+static int pni_messenger_encode(pn_messenger_t *messenger, pn_message_t *msg,
+                                const char *address)
+{
+  pni_entry_t *entry = pni_store_put(messenger->outgoing, address,
+                                     pn_message_get_priority(msg));
   if (!entry)
     return pn_error_format(messenger->error, PN_ERR, "store error");
 
-  messenger->outgoing_tracker = pn_tracker(OUTGOING, pni_entry_track(entry));
   pn_buffer_t *buf = pni_entry_bytes(entry);
 
-  pni_rewrite(messenger, msg);
-  while (true) {
-    char *encoded = pn_buffer_bytes(buf).start;
-    size_t size = pn_buffer_capacity(buf);
+  // consecutive messages tend to be of similar size, start from the
+  // last one so large messages are not re-encoded at every doubling
+  int err = pn_buffer_ensure(buf, messenger->encoded_size);
+  while (!err) {
+    pn_bytes_t space = pn_buffer_space(buf);
+    size_t size = space.size;
 
-    int err = pn_message_encode(msg, encoded, &size);
+    err = pn_message_encode(msg, space.start, &size);
     if (err == PN_OVERFLOW) {
-
       err = pn_buffer_ensure(buf, 2*pn_buffer_capacity(buf));
+    } else if (err) {
+      pni_entry_free(entry);
+      return pn_error_format(messenger->error, err, "encode error: %s",
+                             pn_message_error(msg));
+    } else {
+      pn_buffer_commit(buf, size);
+      pni_entry_account(entry);
+      messenger->encoded_size = size;
+      err = pni_entry_persist(entry);
       if (err) {
-
         pni_entry_free(entry);
-        pni_restore(messenger, msg);
-
-        return pn_error_format(messenger->error, err, "put: error growing buffer");
+        return pn_error_format(messenger->error, err, "journal error: %s",
+                               pn_error_text(pni_journal_error(messenger->journal)));
       }
-    } else if (err) {
+      // tracked once stored, see pni_entry_track
+      messenger->outgoing_tracker = pn_tracker(OUTGOING, pni_entry_track(entry));
+      return 0;
+    }
+  }
 
-      pni_restore(messenger, msg);
-      return pn_error_format(messenger->error, err, "encode error: %s",
-                             pn_message_error(msg));
+  pni_entry_free(entry);
+  return pn_error_format(messenger->error, err, "put: error growing buffer");
+}
+
+static int pni_messenger_out(pn_messenger_t *messenger, const char *address,
+                             pn_link_t *sender)
+{
+  if (!sender) {
+    int err = pn_error_code(messenger->error);
+    if (err) {
+      return err;
+    } else if (messenger->connection_error) {
+      return pni_bump_out(messenger, address);
     } else {
+      return 0;
+    }
+  } else {
+    return pni_pump_out(messenger, address, sender);
+  }
+}
 
-      pni_restore(messenger, msg);
-      pn_buffer_append(buf, encoded, size); // XXX
+int pn_messenger_put(pn_messenger_t *messenger, pn_message_t *msg)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (!msg) return pn_error_set(messenger->error, PN_ARG_ERR, "null message");
+  outward_munge(messenger, msg);
+  int stripe = pni_messenger_stripe(messenger, msg, pn_message_get_address(msg));
+  int err = pni_messenger_wait_room(messenger, msg, stripe);
+  if (err) return err;
+  pni_rewrite(messenger, msg);
 
-      pn_link_t *sender = pn_messenger_target(messenger, address);
+  const char *address = pn_string_get(messenger->original);
+  const char *key = pni_stripe_key(messenger->stripe_key, address, stripe);
+  err = pni_messenger_encode(messenger, msg, key);
+  pni_restore(messenger, msg);
+  if (err) return err;
 
-      if (!sender) {
-        int err = pn_error_code(messenger->error);
-        if (err) {
-          return err;
-        } else if (messenger->connection_error) {
-          return pni_bump_out(messenger, address);
-        } else {
-          return 0;
-        }
-      } else {
+  pn_link_t *sender = pni_stripe_link(messenger, address, true, stripe);
+  return pni_messenger_out(messenger, key, sender);
+}
 
-        return pni_pump_out(messenger, address, sender);
-      }
+int pn_messenger_put_batch(pn_messenger_t *messenger, pn_message_t **msgs, int n)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (!msgs || n < 0)
+    return pn_error_set(messenger->error, PN_ARG_ERR, "null messages");
+
+  int err = 0;
+  int i;
+  for (i = 0; i < n; i++) {
+    pn_message_t *msg = msgs[i];
+    if (!msg) {
+      err = pn_error_set(messenger->error, PN_ARG_ERR, "null message");
+      break;
     }
+    outward_munge(messenger, msg);
+    int stripe = pni_messenger_stripe(messenger, msg, pn_message_get_address(msg));
+    err = pni_messenger_wait_room(messenger, msg, stripe);
+    if (err) break;
+
+    // a run of messages to the same address shares the rewrite of the
+    // first; the link is looked up each time, as waiting for room may
+    // have lost it
+    bool same = i > 0 && pn_streq(pn_message_get_address(msg),
+                                  pn_string_get(messenger->original));
+    if (same) {
+      pn_message_set_address(msg, pn_string_get(messenger->rewritten));
+    } else {
+      pni_rewrite(messenger, msg);
+    }
+
+    const char *address = pn_string_get(messenger->original);
+    const char *key = pni_stripe_key(messenger->stripe_key, address, stripe);
+    err = pni_messenger_encode(messenger, msg, key);
+    pni_restore(messenger, msg);
+    if (err) break;
+
+    pn_link_t *sender = pni_stripe_link(messenger, address, true, stripe);
+    err = pni_messenger_out(messenger, key, sender);
+    if (err) break;
+  }
+
+  return i ? i : err;
+}
+
+static bool pni_messenger_flushed(pn_messenger_t *messenger)
+{
+  return !pni_store_get(messenger->outgoing, pn_string_get(messenger->room_address));
+}
+
+static bool pni_stream_writable(pn_messenger_t *messenger)
+{
+  pn_delivery_t *d = pni_entry_get_delivery(messenger->stream);
+  if (!d) return true;
+  size_t high_water = pn_link_get_high_water(pn_delivery_link(d));
+  return !high_water || pn_delivery_pending(d) < high_water;
+}
+
+// the message goes out ahead of its body as it would be encoded with a
+// data section for a body, only with the data left to follow
+static int pni_stream_open(pn_messenger_t *messenger, pn_message_t *msg,
+                           const char *key, pn_link_t *sender, size_t size)
+{
+  pni_entry_t *entry = pni_store_put(messenger->outgoing, key,
+                                     pn_message_get_priority(msg));
+  if (!entry)
+    return pn_error_format(messenger->error, PN_ERR, "store error");
+
+  pn_buffer_t *buf = pni_entry_bytes(entry);
+  int err = pn_buffer_ensure(buf, 256);
+  while (!err) {
+    pn_bytes_t space = pn_buffer_space(buf);
+    size_t encoded = space.size;
+    err = pn_message_encode(msg, space.start, &encoded);
+    if (err == PN_OVERFLOW) {
+      err = pn_buffer_ensure(buf, 2*pn_buffer_capacity(buf));
+    } else if (!err) {
+      pn_buffer_commit(buf, encoded);
+      break;
+    }
+  }
+  if (err) {
+    pni_entry_free(entry);
+    return pn_error_format(messenger->error, err, "encode error: %s",
+                           pn_message_error(msg));
+  }
+  // described type 0x75 (data), then vbin32 with the body's size
+  char data[8] = {0x00, 0x53, 0x75, (char) 0xb0,
+                  (char) (size >> 24), (char) (size >> 16),
+                  (char) (size >> 8), (char) size};
+  pn_buffer_append(buf, data, sizeof(data));
+
+  messenger->outgoing_tracker = pn_tracker(OUTGOING, pni_entry_track(entry));
+  char tag[8];
+  void *ptr = &tag;
+  *((uint64_t *) ptr) = messenger->next_tag++;
+  pn_delivery_t *d = pn_delivery(sender, pn_dtag(tag, 8));
+  pn_bytes_t head = pn_buffer_bytes(buf);
+  pn_link_set_high_water(sender, 0);
+  pn_link_send(sender, head.start, head.size);
+  pn_link_set_high_water(sender, messenger->stream_high_water);
+
+  // the entry leaves the queue without keeping any bytes, as the body
+  // could not be sent again anyway, and stays with the delivery
+  pn_incref(entry);
+  pni_entry_free(entry);
+  pni_entry_set_delivery(entry, d);
+  messenger->stream = entry;
+  messenger->stream_left = size;
+  return 0;
+}
+
+int pn_messenger_stream_begin(pn_messenger_t *messenger, pn_message_t *msg, size_t size)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (!msg) return pn_error_set(messenger->error, PN_ARG_ERR, "null message");
+  if (messenger->stream)
+    return pn_error_set(messenger->error, PN_STATE_ERR, "already streaming a message");
+  if (pn_data_size(pn_message_body(msg)) || size > UINT32_MAX)
+    return pn_error_set(messenger->error, PN_ARG_ERR, "invalid message for streaming");
+
+  outward_munge(messenger, msg);
+  pni_rewrite(messenger, msg);
+  const char *address = pn_string_get(messenger->original);
+  int stripe = pni_messenger_stripe(messenger, msg, address);
+  pn_string_set(messenger->room_address,
+                pni_stripe_key(messenger->stripe_key, address, stripe));
+  const char *key = pn_string_get(messenger->room_address);
+
+  // anything put to the address before goes first
+  pn_link_t *sender = pni_stripe_link(messenger, address, true, stripe);
+  int err = pni_messenger_out(messenger, key, sender);
+  if (!err && sender && !pni_messenger_flushed(messenger) && messenger->blocking) {
+    pn_messenger_tsync(messenger, pni_messenger_flushed, messenger->timeout);
+    sender = pni_stripe_link(messenger, address, true, stripe);
   }
+  if (!err && !sender) {
+    err = pn_error_code(messenger->error);
+    if (!err) err = pn_error_format(messenger->error, PN_ERR, "unable to send to %s", address);
+  } else if (!err && !pni_messenger_flushed(messenger)) {
+    err = pn_error_format(messenger->error, PN_OVERFLOW,
+                          "earlier messages still waiting: %s", key);
+  }
+  if (!err) err = pni_stream_open(messenger, msg, key, sender, size);
+  pni_restore(messenger, msg);
+  return err;
+}
+
+ssize_t pn_messenger_stream_write(pn_messenger_t *messenger, const char *bytes, size_t n)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (!messenger->stream)
+    return pn_error_set(messenger->error, PN_STATE_ERR, "no message is being streamed");
+  if (n > messenger->stream_left)
+    return pn_error_format(messenger->error, PN_ARG_ERR,
+                           "write past the end of the body: %" PN_ZU " bytes left",
+                           messenger->stream_left);
+  if (!n) return 0;
+
+  if (messenger->blocking && !pni_stream_writable(messenger)) {
+    pn_messenger_tsync(messenger, pni_stream_writable, messenger->timeout);
+  }
+  pn_delivery_t *d = pni_entry_get_delivery(messenger->stream);
+  if (!d)
+    return pn_error_set(messenger->error, PN_STATE_ERR, "stream lost with its connection");
+  pn_link_t *sender = pn_delivery_link(d);
+  ssize_t taken = pn_link_send(sender, bytes, n);
+  if (taken < 0)
+    return pn_error_format(messenger->error, taken, "send error: %s",
+                           pn_error_text(pn_link_error(sender)));
+  if (!taken)
+    return pn_error_set(messenger->error, PN_OVERFLOW, "stream at its high water mark");
+  messenger->stream_left -= taken;
+  return taken;
+}
+
+ssize_t pn_messenger_stream_write_fd(pn_messenger_t *messenger, int fd, off_t offset, size_t n)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (!messenger->stream)
+    return pn_error_set(messenger->error, PN_STATE_ERR, "no message is being streamed");
+  if (n > messenger->stream_left)
+    return pn_error_format(messenger->error, PN_ARG_ERR,
+                           "write past the end of the body: %" PN_ZU " bytes left",
+                           messenger->stream_left);
+
+  pn_delivery_t *d = pni_entry_get_delivery(messenger->stream);
+  if (!d)
+    return pn_error_set(messenger->error, PN_STATE_ERR, "stream lost with its connection");
+  // the file is read as it goes out, so there is no high water mark to
+  // wait for
+  ssize_t taken = pn_link_send_fd(pn_delivery_link(d), fd, offset, n);
+  if (taken < 0)
+    return pn_error_format(messenger->error, taken, "send error: %s", pn_code(taken));
+  messenger->stream_left -= taken;
+  return taken;
+}
+
+int pn_messenger_stream_end(pn_messenger_t *messenger)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (!messenger->stream)
+    return pn_error_set(messenger->error, PN_STATE_ERR, "no message is being streamed");
+  if (messenger->stream_left)
+    return pn_error_format(messenger->error, PN_STATE_ERR,
+                           "body short by %" PN_ZU " bytes", messenger->stream_left);
+
+  pni_entry_t *entry = messenger->stream;
+  messenger->stream = NULL;
+  pn_delivery_t *d = pni_entry_get_delivery(entry);
+  pn_link_t *sender = d ? pn_delivery_link(d) : NULL;
+  if (sender) {
+    pn_link_advance(sender);
+    pn_link_set_high_water(sender, 0);
+  }
+  pn_decref(entry);
+  if (!sender)
+    return pn_error_set(messenger->error, PN_STATE_ERR, "stream lost with its connection");
+
+  // puts held back by the stream can go now
+  pni_pump_waiting(messenger, sender);
+  return 0;
+}
 
-  return PN_ERR;
+int pn_messenger_set_stream_high_water(pn_messenger_t *messenger, size_t bytes)
+{
+  if (!messenger) return PN_ARG_ERR;
+  messenger->stream_high_water = bytes;
+  return 0;
+}
+
+// put a message left over from a previous run back in the outgoing
+// queue, it keeps its place in the journal
+static int pni_messenger_recover(void *context, uint64_t id, const char *stored,
+                                 uint8_t priority, pn_bytes_t bytes)
+{
+  pn_messenger_t *messenger = (pn_messenger_t *) context;
+  // it keeps its stripe if there still is one
+  int stripe;
+  char *address = pni_stripe_address(stored, &stripe);
+  if (!address) return PN_ERR;
+  if (stripe >= messenger->stripes) stripe = 0;
+  const char *key = pni_stripe_key(messenger->stripe_key, address, stripe);
+  pni_entry_t *entry = pni_store_put(messenger->outgoing, key, priority);
+  int err = entry ? pn_buffer_append(pni_entry_bytes(entry), bytes.start, bytes.size) : PN_ERR;
+  if (err) {
+    pni_entry_free(entry);
+    free(address);
+    return err;
+  }
+  pni_entry_account(entry);
+  pni_entry_restore(entry, id);
+  pni_entry_track(entry);
+  // a message that cannot be routed yet stays in the journal, it is
+  // recovered again next time
+  pn_link_t *sender = pni_stripe_link(messenger, address, true, stripe);
+  pni_messenger_out(messenger, key, sender);
+  free(address);
+  return 0;
+}
+
+int pn_messenger_set_journal(pn_messenger_t *messenger, const char *directory)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (!directory) return pn_error_set(messenger->error, PN_ARG_ERR, "null directory");
+  if (messenger->journal)
+    return pn_error_set(messenger->error, PN_STATE_ERR, "journal already set");
+
+  pni_journal_t *journal = pni_journal();
+  if (!journal) return pn_error_set(messenger->error, PN_ERR, "unable to allocate journal");
+  int err = pni_journal_open(journal, directory, pni_messenger_recover, messenger);
+  if (err) {
+    pn_error_format(messenger->error, err, "journal error: %s",
+                    pn_error_text(pni_journal_error(journal)));
+    pni_journal_free(journal);
+    return err;
+  }
+  messenger->journal = journal;
+  pni_store_set_backend(messenger->outgoing, &pni_journal_backend, journal);
+  return 0;
+}
+
+int pn_messenger_set_journal_sync(pn_messenger_t *messenger, int latency, size_t size)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (!messenger->journal)
+    return pn_error_set(messenger->error, PN_STATE_ERR, "no journal");
+  if (latency < 0)
+    return pn_error_format(messenger->error, PN_ARG_ERR, "negative sync latency: %d", latency);
+  pni_journal_set_sync(messenger->journal, latency, size);
+  return 0;
 }
 
 pn_tracker_t pn_messenger_outgoing_tracker(pn_messenger_t *messenger)
@@ -1471,67 +2749,28 @@ int pn_messenger_settle(pn_messenger_t *messenger, pn_tracker_t tracker, int fla
 // true if all pending output has been sent to peer
 bool pn_messenger_sent(pn_messenger_t *messenger)
 {
-  int total = pni_store_size(messenger->outgoing);
+  int total = pni_store_size(messenger->outgoing) +
+    pni_store_unsettled(messenger->outgoing);
+  if (total > messenger->send_threshold) return false;
 
-  pn_connector_t *ctor = pn_connector_head(messenger->driver);
-  while (ctor) {
-
-    // check if transport is done generating output
-    pn_transport_t *transport = pn_connector_transport(ctor);
-    if (transport) {
-      if (!pn_transport_quiesced(transport)) {
-        pn_connector_process(ctor);
-        return false;
-      }
-    }
-
-    pn_connection_t *conn = pn_connector_connection(ctor);
-
-    pn_link_t *link = pn_link_head(conn, PN_LOCAL_ACTIVE);
-    while (link) {
-      if (pn_link_is_sender(link)) {
-        total += pn_link_queued(link);
-
-        pn_delivery_t *d = pn_unsettled_head(link);
-        while (d) {
-          if (!pn_delivery_remote_state(d) && !pn_delivery_settled(d)) {
-            total++;
-          }
-          d = pn_unsettled_next(d);
-        }
-      }
-      link = pn_link_next(link, PN_LOCAL_ACTIVE);
+  // only a connection still on the pending list can have output left
+  for (pn_connection_ctx_t *ctx = messenger->pending_head; ctx; ctx = ctx->pending_next) {
+    pn_connection_t *conn = pn_connector_connection(ctx->connector);
+    if (!pni_connection_quiet(conn, pn_connector_transport(ctx->connector))) {
+      pn_connector_process(ctx->connector);
+      return false;
     }
-
-    ctor = pn_connector_next(ctor);
   }
 
-  return total <= messenger->send_threshold;
+  return true;
 }
 
+// readable deliveries are moved to the incoming store as their events
+// come in, so what has been received is all there
 bool pn_messenger_rcvd(pn_messenger_t *messenger)
 {
   if (pni_store_size(messenger->incoming) > 0) return true;
-
-  pn_connector_t *ctor = pn_connector_head(messenger->driver);
-  while (ctor) {
-    pn_connection_t *conn = pn_connector_connection(ctor);
-
-    pn_delivery_t *d = pn_work_head(conn);
-    while (d) {
-      if (pn_delivery_readable(d) && !pn_delivery_partial(d)) {
-        return true;
-      }
-      d = pn_work_next(d);
-    }
-    ctor = pn_connector_next(ctor);
-  }
-
-  if (!pn_connector_head(messenger->driver) && !pn_listener_head(messenger->driver)) {
-    return true;
-  } else {
-    return false;
-  }
+  return !pn_connector_head(messenger->driver) && !pn_listener_head(messenger->driver);
 }
 
 static bool work_pred(pn_messenger_t *messenger) {
@@ -1624,39 +2863,70 @@ int pn_messenger_receiving(pn_messenger_t *messenger)
   return messenger->credit + messenger->distributed;
 }
 
-int pn_messenger_get(pn_messenger_t *messenger, pn_message_t *msg)
+// hand the next incoming message to the application, decoded into
+// msg if there is one, or copied out still encoded if there is room
+static int pni_messenger_take(pn_messenger_t *messenger, pn_message_t *msg,
+                              char *bytes, size_t *size)
 {
-  if (!messenger) return PN_ARG_ERR;
-
   pni_entry_t *entry = pni_store_get(messenger->incoming, NULL);
   // XXX: need to drain credit before returning EOS
   if (!entry) return PN_EOS;
 
-  messenger->incoming_tracker = pn_tracker(INCOMING, pni_entry_track(entry));
-  pn_buffer_t *buf = pni_entry_bytes(entry);
-  pn_bytes_t bytes = pn_buffer_bytes(buf);
-  const char *encoded = bytes.start;
-  size_t size = bytes.size;
+  pn_bytes_t encoded = pn_buffer_bytes(pni_entry_bytes(entry));
+  if (size) {
+    if (!bytes || *size < encoded.size) {
+      *size = encoded.size;
+      return PN_OVERFLOW;
+    }
+    memcpy(bytes, encoded.start, encoded.size);
+    *size = encoded.size;
+  }
 
+  messenger->incoming_tracker = pn_tracker(INCOMING, pni_entry_track(entry));
   messenger->incoming_subscription = (pn_subscription_t *) pni_entry_get_context(entry);
+  pni_entry_consumed(entry);
 
-  if (msg) {
+  int err = msg ? pn_message_decode(msg, encoded.start, encoded.size) : 0;
+  pni_entry_free(entry);
+  if (err) {
+    return pn_error_format(messenger->error, err, "error decoding message: %s",
+                           pn_message_error(msg));
+  }
+  return 0;
+}
 
-    int err = pn_message_decode(msg, encoded, size);
+int pn_messenger_get(pn_messenger_t *messenger, pn_message_t *msg)
+{
+  if (!messenger) return PN_ARG_ERR;
+  return pni_messenger_take(messenger, msg, NULL, NULL);
+}
 
-    pni_entry_free(entry);
+int pni_messenger_get_bytes(pn_messenger_t *messenger, char *bytes, size_t *size)
+{
+  assert(messenger && size);
+  return pni_messenger_take(messenger, NULL, bytes, size);
+}
 
-    if (err) {
-      return pn_error_format(messenger->error, err, "error decoding message: %s",
-                             pn_message_error(msg));
-    } else {
+size_t pni_messenger_outgoing_room(pn_messenger_t *messenger, const char *address)
+{
+  assert(messenger);
+  return pni_store_room(messenger->outgoing, address);
+}
 
-      return 0;
-    }
-  } else {
-    pni_entry_free(entry);
-    return 0;
+int pn_messenger_get_batch(pn_messenger_t *messenger, pn_message_t **msgs, int max)
+{
+  if (!messenger) return PN_ARG_ERR;
+  if (!msgs || max < 0)
+    return pn_error_set(messenger->error, PN_ARG_ERR, "null messages");
+
+  int err = 0;
+  int i;
+  for (i = 0; i < max; i++) {
+    err = pn_messenger_get(messenger, msgs[i]);
+    if (err) break;
   }
+
+  return i ? i : err;
 }
 
 pn_tracker_t pn_messenger_incoming_tracker(pn_messenger_t *messenger)
@@ -1730,9 +3000,42 @@ int pn_messenger_incoming(pn_messenger_t *messenger)
   return pni_store_size(messenger->incoming) + pn_messenger_queued(messenger, false);
 }
 
+size_t pn_messenger_outgoing_bytes(pn_messenger_t *messenger)
+{
+  return pni_store_bytes(messenger->outgoing);
+}
+
+size_t pn_messenger_incoming_bytes(pn_messenger_t *messenger)
+{
+  return pni_store_bytes(messenger->incoming);
+}
+
+int pn_messenger_set_outgoing_limit(pn_messenger_t *messenger, size_t messages, size_t bytes)
+{
+  if (!messenger) return PN_ARG_ERR;
+  pni_store_set_limit(messenger->outgoing, messages, bytes);
+  return 0;
+}
+
+int pn_messenger_set_incoming_limit(pn_messenger_t *messenger, size_t messages, size_t bytes)
+{
+  if (!messenger) return PN_ARG_ERR;
+  pni_store_set_limit(messenger->incoming, messages, bytes);
+  return 0;
+}
+
+int pn_messenger_set_address_limit(pn_messenger_t *messenger, size_t messages, size_t bytes)
+{
+  if (!messenger) return PN_ARG_ERR;
+  pni_store_set_stream_limit(messenger->outgoing, messages, bytes);
+  pni_store_set_stream_limit(messenger->incoming, messages, bytes);
+  return 0;
+}
+
 int pn_messenger_route(pn_messenger_t *messenger, const char *pattern, const char *address)
 {
   pn_transform_rule(messenger->routes, pattern, address);
+  pni_resolved_clear(messenger);
   return 0;
 }
 
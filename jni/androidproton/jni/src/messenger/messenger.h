@@ -26,5 +26,11 @@
 
 int pni_messenger_add_subscription(pn_messenger_t *messenger, pn_subscription_t *subscription);
 int pni_messenger_work(pn_messenger_t *messenger);
+// like pn_messenger_get, but copies out the message still encoded;
+// PN_OVERFLOW with the size needed if it does not fit
+int pni_messenger_get_bytes(pn_messenger_t *messenger, char *bytes, size_t *size);
+// messages the outgoing queue has room for, for the address or for the
+// queue as a whole when that is NULL
+size_t pni_messenger_outgoing_room(pn_messenger_t *messenger, const char *address);
 
 #endif /* messenger.h */
@@ -0,0 +1,479 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <proton/sharded.h>
+#include <proton/error.h>
+#include <proton/object.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../util.h"
+#include "../platform.h"
+#include "messenger.h"
+
+// messages waiting to be taken by a shard, or by the application from
+// a shard, beyond which puts are refused and the shard stops taking
+// messages off its messenger; the messenger's own queues and credit
+// then push back on the peers
+#define PNI_SHARD_BACKLOG (1024)
+
+typedef struct pni_node_t pni_node_t;
+
+// an encoded message on its way from one thread to another, the
+// bytes follow the node in the same allocation
+struct pni_node_t {
+  pni_node_t *next;
+  char *bytes;
+  size_t size;
+  int shard;
+};
+
+// Vyukov's intrusive queue: any number of producers swap themselves
+// in at the head, a single consumer follows the next pointers from
+// the tail, and the stub node stands in whenever it runs dry
+typedef struct {
+  pni_node_t *head;
+  pni_node_t *tail;
+  pni_node_t stub;
+} pni_mpsc_t;
+
+typedef struct {
+  pn_sharded_t *sharded;
+  pn_messenger_t *messenger;
+  pn_message_t *msg;
+  pni_mpsc_t inbound;
+  pni_node_t *held; // taken off inbound, waiting for room in the messenger
+  int index;
+  int pending;    // put for the shard, not yet taken by it
+  int delivered;  // handed back by the shard, not yet taken by a get
+  int sleeping;   // waiting on its driver, a put must wake it
+  bool subscribed;
+  pthread_t thread;
+} pni_shard_t;
+
+struct pn_sharded_t {
+  pni_shard_t *shard;
+  int shards;
+  int started;    // shards with a thread to join
+  pni_mpsc_t delivered;
+  pthread_mutex_t lock;
+  pthread_cond_t arrived;
+  int waiting;    // a get is blocked on arrived
+  int failed;     // put, but lost by a shard
+  int stopping;
+  bool running;
+};
+
+static void pni_mpsc_init(pni_mpsc_t *queue)
+{
+  queue->stub.next = NULL;
+  queue->head = &queue->stub;
+  queue->tail = &queue->stub;
+}
+
+static void pni_mpsc_push(pni_mpsc_t *queue, pni_node_t *node)
+{
+  __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+  pni_node_t *prev = __atomic_exchange_n(&queue->head, node, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+// NULL when empty, and also while a producer is between its swap and
+// linking in the node, in which case it signals the consumer after
+static pni_node_t *pni_mpsc_pop(pni_mpsc_t *queue)
+{
+  pni_node_t *tail = queue->tail;
+  pni_node_t *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  if (tail == &queue->stub) {
+    if (!next) return NULL;
+    queue->tail = next;
+    tail = next;
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  }
+  if (next) {
+    queue->tail = next;
+    return tail;
+  }
+  if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) return NULL;
+  pni_mpsc_push(queue, &queue->stub);
+  next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  if (next) {
+    queue->tail = next;
+    return tail;
+  }
+  return NULL;
+}
+
+// for the consumer only
+static bool pni_mpsc_empty(pni_mpsc_t *queue)
+{
+  return queue->tail == &queue->stub &&
+    __atomic_load_n(&queue->head, __ATOMIC_SEQ_CST) == &queue->stub;
+}
+
+static void pni_mpsc_clear(pni_mpsc_t *queue)
+{
+  pni_node_t *node;
+  while ((node = pni_mpsc_pop(queue))) {
+    free(node);
+  }
+}
+
+static pni_node_t *pni_node(size_t capacity)
+{
+  pni_node_t *node = (pni_node_t *) malloc(sizeof(pni_node_t) + capacity);
+  if (!node) return NULL;
+  node->bytes = (char *) (node + 1);
+  node->size = capacity;
+  node->shard = 0;
+  return node;
+}
+
+static int pni_encode(pn_message_t *msg, pni_node_t **result)
+{
+  size_t capacity = 1024;
+  while (true) {
+    pni_node_t *node = pni_node(capacity);
+    if (!node) return PN_ERR;
+    int err = pn_message_encode(msg, node->bytes, &node->size);
+    if (!err) {
+      *result = node;
+      return 0;
+    }
+    free(node);
+    if (err != PN_OVERFLOW) return err;
+    capacity *= 2;
+  }
+}
+
+static void pni_shard_failed(pni_shard_t *shard, int count)
+{
+  __atomic_add_fetch(&shard->sharded->failed, count, __ATOMIC_RELAXED);
+}
+
+// a message is only taken off inbound when the messenger has room for
+// it, a message held back for its address to drain comes first
+static bool pni_shard_hungry(pni_shard_t *shard)
+{
+  return !shard->held &&
+    pn_messenger_outgoing(shard->messenger) < PNI_SHARD_BACKLOG &&
+    pni_messenger_outgoing_room(shard->messenger, NULL) > 0;
+}
+
+// put a message into the shard's messenger, false if it has to wait
+static bool pni_shard_put_node(pni_shard_t *shard, pni_node_t *node)
+{
+  int err = pn_message_decode(shard->msg, node->bytes, node->size);
+  if (!err) {
+    err = pn_messenger_put(shard->messenger, shard->msg);
+    if (err == PN_OVERFLOW && !pn_messenger_is_blocking(shard->messenger)) {
+      shard->held = node;
+      return false;
+    }
+  }
+  if (err) pni_shard_failed(shard, 1);
+  free(node);
+  return true;
+}
+
+// move what was put for the shard into its messenger, as far as the
+// messenger has room unless the shard is draining on its way out
+static void pni_shard_put(pni_shard_t *shard, bool drain)
+{
+  pni_node_t *node = shard->held;
+  if (node) {
+    shard->held = NULL;
+    if (!pni_shard_put_node(shard, node)) return;
+  }
+  while ((drain || pni_shard_hungry(shard)) && (node = pni_mpsc_pop(&shard->inbound))) {
+    __atomic_sub_fetch(&shard->pending, 1, __ATOMIC_RELAXED);
+    if (!pni_shard_put_node(shard, node)) return;
+  }
+}
+
+// hand what the shard has received back to the application, still
+// encoded, as far as the application keeps up
+static void pni_shard_get(pni_shard_t *shard)
+{
+  pn_sharded_t *sharded = shard->sharded;
+  bool handed = false;
+  while (__atomic_load_n(&shard->delivered, __ATOMIC_ACQUIRE) < PNI_SHARD_BACKLOG) {
+    size_t size = 0;
+    if (pni_messenger_get_bytes(shard->messenger, NULL, &size) != PN_OVERFLOW) break;
+    pni_node_t *node = pni_node(size);
+    if (!node) break;
+    pni_messenger_get_bytes(shard->messenger, node->bytes, &node->size);
+    node->shard = shard->index;
+    __atomic_add_fetch(&shard->delivered, 1, __ATOMIC_RELAXED);
+    pni_mpsc_push(&sharded->delivered, node);
+    handed = true;
+  }
+
+  if (handed && __atomic_load_n(&sharded->waiting, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&sharded->lock);
+    pthread_cond_signal(&sharded->arrived);
+    pthread_mutex_unlock(&sharded->lock);
+  }
+}
+
+static void *pni_shard_run(void *context)
+{
+  pni_shard_t *shard = (pni_shard_t *) context;
+  pn_sharded_t *sharded = shard->sharded;
+  pn_messenger_t *messenger = shard->messenger;
+
+  if (shard->subscribed) {
+    pn_messenger_recv(messenger, -1);
+  }
+
+  while (!__atomic_load_n(&sharded->stopping, __ATOMIC_ACQUIRE)) {
+    pni_shard_put(shard, false);
+    pni_shard_get(shard);
+    // a put that comes in after this either sees the flag and wakes
+    // the driver, or is seen here
+    __atomic_store_n(&shard->sleeping, 1, __ATOMIC_SEQ_CST);
+    if (!pni_shard_hungry(shard) || pni_mpsc_empty(&shard->inbound)) {
+      pn_messenger_work(messenger, -1);
+    }
+    __atomic_store_n(&shard->sleeping, 0, __ATOMIC_SEQ_CST);
+  }
+
+  pn_messenger_set_blocking(messenger, true);
+  pni_shard_put(shard, true);
+  if (pn_messenger_send(messenger, -1)) {
+    pni_shard_failed(shard, pn_messenger_outgoing(messenger));
+  }
+  pni_shard_get(shard);
+  pn_messenger_stop(messenger);
+  return NULL;
+}
+
+pn_sharded_t *pn_sharded(const char *name, int shards)
+{
+  if (shards < 1 || shards > PN_SHARDS_MAX) return NULL;
+
+  pn_sharded_t *sharded = (pn_sharded_t *) malloc(sizeof(pn_sharded_t));
+  if (!sharded) return NULL;
+  sharded->shard = (pni_shard_t *) calloc(shards, sizeof(pni_shard_t));
+  if (!sharded->shard) {
+    free(sharded);
+    return NULL;
+  }
+  sharded->shards = shards;
+  sharded->started = 0;
+  pni_mpsc_init(&sharded->delivered);
+  pthread_mutex_init(&sharded->lock, NULL);
+  pthread_cond_init(&sharded->arrived, NULL);
+  sharded->waiting = 0;
+  sharded->failed = 0;
+  sharded->stopping = 0;
+  sharded->running = false;
+
+  char *base = name ? pn_strdup(name) : pn_i_genuuid();
+  pn_string_t *shard_name = pn_string(NULL);
+  bool failed = !base || !shard_name;
+  for (int i = 0; i < shards && !failed; i++) {
+    pni_shard_t *shard = &sharded->shard[i];
+    shard->sharded = sharded;
+    shard->index = i;
+    pni_mpsc_init(&shard->inbound);
+    pn_string_format(shard_name, "%s-%d", base, i);
+    shard->messenger = pn_messenger(pn_string_get(shard_name));
+    shard->msg = pn_message();
+    failed = !shard->messenger || !shard->msg;
+  }
+  free(base);
+  pn_free(shard_name);
+
+  if (failed) {
+    pn_sharded_free(sharded);
+    return NULL;
+  }
+  return sharded;
+}
+
+void pn_sharded_free(pn_sharded_t *sharded)
+{
+  if (!sharded) return;
+  pn_sharded_stop(sharded);
+  for (int i = 0; i < sharded->shards; i++) {
+    pni_shard_t *shard = &sharded->shard[i];
+    // a shard left unnamed by a failed construction was never set up
+    if (!shard->sharded) continue;
+    free(shard->held);
+    pni_mpsc_clear(&shard->inbound);
+    pn_messenger_free(shard->messenger);
+    pn_message_free(shard->msg);
+  }
+  pni_mpsc_clear(&sharded->delivered);
+  pthread_cond_destroy(&sharded->arrived);
+  pthread_mutex_destroy(&sharded->lock);
+  free(sharded->shard);
+  free(sharded);
+}
+
+pn_messenger_t *pn_sharded_messenger(pn_sharded_t *sharded, int shard)
+{
+  if (!sharded || shard < 0 || shard >= sharded->shards || sharded->running) return NULL;
+  return sharded->shard[shard].messenger;
+}
+
+int pn_sharded_subscribe(pn_sharded_t *sharded, const char *source)
+{
+  if (!sharded || !source) return PN_ARG_ERR;
+  if (sharded->running || sharded->stopping) return PN_STATE_ERR;
+  pni_shard_t *shard = &sharded->shard[pn_strhash(source) % sharded->shards];
+  if (!pn_messenger_subscribe(shard->messenger, source)) {
+    int err = pn_messenger_errno(shard->messenger);
+    return err ? err : PN_ERR;
+  }
+  shard->subscribed = true;
+  return 0;
+}
+
+int pn_sharded_start(pn_sharded_t *sharded)
+{
+  if (!sharded) return PN_ARG_ERR;
+  if (sharded->running || sharded->stopping) return PN_STATE_ERR;
+
+  for (int i = 0; i < sharded->shards; i++) {
+    pni_shard_t *shard = &sharded->shard[i];
+    pn_messenger_set_blocking(shard->messenger, false);
+    pn_messenger_start(shard->messenger);
+    if (pthread_create(&shard->thread, NULL, pni_shard_run, shard)) {
+      // stop the ones already going
+      pn_sharded_stop(sharded);
+      return PN_ERR;
+    }
+    sharded->started++;
+    sharded->running = true;
+  }
+  return 0;
+}
+
+int pn_sharded_stop(pn_sharded_t *sharded)
+{
+  if (!sharded) return PN_ARG_ERR;
+  __atomic_store_n(&sharded->stopping, 1, __ATOMIC_RELEASE);
+  if (!sharded->running) return 0;
+
+  for (int i = 0; i < sharded->started; i++) {
+    pn_messenger_interrupt(sharded->shard[i].messenger);
+  }
+  for (int i = 0; i < sharded->started; i++) {
+    pthread_join(sharded->shard[i].thread, NULL);
+  }
+  sharded->started = 0;
+  sharded->running = false;
+
+  // nothing more is coming for a get still waiting
+  pthread_mutex_lock(&sharded->lock);
+  pthread_cond_broadcast(&sharded->arrived);
+  pthread_mutex_unlock(&sharded->lock);
+  return 0;
+}
+
+int pn_sharded_put(pn_sharded_t *sharded, pn_message_t *msg)
+{
+  if (!sharded || !msg) return PN_ARG_ERR;
+  if (__atomic_load_n(&sharded->stopping, __ATOMIC_ACQUIRE)) return PN_STATE_ERR;
+
+  // every message for an address goes through the same shard, in order
+  const char *address = pn_message_get_address(msg);
+  int index = address ? (int) (pn_strhash(address) % sharded->shards) : 0;
+  pni_shard_t *shard = &sharded->shard[index];
+  if (__atomic_load_n(&shard->pending, __ATOMIC_RELAXED) >= PNI_SHARD_BACKLOG) {
+    return PN_OVERFLOW;
+  }
+
+  pni_node_t *node;
+  int err = pni_encode(msg, &node);
+  if (err) return err;
+  __atomic_add_fetch(&shard->pending, 1, __ATOMIC_RELAXED);
+  pni_mpsc_push(&shard->inbound, node);
+  if (__atomic_exchange_n(&shard->sleeping, 0, __ATOMIC_SEQ_CST)) {
+    pn_messenger_interrupt(shard->messenger);
+  }
+  return 0;
+}
+
+int pn_sharded_failed(pn_sharded_t *sharded)
+{
+  if (!sharded) return PN_ARG_ERR;
+  return __atomic_load_n(&sharded->failed, __ATOMIC_RELAXED);
+}
+
+// block until a shard hands something back, the timeout runs out,
+// or the shards stop
+static pni_node_t *pni_sharded_wait(pn_sharded_t *sharded, int timeout)
+{
+  struct timespec deadline;
+  if (timeout > 0) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (long) (timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+
+  pni_node_t *node;
+  pthread_mutex_lock(&sharded->lock);
+  __atomic_store_n(&sharded->waiting, 1, __ATOMIC_SEQ_CST);
+  while (!(node = pni_mpsc_pop(&sharded->delivered)) &&
+         !__atomic_load_n(&sharded->stopping, __ATOMIC_ACQUIRE)) {
+    int err = timeout < 0 ?
+      pthread_cond_wait(&sharded->arrived, &sharded->lock) :
+      pthread_cond_timedwait(&sharded->arrived, &sharded->lock, &deadline);
+    if (err == ETIMEDOUT) {
+      node = pni_mpsc_pop(&sharded->delivered);
+      break;
+    }
+  }
+  __atomic_store_n(&sharded->waiting, 0, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&sharded->lock);
+  return node;
+}
+
+int pn_sharded_get(pn_sharded_t *sharded, pn_message_t *msg, int timeout)
+{
+  if (!sharded) return PN_ARG_ERR;
+
+  pni_node_t *node = pni_mpsc_pop(&sharded->delivered);
+  if (!node && timeout) {
+    node = pni_sharded_wait(sharded, timeout);
+  }
+  if (!node) return PN_EOS;
+
+  // a shard held back by the backlog is woken once it is half drained
+  pni_shard_t *shard = &sharded->shard[node->shard];
+  if (__atomic_sub_fetch(&shard->delivered, 1, __ATOMIC_ACQ_REL) == PNI_SHARD_BACKLOG/2) {
+    pn_messenger_interrupt(shard->messenger);
+  }
+  int err = msg ? pn_message_decode(msg, node->bytes, node->size) : 0;
+  free(node);
+  return err;
+}
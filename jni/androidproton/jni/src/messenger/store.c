@@ -23,37 +23,93 @@
 #include <proton/engine.h>
 #include <proton/object.h>
 #include <assert.h>
+#include <limits.h>
 #ifndef __cplusplus
 #include <stdbool.h>
 #endif
 #include <stdlib.h>
 #include <string.h>
 #include "../util.h"
+#include "../platform.h"
 #include "store.h"
 
 typedef struct pni_stream_t pni_stream_t;
 
+// reclaimed streams kept around for reuse, enough to cover a put
+// emptying and recreating the stream for the same few addresses
+#define PNI_STREAM_POOL (16)
+
+// initial number of tracker slots, grown by doubling
+#define PNI_TRACKED_MIN (16)
+
+// AMQP message priorities run from 0 up to 9
+#define PNI_PRIORITIES (10)
+
+// entries handed out in a row while an older one waits at a lower
+// priority, after which the oldest gets its turn anyway
+#define PNI_PRIORITY_QUOTA (8)
+
+// the latencies recorded for one address, a histogram for each step
+// once something is recorded for it
+typedef struct {
+  pn_string_t *address;
+  pn_histogram_t *steps[PN_LATENCY_CT];
+} pni_latency_t;
+
 struct pni_store_t {
   size_t size;
-  pni_stream_t *streams;
+  size_t bytes;
+  size_t unsettled;   // sent entries the peer has yet to answer for
+  // limits on the store as a whole and on each stream, zero for none
+  size_t max_size;
+  size_t max_bytes;
+  size_t max_stream_size;
+  size_t max_stream_bytes;
+  pn_map_t *streams;
+  pn_string_t *key;
+  pni_stream_t *pool;
+  size_t pooled;
   pni_entry_t *store_head;
   pni_entry_t *store_tail;
+  uint64_t arrivals;
+  bool retain;        // keep what was sent until its outcome is known
   int window;
   pn_sequence_t lwm;
   pn_sequence_t hwm;
-  pn_hash_t *tracked;
+  // trackers are dense, ids lwm up to hwm live in a ring of capacity
+  // slots (a power of two) at id & (capacity - 1)
+  pni_entry_t **tracked;
+  size_t capacity;
+  pni_store_notify_t notify;
+  void *notify_context;
+  const pni_store_backend_t *backend;
+  void *backend_context;
+  bool timed;         // record latencies for new entries
+  pn_map_t *latencies;
+  pni_latency_t overall;
 };
 
-struct pni_stream_t {
-  pni_store_t *store;
-  char address[1024]; // XXX
+// the entries of one priority within a stream, in arrival order
+typedef struct {
   pni_entry_t *stream_head;
   pni_entry_t *stream_tail;
+} pni_level_t;
+
+struct pni_stream_t {
+  pni_store_t *store;
+  pn_string_t *address;
+  pni_level_t levels[PNI_PRIORITIES];
+  size_t size;
+  size_t bytes;
+  size_t retained;    // sent entries still holding their bytes
+  unsigned active;    // a bit for each non empty level
+  int bypassed;       // handed out ahead of the oldest entry in a row
   pni_stream_t *next;
 };
 
 struct pni_entry_t {
   pn_sequence_t id;
+  pni_store_t *store;
   pni_stream_t *stream;
   bool free;
   pni_entry_t *stream_next;
@@ -64,17 +120,48 @@ struct pni_entry_t {
   pn_buffer_t *bytes;
   pn_delivery_t *delivery;
   void *context;
+  uint64_t stored;    // id with the backend, zero if not stored
+  size_t accounted;   // bytes counted against the store
+  uint64_t arrival;
+  uint8_t priority;
+  bool unsettled;     // counted in the store's unsettled
+  pni_latency_t *latency;  // where its times are recorded, NULL if untimed
+  uint64_t created;
+  uint64_t delivered;
 };
 
+// the entry is done with, its durable copy can go
+static void pni_entry_unstore(pni_entry_t *entry)
+{
+  pni_store_t *store = entry->store;
+  if (entry->stored && store->backend) {
+    store->backend->settle(store->backend_context, entry->stored);
+  }
+  entry->stored = 0;
+}
+
+static void pni_entry_release(pni_entry_t *entry);
+
+// the peer has reported an outcome, or the entry was given up on
+static bool pni_entry_final(pni_entry_t *entry)
+{
+  return entry->status != PN_STATUS_PENDING && entry->status != PN_STATUS_UNKNOWN;
+}
+
 void pni_entry_finalize(void *object)
 {
   pni_entry_t *entry = (pni_entry_t *) object;
   assert(entry->free);
+  // an aborted message never reached the peer, keep it for next time
+  if (entry->status != PN_STATUS_ABORTED) {
+    pni_entry_unstore(entry);
+  }
   pn_delivery_t *d = entry->delivery;
   if (d) {
     pn_delivery_settle(d);
     pni_entry_set_delivery(entry, NULL);
   }
+  pni_entry_release(entry);
 }
 
 pni_store_t *pni_store()
@@ -83,13 +170,38 @@ pni_store_t *pni_store()
   if (!store) return NULL;
 
   store->size = 0;
-  store->streams = NULL;
+  store->bytes = 0;
+  store->unsettled = 0;
+  store->max_size = 0;
+  store->max_bytes = 0;
+  store->max_stream_size = 0;
+  store->max_stream_bytes = 0;
+  store->streams = pn_map(0, 0.75, 0);
+  store->key = pn_string(NULL);
+  store->pool = NULL;
+  store->pooled = 0;
   store->store_head = NULL;
   store->store_tail = NULL;
+  store->arrivals = 0;
+  store->retain = false;
   store->window = 0;
   store->lwm = 0;
   store->hwm = 0;
-  store->tracked = pn_hash(0, 0.75, PN_REFCOUNT);
+  store->capacity = PNI_TRACKED_MIN;
+  store->notify = NULL;
+  store->notify_context = NULL;
+  store->backend = NULL;
+  store->backend_context = NULL;
+  store->timed = false;
+  store->latencies = NULL;
+  memset(&store->overall, 0, sizeof(store->overall));
+  store->tracked = (pni_entry_t **) calloc(store->capacity, sizeof(pni_entry_t *));
+  if (!store->tracked) {
+    pn_free(store->streams);
+    pn_free(store->key);
+    free(store);
+    return NULL;
+  }
 
   return store;
 }
@@ -100,51 +212,190 @@ size_t pni_store_size(pni_store_t *store)
   return store->size;
 }
 
+size_t pni_store_unsettled(pni_store_t *store)
+{
+  assert(store);
+  return store->unsettled;
+}
+
+size_t pni_store_bytes(pni_store_t *store)
+{
+  assert(store);
+  return store->bytes;
+}
+
+void pni_store_set_limit(pni_store_t *store, size_t size, size_t bytes)
+{
+  assert(store);
+  store->max_size = size;
+  store->max_bytes = bytes;
+}
+
+void pni_store_set_retain(pni_store_t *store, bool retain)
+{
+  assert(store);
+  store->retain = retain;
+}
+
+void pni_store_set_latency(pni_store_t *store, bool enabled)
+{
+  assert(store);
+  if (enabled && !store->latencies) {
+    store->latencies = pn_map(0, 0.75, 0);
+    if (!store->latencies) return;
+  }
+  store->timed = enabled;
+}
+
+static pni_latency_t *pni_latency(pni_store_t *store, const char *address)
+{
+  pn_string_set(store->key, address);
+  pni_latency_t *latency = (pni_latency_t *) pn_map_get(store->latencies, store->key);
+  if (latency) return latency;
+
+  latency = (pni_latency_t *) calloc(1, sizeof(pni_latency_t));
+  if (!latency) return NULL;
+  latency->address = pn_string(address);
+  pn_map_put(store->latencies, latency->address, latency);
+  return latency;
+}
+
+static void pni_latency_clear(pni_latency_t *latency)
+{
+  for (int i = 0; i < PN_LATENCY_CT; i++) {
+    free(latency->steps[i]);
+    latency->steps[i] = NULL;
+  }
+}
+
+static void pni_latency_add(pni_latency_t *latency, pn_latency_t step, uint64_t value)
+{
+  if (!latency->steps[step]) {
+    latency->steps[step] = (pn_histogram_t *) calloc(1, sizeof(pn_histogram_t));
+    if (!latency->steps[step]) return;
+  }
+  pn_histogram_record(latency->steps[step], value);
+}
+
+// times before and after are taken from the same monotonic clock, a
+// step that seems to have taken negative time took none
+static void pni_entry_record(pni_entry_t *entry, pn_latency_t step,
+                             uint64_t start, uint64_t end)
+{
+  uint64_t value = end > start ? end - start : 0;
+  pni_latency_add(entry->latency, step, value);
+  pni_latency_add(&entry->store->overall, step, value);
+}
+
+void pni_store_latency(pni_store_t *store, const char *address, pn_latency_t step,
+                       pn_histogram_t *histogram)
+{
+  assert(store);
+  pni_latency_t *latency = &store->overall;
+  if (address) {
+    if (!store->latencies) return;
+    pn_string_set(store->key, address);
+    latency = (pni_latency_t *) pn_map_get(store->latencies, store->key);
+  }
+  if (latency && latency->steps[step]) {
+    pn_histogram_merge(histogram, latency->steps[step]);
+  }
+}
+
+void pni_store_set_stream_limit(pni_store_t *store, size_t size, size_t bytes)
+{
+  assert(store);
+  store->max_stream_size = size;
+  store->max_stream_bytes = bytes;
+}
+
+// entries left before a limit is hit, none once a byte limit is
+// reached since an entry's size is not known before it is filled
+static size_t pni_room(size_t size, size_t bytes, size_t max_size, size_t max_bytes)
+{
+  if (max_bytes && bytes >= max_bytes) return 0;
+  if (!max_size) return INT_MAX;
+  return size < max_size ? max_size - size : 0;
+}
+
 pni_stream_t *pni_stream(pni_store_t *store, const char *address, bool create)
 {
   assert(store);
   assert(address);
-  // XXX
-  if (strlen(address) >= 1024) return NULL;
-
-  pni_stream_t *prev = NULL;
-  pni_stream_t *stream = store->streams;
-  while (stream) {
-    if (!strcmp(stream->address, address)) {
-      return stream;
-    }
-    prev = stream;
-    stream = stream->next;
-  }
 
-  if (create) {
+  pn_string_set(store->key, address);
+  pni_stream_t *stream = (pni_stream_t *) pn_map_get(store->streams, store->key);
+  if (stream || !create) return stream;
+
+  stream = store->pool;
+  if (stream) {
+    store->pool = stream->next;
+    store->pooled--;
+    pn_string_set(stream->address, address);
+  } else {
     stream = (pni_stream_t *) malloc(sizeof(pni_stream_t));
+    if (!stream) return NULL;
     stream->store = store;
-    strcpy(stream->address, address);
-    stream->stream_head = NULL;
-    stream->stream_tail = NULL;
-    stream->next = NULL;
-
-    if (prev) {
-      prev->next = stream;
-    } else {
-      store->streams = stream;
-    }
+    stream->address = pn_string(address);
   }
+  memset(stream->levels, 0, sizeof(stream->levels));
+  stream->size = 0;
+  stream->bytes = 0;
+  stream->retained = 0;
+  stream->active = 0;
+  stream->bypassed = 0;
+  stream->next = NULL;
+  pn_map_put(store->streams, stream->address, stream);
 
   return stream;
 }
 
-pni_stream_t *pni_stream_head(pni_store_t *store)
+static void pni_stream_destroy(pni_stream_t *stream)
 {
-  assert(store);
-  return store->streams;
+  pn_free(stream->address);
+  free(stream);
 }
 
-pni_stream_t *pni_stream_next(pni_stream_t *stream)
+// drop an empty stream from the index so that one off addresses,
+// e.g. reply-to queues, do not accumulate
+static void pni_stream_reclaim(pni_stream_t *stream)
 {
-  assert(stream);
-  return stream->next;
+  pni_store_t *store = stream->store;
+  pn_map_del(store->streams, stream->address);
+  if (store->pooled < PNI_STREAM_POOL) {
+    stream->next = store->pool;
+    store->pool = stream;
+    store->pooled++;
+  } else {
+    pni_stream_destroy(stream);
+  }
+}
+
+// the entry that has waited longest of those at the head of each
+// level, only worth asking when more than one level is in use
+static pni_entry_t *pni_stream_oldest(pni_stream_t *stream)
+{
+  pni_entry_t *oldest = NULL;
+  for (int i = 0; i < PNI_PRIORITIES; i++) {
+    pni_entry_t *head = LL_HEAD(&stream->levels[i], stream);
+    if (head && (!oldest || head->arrival < oldest->arrival)) {
+      oldest = head;
+    }
+  }
+  return oldest;
+}
+
+// highest priority first, unless that has kept the oldest entry
+// waiting for a full quota
+static pni_entry_t *pni_stream_next(pni_stream_t *stream)
+{
+  if (!stream->active) return NULL;
+  int top = PNI_PRIORITIES - 1;
+  while (!(stream->active & (1u << top))) top--;
+  if (stream->active != (1u << top) && stream->bypassed >= PNI_PRIORITY_QUOTA) {
+    return pni_stream_oldest(stream);
+  }
+  return LL_HEAD(&stream->levels[top], stream);
 }
 
 void pni_entry_free(pni_entry_t *entry)
@@ -152,36 +403,151 @@ void pni_entry_free(pni_entry_t *entry)
   if (!entry) return;
   pni_stream_t *stream = entry->stream;
   pni_store_t *store = stream->store;
-  LL_REMOVE(stream, stream, entry);
+  pni_level_t *level = &stream->levels[entry->priority];
+  if (stream->active == (1u << entry->priority) ||
+      pni_stream_oldest(stream) == entry) {
+    stream->bypassed = 0;
+  } else {
+    stream->bypassed++;
+  }
+  LL_REMOVE(level, stream, entry);
+  if (!LL_HEAD(level, stream)) stream->active &= ~(1u << entry->priority);
   LL_REMOVE(store, store, entry);
   entry->free = true;
 
-  pn_buffer_free(entry->bytes);
-  entry->bytes = NULL;
+  store->bytes -= entry->accounted;
+  stream->bytes -= entry->accounted;
+  entry->accounted = 0;
+  if (store->retain && entry->delivery && !pni_entry_final(entry)) {
+    // sent but not yet settled, kept in case it has to go again
+    stream->retained++;
+  } else {
+    pn_buffer_free(entry->bytes);
+    entry->bytes = NULL;
+  }
+  // decided before letting go of the entry, whose finalizer may
+  // release the last retained bytes and reclaim the stream itself
+  bool reclaim = !stream->active && !stream->retained;
   pn_decref(entry);
   store->size--;
+  stream->size--;
+
+  if (reclaim) {
+    pni_stream_reclaim(stream);
+  }
 }
 
-void pni_stream_free(pni_stream_t *stream)
+// let go of the bytes kept for a sent entry
+static void pni_entry_release(pni_entry_t *entry)
 {
-  if (!stream) return;
-  pni_entry_t *entry;
-  while ((entry = LL_HEAD(stream, stream))) {
-    pni_entry_free(entry);
+  if (!entry->free || !entry->bytes) return;
+  pni_stream_t *stream = entry->stream;
+  pn_buffer_free(entry->bytes);
+  entry->bytes = NULL;
+  if (!--stream->retained && !stream->active) {
+    pni_stream_reclaim(stream);
   }
-  free(stream);
+}
+
+bool pni_entry_retained(pni_entry_t *entry)
+{
+  assert(entry);
+  pni_store_t *store = entry->store;
+  // only a tracked entry is still around once freed
+  return store->retain && !pni_entry_final(entry) &&
+    (entry->stored || store->window != 0);
+}
+
+int pni_entry_requeue(pni_entry_t *entry)
+{
+  assert(entry);
+  // bytes handed over to a delivery are not there to send again
+  if (!entry->free || !entry->bytes || !pn_buffer_size(entry->bytes))
+    return PN_STATE_ERR;
+
+  pni_stream_t *stream = entry->stream;
+  pni_store_t *store = entry->store;
+  pni_level_t *level = &stream->levels[entry->priority];
+  // back in arrival order, ahead of anything put since it was sent
+  pni_entry_t *next = LL_HEAD(level, stream);
+  while (next && next->arrival < entry->arrival) next = next->stream_next;
+  LL_INSERT(level, stream, next, entry);
+  stream->active |= 1u << entry->priority;
+  next = LL_HEAD(store, store);
+  while (next && next->arrival < entry->arrival) next = next->store_next;
+  LL_INSERT(store, store, next, entry);
+
+  entry->free = false;
+  pn_incref(entry);
+  stream->retained--;
+  store->size++;
+  stream->size++;
+  pni_entry_account(entry);
+  return 0;
+}
+
+static pni_entry_t **pni_store_slot(pni_store_t *store, pn_sequence_t id)
+{
+  return &store->tracked[(uint32_t) id & (store->capacity - 1)];
+}
+
+static void pni_store_untrack(pni_store_t *store, pn_sequence_t id)
+{
+  pni_entry_t **slot = pni_store_slot(store, id);
+  if (*slot) {
+    pni_entry_t *e = *slot;
+    *slot = NULL;
+    pn_decref(e);
+  }
+}
+
+static int pni_store_grow(pni_store_t *store)
+{
+  size_t capacity = 2*store->capacity;
+  pni_entry_t **tracked = (pni_entry_t **) calloc(capacity, sizeof(pni_entry_t *));
+  if (!tracked) return PN_ERR;
+
+  size_t count = store->hwm - store->lwm;
+  for (size_t i = 0; i < count; i++) {
+    pn_sequence_t id = store->lwm + i;
+    tracked[(uint32_t) id & (capacity - 1)] = *pni_store_slot(store, id);
+  }
+
+  free(store->tracked);
+  store->tracked = tracked;
+  store->capacity = capacity;
+  return 0;
 }
 
 void pni_store_free(pni_store_t *store)
 {
   if (!store) return;
-  pn_free(store->tracked);
-  pni_stream_t *stream = store->streams;
-  while (stream) {
-    pni_stream_t *next = stream->next;
-    pni_stream_free(stream);
-    stream = next;
+  store->backend = NULL;
+  while (store->hwm - store->lwm > 0) {
+    pni_store_untrack(store, store->lwm++);
   }
+  free(store->tracked);
+  if (store->latencies) {
+    for (pn_handle_t h = pn_map_head(store->latencies); h; h = pn_map_next(store->latencies, h)) {
+      pni_latency_t *latency = (pni_latency_t *) pn_map_value(store->latencies, h);
+      pni_latency_clear(latency);
+      pn_free(latency->address);
+      free(latency);
+    }
+    pn_free(store->latencies);
+  }
+  pni_latency_clear(&store->overall);
+  // freeing the last entry of a stream reclaims it
+  while (store->store_head) {
+    pni_entry_free(store->store_head);
+  }
+  while (store->pool) {
+    pni_stream_t *next = store->pool->next;
+    pni_stream_destroy(store->pool);
+    store->pool = next;
+  }
+  pn_free(store->streams);
+  pn_free(store->key);
   free(store);
 }
 
@@ -202,16 +568,23 @@ pni_stream_t *pni_stream_get(pni_store_t *store, const char *address)
 #define pni_entry_compare NULL
 #define pni_entry_inspect NULL
 
-pni_entry_t *pni_store_put(pni_store_t *store, const char *address)
+pni_entry_t *pni_store_put(pni_store_t *store, const char *address,
+                           uint8_t priority)
 {
   assert(store);
   static pn_class_t clazz = PN_CLASS(pni_entry);
 
   if (!address) address = "";
+  if (priority >= PNI_PRIORITIES) priority = PNI_PRIORITIES - 1;
   pni_stream_t *stream = pni_stream_put(store, address);
   if (!stream) return NULL;
   pni_entry_t *entry = (pni_entry_t *) pn_new(sizeof(pni_entry_t), &clazz);
-  if (!entry) return NULL;
+  if (!entry) {
+    if (!stream->active) pni_stream_reclaim(stream);
+    return NULL;
+  }
+  entry->id = 0;
+  entry->store = store;
   entry->stream = stream;
   entry->free = false;
   entry->stream_next = NULL;
@@ -219,21 +592,52 @@ pni_entry_t *pni_store_put(pni_store_t *store, const char *address)
   entry->store_next = NULL;
   entry->store_prev = NULL;
   entry->delivery = NULL;
+  entry->stored = 0;
+  entry->accounted = 0;
+  entry->unsettled = false;
   entry->bytes = pn_buffer(64);
   entry->status = PN_STATUS_UNKNOWN;
-  LL_ADD(stream, stream, entry);
+  entry->arrival = store->arrivals++;
+  entry->priority = priority;
+  entry->latency = store->timed ? pni_latency(store, address) : NULL;
+  entry->created = entry->latency ? pn_i_micros() : 0;
+  entry->delivered = 0;
+  LL_ADD(&stream->levels[priority], stream, entry);
+  stream->active |= 1u << priority;
   LL_ADD(store, store, entry);
   store->size++;
+  stream->size++;
   return entry;
 }
 
+size_t pni_store_stream_bytes(pni_store_t *store, const char *address)
+{
+  assert(store);
+  pni_stream_t *stream = pni_stream_get(store, address);
+  return stream ? stream->bytes : 0;
+}
+
+size_t pni_store_room(pni_store_t *store, const char *address)
+{
+  assert(store);
+  size_t room = pni_room(store->size, store->bytes, store->max_size, store->max_bytes);
+  if (address && room && (store->max_stream_size || store->max_stream_bytes)) {
+    pni_stream_t *stream = pni_stream_get(store, address);
+    size_t size = stream ? stream->size : 0;
+    size_t bytes = stream ? stream->bytes : 0;
+    size_t left = pni_room(size, bytes, store->max_stream_size, store->max_stream_bytes);
+    room = pn_min(room, left);
+  }
+  return room;
+}
+
 pni_entry_t *pni_store_get(pni_store_t *store, const char *address)
 {
   assert(store);
   if (address) {
     pni_stream_t *stream = pni_stream_get(store, address);
     if (!stream) return NULL;
-    return LL_HEAD(stream, stream);
+    return pni_stream_next(stream);
   } else {
     return LL_HEAD(store, store);
   }
@@ -245,16 +649,46 @@ pn_buffer_t *pni_entry_bytes(pni_entry_t *entry)
   return entry->bytes;
 }
 
+void pni_entry_account(pni_entry_t *entry)
+{
+  assert(entry);
+  size_t size = pn_buffer_size(entry->bytes);
+  pni_store_t *store = entry->store;
+  store->bytes += size - entry->accounted;
+  entry->stream->bytes += size - entry->accounted;
+  entry->accounted = size;
+}
+
 pn_status_t pni_entry_get_status(pni_entry_t *entry)
 {
   assert(entry);
   return entry->status;
 }
 
+bool pni_store_tracking(pni_store_t *store, pn_sequence_t id)
+{
+  return (id - store->lwm >= 0) && (store->hwm - id > 0);
+}
+
+// tell the store's owner when a tracked entry moves on to a new
+// status, the owner must not touch the store from the callback
+static void pni_entry_notify(pni_entry_t *entry, pn_status_t old)
+{
+  pni_store_t *store = entry->store;
+  if (entry->status == old || entry->status == PN_STATUS_PENDING ||
+      !store->notify) return;
+  if (pni_store_tracking(store, entry->id) &&
+      *pni_store_slot(store, entry->id) == entry) {
+    store->notify(store->notify_context, entry->id, entry->status);
+  }
+}
+
 void pni_entry_set_status(pni_entry_t *entry, pn_status_t status)
 {
   assert(entry);
+  pn_status_t old = entry->status;
   entry->status = status;
+  pni_entry_notify(entry, old);
 }
 
 pn_delivery_t *pni_entry_get_delivery(pni_entry_t *entry)
@@ -272,10 +706,31 @@ void pni_entry_set_delivery(pni_entry_t *entry, pn_delivery_t *delivery)
   entry->delivery = delivery;
   if (delivery) {
     pn_delivery_set_context(delivery, entry);
+    if (entry->latency && pn_link_is_sender(pn_delivery_link(delivery))) {
+      entry->delivered = pn_i_micros();
+      pni_entry_record(entry, PN_LATENCY_QUEUED, entry->created, entry->delivered);
+    }
   }
   pni_entry_updated(entry);
 }
 
+int pni_entry_persist(pni_entry_t *entry)
+{
+  assert(entry);
+  pni_store_t *store = entry->store;
+  if (!store->backend) return 0;
+  return store->backend->append(store->backend_context,
+                                pn_string_get(entry->stream->address),
+                                entry->priority, pn_buffer_bytes(entry->bytes),
+                                &entry->stored);
+}
+
+void pni_entry_restore(pni_entry_t *entry, uint64_t id)
+{
+  assert(entry);
+  entry->stored = id;
+}
+
 void pni_entry_set_context(pni_entry_t *entry, void *context)
 {
   assert(entry);
@@ -310,14 +765,49 @@ static pn_status_t disp2status(uint64_t disp)
   return (pn_status_t) 0;
 }
 
+// the peer's outcome for a timed entry has arrived
+static void pni_entry_outcome(pni_entry_t *entry)
+{
+  uint64_t now = pn_i_micros();
+  uint64_t transferred = pn_delivery_transferred(entry->delivery);
+  if (transferred) {
+    pni_entry_record(entry, PN_LATENCY_TRANSFER, entry->delivered, transferred);
+    pni_entry_record(entry, PN_LATENCY_OUTCOME, transferred, now);
+  }
+  pni_entry_record(entry, PN_LATENCY_TOTAL, entry->created, now);
+}
+
+void pni_entry_consumed(pni_entry_t *entry)
+{
+  assert(entry);
+  if (entry->latency) {
+    pni_entry_record(entry, PN_LATENCY_RECEIVE, entry->created, pn_i_micros());
+  }
+}
+
+static void pni_entry_settled(pni_entry_t *entry, bool unsettled)
+{
+  if (entry->unsettled == unsettled) return;
+  entry->unsettled = unsettled;
+  if (unsettled) {
+    entry->store->unsettled++;
+  } else {
+    entry->store->unsettled--;
+  }
+}
 
 void pni_entry_updated(pni_entry_t *entry)
 {
   assert(entry);
   pn_delivery_t *d = entry->delivery;
+  pn_status_t old = entry->status;
   if (d) {
     if (pn_delivery_remote_state(d)) {
+      bool final = pni_entry_final(entry);
       entry->status = disp2status(pn_delivery_remote_state(d));
+      if (entry->delivered && !final && pni_entry_final(entry)) {
+        pni_entry_outcome(entry);
+      }
     } else if (pn_delivery_settled(d)) {
       uint64_t disp = pn_delivery_local_state(d);
       if (disp) {
@@ -329,6 +819,14 @@ void pni_entry_updated(pni_entry_t *entry)
       entry->status = PN_STATUS_PENDING;
     }
   }
+  // sent and not yet answered for by the peer
+  pni_entry_settled(entry, d && pn_link_is_sender(pn_delivery_link(d)) &&
+                    !pn_delivery_remote_state(d) && !pn_delivery_settled(d));
+  if (pni_entry_final(entry)) {
+    pni_entry_unstore(entry);
+    pni_entry_release(entry);
+  }
+  pni_entry_notify(entry, old);
 }
 
 pn_sequence_t pni_entry_id(pni_entry_t *entry)
@@ -340,12 +838,8 @@ pn_sequence_t pni_entry_id(pni_entry_t *entry)
 pni_entry_t *pni_store_entry(pni_store_t *store, pn_sequence_t id)
 {
   assert(store);
-  return (pni_entry_t *) pn_hash_get(store->tracked, id);
-}
-
-bool pni_store_tracking(pni_store_t *store, pn_sequence_t id)
-{
-  return (id - store->lwm >= 0) && (store->hwm - id > 0);
+  if (!pni_store_tracking(store, id)) return NULL;
+  return *pni_store_slot(store, id);
 }
 
 pn_sequence_t pni_entry_track(pni_entry_t *entry)
@@ -353,16 +847,22 @@ pn_sequence_t pni_entry_track(pni_entry_t *entry)
   assert(entry);
 
   pni_store_t *store = entry->stream->store;
+  if ((size_t) (store->hwm - store->lwm) == store->capacity &&
+      pni_store_grow(store)) {
+    // out of memory, drop the oldest tracker to make room
+    pni_store_untrack(store, store->lwm++);
+  }
   entry->id = store->hwm++;
-  pn_hash_put(store->tracked, entry->id, entry);
+  pn_incref(entry);
+  *pni_store_slot(store, entry->id) = entry;
 
   if (store->window >= 0) {
+    // stored messages stay tracked, and so their deliveries unsettled,
+    // until the peer reports an outcome
     while (store->hwm - store->lwm > store->window) {
-      pni_entry_t *e = pni_store_entry(store, store->lwm);
-      if (e) {
-        pn_hash_del(store->tracked, store->lwm);
-      }
-      store->lwm++;
+      pni_entry_t *e = *pni_store_slot(store, store->lwm);
+      if (e && e->stored && e->status != PN_STATUS_ABORTED) break;
+      pni_store_untrack(store, store->lwm++);
     }
   }
 
@@ -378,15 +878,16 @@ int pni_store_update(pni_store_t *store, pn_sequence_t id, pn_status_t status,
     return 0;
   }
 
-  size_t start;
+  pn_sequence_t start;
   if (PN_CUMULATIVE & flags) {
     start = store->lwm;
   } else {
     start = id;
   }
 
-  for (pn_sequence_t i = start; i <= id; i++) {
-    pni_entry_t *e = pni_store_entry(store, i);
+  size_t count = id - start + 1;
+  for (size_t i = 0; i < count; i++) {
+    pni_entry_t *e = *pni_store_slot(store, start + i);
     if (e) {
       pn_delivery_t *d = e->delivery;
       if (d) {
@@ -413,13 +914,14 @@ int pni_store_update(pni_store_t *store, pn_sequence_t id, pn_status_t status,
         if (d) {
           pn_delivery_settle(d);
         }
-        pn_hash_del(store->tracked, e->id);
+        pni_entry_settled(e, false);
+        pni_store_untrack(store, e->id);
       }
     }
   }
 
   while (store->hwm - store->lwm > 0 &&
-         !pn_hash_get(store->tracked, store->lwm)) {
+         !*pni_store_slot(store, store->lwm)) {
     store->lwm++;
   }
 
@@ -437,3 +939,17 @@ void pni_store_set_window(pni_store_t *store, int window)
   assert(store);
   store->window = window;
 }
+
+void pni_store_set_notify(pni_store_t *store, pni_store_notify_t notify, void *context)
+{
+  assert(store);
+  store->notify = notify;
+  store->notify_context = context;
+}
+
+void pni_store_set_backend(pni_store_t *store, const pni_store_backend_t *backend, void *context)
+{
+  assert(store);
+  store->backend = backend;
+  store->backend_context = context;
+}
@@ -26,14 +26,51 @@
 
 typedef struct pni_store_t pni_store_t;
 typedef struct pni_entry_t pni_entry_t;
+typedef void (*pni_store_notify_t)(void *context, pn_sequence_t id, pn_status_t status);
+
+// somewhere to keep a durable copy of the entries of a store, see
+// journal.h; an entry is settled with the backend once it reaches a
+// final outcome or is dropped, entries left in a store being freed
+// stay stored
+typedef struct {
+  int (*append)(void *context, const char *address, uint8_t priority,
+                pn_bytes_t bytes, uint64_t *id);
+  void (*settle)(void *context, uint64_t id);
+} pni_store_backend_t;
 
 pni_store_t *pni_store();
 void pni_store_free(pni_store_t *store);
 size_t pni_store_size(pni_store_t *store);
-pni_entry_t *pni_store_put(pni_store_t *store, const char *address);
+size_t pni_store_bytes(pni_store_t *store);
+// entries sent on a link that the peer has neither settled nor
+// reported a state for, kept up to date as their deliveries change
+size_t pni_store_unsettled(pni_store_t *store);
+size_t pni_store_stream_bytes(pni_store_t *store, const char *address);
+// limits on entries and bytes, zero for none; they are advisory, the
+// store only reports the room left, see pni_store_room
+void pni_store_set_limit(pni_store_t *store, size_t size, size_t bytes);
+void pni_store_set_stream_limit(pni_store_t *store, size_t size, size_t bytes);
+size_t pni_store_room(pni_store_t *store, const char *address);
+// keep the bytes of entries freed once sent until their outcome is
+// known, so that they can be requeued if the delivery is lost
+void pni_store_set_retain(pni_store_t *store, bool retain);
+// time the entries put from now on, see pn_latency_t; outgoing
+// entries are timed from put to the peer's outcome, incoming ones
+// from put until they are consumed
+void pni_store_set_latency(pni_store_t *store, bool enabled);
+// add what was recorded for a step, for an address or the whole store
+// when that is NULL, to the histogram
+void pni_store_latency(pni_store_t *store, const char *address, pn_latency_t step,
+                       pn_histogram_t *histogram);
+// the entries of an address come out highest priority first, without
+// an address the oldest entry of the whole store comes out
+pni_entry_t *pni_store_put(pni_store_t *store, const char *address,
+                           uint8_t priority);
 pni_entry_t *pni_store_get(pni_store_t *store, const char *address);
 
 pn_buffer_t *pni_entry_bytes(pni_entry_t *entry);
+// count the entry's bytes against the store once they are written
+void pni_entry_account(pni_entry_t *entry);
 pn_status_t pni_entry_get_status(pni_entry_t *entry);
 void pni_entry_set_status(pni_entry_t *entry, pn_status_t status);
 pn_delivery_t *pni_entry_get_delivery(pni_entry_t *entry);
@@ -41,7 +78,17 @@ void pni_entry_set_delivery(pni_entry_t *entry, pn_delivery_t *delivery);
 void pni_entry_set_context(pni_entry_t *entry, void *context);
 void *pni_entry_get_context(pni_entry_t *entry);
 void pni_entry_updated(pni_entry_t *entry);
+// the application has taken an incoming entry
+void pni_entry_consumed(pni_entry_t *entry);
 void pni_entry_free(pni_entry_t *entry);
+// whether the entry's bytes outlive pni_entry_free once it is sent,
+// in which case they must be copied rather than handed over
+bool pni_entry_retained(pni_entry_t *entry);
+// put a sent entry whose bytes were retained back in the store, in
+// its original place, PN_STATE_ERR if they were not
+int pni_entry_requeue(pni_entry_t *entry);
+int pni_entry_persist(pni_entry_t *entry);
+void pni_entry_restore(pni_entry_t *entry, uint64_t id);
 
 pn_sequence_t pni_entry_track(pni_entry_t *entry);
 pni_entry_t *pni_store_entry(pni_store_t *store, pn_sequence_t id);
@@ -49,6 +96,8 @@ int pni_store_update(pni_store_t *store, pn_sequence_t id, pn_status_t status,
                      int flags, bool settle, bool match);
 int pni_store_get_window(pni_store_t *store);
 void pni_store_set_window(pni_store_t *store, int window);
+void pni_store_set_notify(pni_store_t *store, pni_store_notify_t notify, void *context);
+void pni_store_set_backend(pni_store_t *store, const pni_store_backend_t *backend, void *context);
 
 
 #endif /* store.h */
@@ -33,6 +33,7 @@ struct pn_subscription_t {
   pn_string_t *port;
   pn_string_t *address;
   void *context;
+  int weight;
 };
 
 void pn_subscription_initialize(void *obj)
@@ -44,6 +45,7 @@ void pn_subscription_initialize(void *obj)
   sub->port = pn_string(NULL);
   sub->address = pn_string(NULL);
   sub->context = NULL;
+  sub->weight = 1;
 }
 
 void pn_subscription_finalize(void *obj)
@@ -93,6 +95,20 @@ void pn_subscription_set_context(pn_subscription_t *sub, void *context)
   sub->context = context;
 }
 
+int pn_subscription_get_weight(pn_subscription_t *sub)
+{
+  assert(sub);
+  return sub->weight;
+}
+
+int pn_subscription_set_weight(pn_subscription_t *sub, int weight)
+{
+  assert(sub);
+  if (weight < 1) return PN_ARG_ERR;
+  sub->weight = weight;
+  return 0;
+}
+
 int pni_subscription_set_address(pn_subscription_t *sub, const char *address)
 {
   assert(sub);
@@ -20,10 +20,12 @@
  */
 
 #include <proton/object.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <ctype.h>
 #include "transform.h"
+#include "../util.h"
 
 typedef struct {
   const char *start;
@@ -35,17 +37,45 @@ typedef struct {
 typedef struct {
   size_t groups;
   pn_group_t group[MAX_GROUP];
+  // (pattern, text) positions already known not to match, this keeps
+  // patterns with several wildcards from backtracking exponentially
+  const char *pattern;
+  const char *text;
+  size_t stride;
+  uint8_t *failed;
+  uint8_t *memo;
+  size_t memo_capacity;
 } pn_matcher_t;
 
 typedef struct {
   pn_string_t *pattern;
   pn_string_t *substitution;
+  size_t prefix;    // literal characters before the first wildcard
+  size_t wildcards;
 } pn_rule_t;
 
+typedef struct pni_cached_t pni_cached_t;
+
+// most recently transformed addresses, kept in least recently used
+// order with the oldest at the head
+#define PNI_TRANSFORM_CACHE (256)
+
+struct pni_cached_t {
+  pn_string_t *address;
+  pn_string_t *result;
+  bool matched;
+  pni_cached_t *lru_next;
+  pni_cached_t *lru_prev;
+};
+
 struct pn_transform_t {
   pn_list_t *rules;
   pn_matcher_t matcher;
   bool matched;
+  pn_map_t *cache;
+  pn_string_t *key;
+  pni_cached_t *lru_head;
+  pni_cached_t *lru_tail;
 };
 
 static void pn_rule_finalize(void *object)
@@ -66,12 +96,48 @@ pn_rule_t *pn_rule(const char *pattern, const char *substitution)
   pn_rule_t *rule = (pn_rule_t *) pn_new(sizeof(pn_rule_t), &clazz);
   rule->pattern = pn_string(pattern);
   rule->substitution = pn_string(substitution);
+  rule->prefix = 0;
+  rule->wildcards = 0;
+  bool literal = true;
+  for (const char *c = pattern; *c; c++) {
+    if (*c == '*' || *c == '%') {
+      literal = false;
+      rule->wildcards++;
+    } else if (literal) {
+      rule->prefix++;
+    }
+  }
   return rule;
 }
 
+static void pni_cached_finalize(void *object)
+{
+  pni_cached_t *cached = (pni_cached_t *) object;
+  pn_decref(cached->address);
+  pn_free(cached->result);
+}
+
+#define pni_cached_initialize NULL
+#define pni_cached_hashcode NULL
+#define pni_cached_compare NULL
+#define pni_cached_inspect NULL
+
+static void pni_transform_uncache(pn_transform_t *transform)
+{
+  while (transform->lru_head) {
+    pni_cached_t *cached = transform->lru_head;
+    LL_REMOVE(transform, lru, cached);
+    pn_map_del(transform->cache, cached->address);
+  }
+}
+
 static void pn_transform_finalize(void *object)
 {
   pn_transform_t *transform = (pn_transform_t *) object;
+  pni_transform_uncache(transform);
+  pn_free(transform->cache);
+  pn_free(transform->key);
+  free(transform->matcher.memo);
   pn_free(transform->rules);
 }
 
@@ -86,6 +152,13 @@ pn_transform_t *pn_transform()
   pn_transform_t *transform = (pn_transform_t *) pn_new(sizeof(pn_transform_t), &clazz);
   transform->rules = pn_list(0, PN_REFCOUNT);
   transform->matched = false;
+  transform->matcher.failed = NULL;
+  transform->matcher.memo = NULL;
+  transform->matcher.memo_capacity = 0;
+  transform->cache = pn_map(0, 0.75, PN_REFCOUNT);
+  transform->key = pn_string(NULL);
+  transform->lru_head = NULL;
+  transform->lru_tail = NULL;
   return transform;
 }
 
@@ -96,10 +169,12 @@ void pn_transform_rule(pn_transform_t *transform, const char *pattern,
   pn_rule_t *rule = pn_rule(pattern, substitution);
   pn_list_add(transform->rules, rule);
   pn_decref(rule);
+  pni_transform_uncache(transform);
 }
 
 static void pni_sub(pn_matcher_t *matcher, size_t group, const char *text, size_t matched)
 {
+  if (group >= MAX_GROUP) return;
   if (group > matcher->groups) {
     matcher->groups = group;
   }
@@ -107,6 +182,25 @@ static void pni_sub(pn_matcher_t *matcher, size_t group, const char *text, size_
   matcher->group[group].size = matched;
 }
 
+static bool pni_match_r(pn_matcher_t *matcher, const char *pattern, const char *text, size_t group, size_t matched);
+
+// whether the rest of the text can match the rest of the pattern
+// only depends on where we are in each, so a failure seen once can
+// be remembered
+static bool pni_match_m(pn_matcher_t *matcher, const char *pattern, const char *text, size_t group, size_t matched)
+{
+  if (!matcher->failed) {
+    return pni_match_r(matcher, pattern, text, group, matched);
+  }
+
+  size_t bit = (pattern - matcher->pattern) * matcher->stride + (text - matcher->text);
+  uint8_t mask = 1 << (bit % 8);
+  if (matcher->failed[bit / 8] & mask) return false;
+  bool match = pni_match_r(matcher, pattern, text, group, matched);
+  if (!match) matcher->failed[bit / 8] |= mask;
+  return match;
+}
+
 static bool pni_match_r(pn_matcher_t *matcher, const char *pattern, const char *text, size_t group, size_t matched)
 {
   bool match;
@@ -120,33 +214,61 @@ static bool pni_match_r(pn_matcher_t *matcher, const char *pattern, const char *
   case '*':
     switch (c) {
     case '\0':
-      match = pni_match_r(matcher, pattern + 1, text, group + 1, 0);
+      match = pni_match_m(matcher, pattern + 1, text, group + 1, 0);
       if (match) pni_sub(matcher, group, text, matched);
       return match;
     case '/':
       if (p == '%') {
-        match = pni_match_r(matcher, pattern + 1, text, group + 1, 0);
+        match = pni_match_m(matcher, pattern + 1, text, group + 1, 0);
         if (match) pni_sub(matcher, group, text, matched);
         return match;
       }
     default:
-      match = pni_match_r(matcher, pattern, text + 1, group, matched + 1);
+      match = pni_match_m(matcher, pattern, text + 1, group, matched + 1);
       if (!match) {
-        match = pni_match_r(matcher, pattern + 1, text, group + 1, 0);
+        match = pni_match_m(matcher, pattern + 1, text, group + 1, 0);
         if (match) pni_sub(matcher, group, text, matched);
       }
       return match;
     }
   default:
-    return c == p && pni_match_r(matcher, pattern + 1, text + 1, group, 0);
+    return c == p && pni_match_m(matcher, pattern + 1, text + 1, group, 0);
   }
 }
 
-static bool pni_match(pn_matcher_t *matcher, const char *pattern, const char *text)
+static bool pni_match(pn_matcher_t *matcher, pn_rule_t *rule, const char *text)
 {
+  const char *pattern = pn_string_get(rule->pattern);
   text = text ? text : "";
+  if (strncmp(pattern, text, rule->prefix)) {
+    return false;
+  }
+
   matcher->groups = 0;
-  if (pni_match_r(matcher, pattern, text, 1, 0)) {
+  matcher->failed = NULL;
+  if (rule->wildcards > 1) {
+    size_t plen = pn_string_size(rule->pattern);
+    size_t tlen = strlen(text);
+    size_t bytes = ((plen + 1) * (tlen + 1) + 7) / 8;
+    if (bytes > matcher->memo_capacity) {
+      uint8_t *memo = (uint8_t *) realloc(matcher->memo, bytes);
+      if (memo) {
+        matcher->memo = memo;
+        matcher->memo_capacity = bytes;
+      }
+    }
+    // without a table we still match, just the slow way
+    if (bytes <= matcher->memo_capacity) {
+      matcher->failed = matcher->memo;
+      memset(matcher->failed, 0, bytes);
+      matcher->pattern = pattern;
+      matcher->text = text;
+      matcher->stride = tlen + 1;
+    }
+  }
+
+  bool match = pni_match_m(matcher, pattern + rule->prefix, text + rule->prefix, 1, 0);
+  if (match) {
     matcher->group[0].start = text;
     matcher->group[0].size = strlen(text);
     return true;
@@ -205,13 +327,13 @@ static size_t pni_substitute(pn_matcher_t *matcher, const char *pattern, char *d
   return result;
 }
 
-int pn_transform_apply(pn_transform_t *transform, const char *src,
-                       pn_string_t *dst)
+static int pni_transform_apply(pn_transform_t *transform, const char *src,
+                               pn_string_t *dst)
 {
   for (size_t i = 0; i < pn_list_size(transform->rules); i++)
   {
     pn_rule_t *rule = (pn_rule_t *) pn_list_get(transform->rules, i);
-    if (pni_match(&transform->matcher, pn_string_get(rule->pattern), src)) {
+    if (pni_match(&transform->matcher, rule, src)) {
       transform->matched = true;
       if (!pn_string_get(rule->substitution)) {
         return pn_string_set(dst, NULL);
@@ -235,6 +357,52 @@ int pn_transform_apply(pn_transform_t *transform, const char *src,
   return pn_string_set(dst, src);
 }
 
+static void pni_transform_cache(pn_transform_t *transform, const char *src,
+                                pn_string_t *result)
+{
+  static pn_class_t clazz = PN_CLASS(pni_cached);
+
+  pni_cached_t *cached;
+  if (pn_map_size(transform->cache) >= PNI_TRANSFORM_CACHE) {
+    cached = transform->lru_head;
+    LL_REMOVE(transform, lru, cached);
+    pn_map_del(transform->cache, cached->address);
+  }
+
+  cached = (pni_cached_t *) pn_new(sizeof(pni_cached_t), &clazz);
+  if (!cached) return;
+  cached->address = pn_string(src);
+  cached->result = pn_string(NULL);
+  pn_string_copy(cached->result, result);
+  cached->matched = transform->matched;
+  pn_map_put(transform->cache, cached->address, cached);
+  LL_ADD(transform, lru, cached);
+  pn_decref(cached);
+}
+
+int pn_transform_apply(pn_transform_t *transform, const char *src,
+                       pn_string_t *dst)
+{
+  if (!src) {
+    return pni_transform_apply(transform, src, dst);
+  }
+
+  pn_string_set(transform->key, src);
+  pni_cached_t *cached = (pni_cached_t *) pn_map_get(transform->cache, transform->key);
+  if (cached) {
+    LL_REMOVE(transform, lru, cached);
+    LL_ADD(transform, lru, cached);
+    transform->matched = cached->matched;
+    return pn_string_copy(dst, cached->result);
+  }
+
+  int err = pni_transform_apply(transform, src, dst);
+  if (!err) {
+    pni_transform_cache(transform, src, dst);
+  }
+  return err;
+}
+
 bool pn_transform_matched(pn_transform_t *transform)
 {
   return transform->matched;
@@ -527,14 +527,20 @@ static pni_entry_t *pni_map_entry(pn_map_t *map, void *key, pni_entry_t **pprev,
       return pni_map_entry(map, key, pprev, create);
     }
 
+    // overflow entries live past the addressable slots so that every
+    // chain starts at its own bucket and chains never merge, this is
+    // what lets pn_map_del unlink an entry without rehashing
     size_t empty = 0;
-    for (size_t i = 0; i < map->capacity; i++) {
-      size_t idx = map->capacity - i - 1;
-      if (map->entries[idx].state == PNI_ENTRY_FREE) {
-        empty = idx;
+    for (size_t idx = map->capacity; idx > map->addressable; idx--) {
+      if (map->entries[idx - 1].state == PNI_ENTRY_FREE) {
+        empty = idx - 1;
         break;
       }
     }
+    if (!empty) {
+      pni_map_ensure(map, map->capacity + 1);
+      return pni_map_entry(map, key, pprev, create);
+    }
     entry->next = empty;
     entry->state = PNI_ENTRY_LINK;
     map->entries[empty].state = PNI_ENTRY_TAIL;
@@ -571,17 +577,23 @@ void pn_map_del(pn_map_t *map, void *key)
   pni_entry_t *prev = NULL;
   pni_entry_t *entry = pni_map_entry(map, key, &prev, false);
   if (entry) {
-    if (prev) {
+    if (map->count_keys) pn_decref(entry->key);
+    if (map->count_values) pn_decref(entry->value);
+    map->size--;
+    if (!prev && entry->state == PNI_ENTRY_LINK) {
+      // the slot heads a chain, pull the rest of the chain up into
+      // it rather than cutting it off
+      pni_entry_t *next = &map->entries[entry->next];
+      *entry = *next;
+      entry = next;
+    } else if (prev) {
       prev->next = entry->next;
       prev->state = entry->state;
     }
     entry->state = PNI_ENTRY_FREE;
     entry->next = 0;
-    if (map->count_keys) pn_decref(entry->key);
     entry->key = NULL;
-    if (map->count_values) pn_decref(entry->value);
     entry->value = NULL;
-    map->size--;
   }
 }
 
@@ -62,6 +62,13 @@ pn_timestamp_t pn_i_now(void)
   if (clock_gettime(CLOCK_REALTIME, &now)) pn_fatal("clock_gettime() failed\n");
   return ((pn_timestamp_t)now.tv_sec) * 1000 + (now.tv_nsec / 1000000);
 }
+
+uint64_t pn_i_micros(void)
+{
+  struct timespec now;
+  if (clock_gettime(CLOCK_MONOTONIC, &now)) pn_fatal("clock_gettime() failed\n");
+  return ((uint64_t)now.tv_sec) * 1000000 + (now.tv_nsec / 1000);
+}
 #elif defined(USE_WIN_FILETIME)
 #include <windows.h>
 pn_timestamp_t pn_i_now(void)
@@ -74,6 +81,14 @@ pn_timestamp_t pn_i_now(void)
   // Convert to milliseconds and adjust base epoch
   return t.QuadPart / 10000 - 11644473600000;
 }
+
+uint64_t pn_i_micros(void)
+{
+  LARGE_INTEGER count, frequency;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&frequency);
+  return count.QuadPart / (frequency.QuadPart / 1000000);
+}
 #else
 #include <sys/time.h>
 pn_timestamp_t pn_i_now(void)
@@ -82,6 +97,13 @@ pn_timestamp_t pn_i_now(void)
   if (gettimeofday(&now, NULL)) pn_fatal("gettimeofday failed\n");
   return ((pn_timestamp_t)now.tv_sec) * 1000 + (now.tv_usec / 1000);
 }
+
+uint64_t pn_i_micros(void)
+{
+  struct timeval now;
+  if (gettimeofday(&now, NULL)) pn_fatal("gettimeofday failed\n");
+  return ((uint64_t)now.tv_sec) * 1000000 + now.tv_usec;
+}
 #endif
 
 #ifdef USE_UUID_GENERATE
@@ -198,6 +220,21 @@ int64_t pn_i_atoll(const char* num) {
 #error "Don't know how to convert int64_t values on this platform"
 #endif
 
+#ifdef _WIN32
+#include <io.h>
+// there is no pread, so the file position does move
+ssize_t pn_i_pread(int fd, char *buf, size_t size, off_t offset) {
+  if (_lseeki64(fd, offset, SEEK_SET) < 0)
+    return -1;
+  return _read(fd, buf, (unsigned int) size);
+}
+#else
+#include <unistd.h>
+ssize_t pn_i_pread(int fd, char *buf, size_t size, off_t offset) {
+  return pread(fd, buf, size, offset);
+}
+#endif
+
 #ifdef _MSC_VER
 // [v]snprintf on Windows only matches C99 when no errors or overflow.
 int pn_i_vsnprintf(char *buf, size_t count, const char *fmt, va_list ap) {
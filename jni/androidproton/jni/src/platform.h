@@ -39,6 +39,16 @@ extern "C" {
  */
 pn_timestamp_t pn_i_now(void);
 
+/** Get a monotonic time in microseconds.
+ *
+ * The value has no defined origin and is only useful for measuring
+ * intervals.
+ *
+ * @return current monotonic time
+ * @internal
+ */
+uint64_t pn_i_micros(void);
+
 /** Generate a UUID in string format.
  *
  * Returns a newly generated UUID in the standard 36 char format.
@@ -72,6 +82,22 @@ int pn_i_error_from_errno(pn_error_t *error, const char *msg);
  */
 int64_t pn_i_atoll(const char* num);
 
+/** Read from a file at a given offset.
+ *
+ * Does not move the file position, so a file may be shared by
+ * several readers.
+ *
+ * @param[in] fd the file descriptor
+ * @param[out] buf where to put the bytes read
+ * @param[in] size the most bytes to read
+ * @param[in] offset where to start in the file
+ * @return the number of bytes read, 0 at end of file, or a negative
+ * value if the read failed
+ *
+ * @internal
+ */
+ssize_t pn_i_pread(int fd, char *buf, size_t size, off_t offset);
+
 #ifdef _MSC_VER
 /** Windows snprintf and vsnprintf substitutes.
  *
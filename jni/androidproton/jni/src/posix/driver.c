@@ -91,6 +91,34 @@ static inline int pn_create_socket() {
 #error "Don't know how to turn off SIGPIPE on this platform"
 #endif
 
+/* File payloads go straight from the page cache to the socket where
+   sendfile can do it */
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#define PN_HAVE_SENDFILE
+
+// sendfile has no MSG_NOSIGNAL, so SIGPIPE is held back over the call
+// and one it raised is dropped
+static ssize_t pn_sendfile(int sockfd, int fd, off_t offset, size_t len) {
+    sigset_t pipe, old;
+    sigemptyset(&pipe);
+    sigaddset(&pipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe, &old);
+    ssize_t n = sendfile(sockfd, fd, &offset, len);
+    if (n < 0 && errno == EPIPE && !sigismember(&old, SIGPIPE)) {
+        struct timespec zero = {0, 0};
+        sigtimedwait(&pipe, NULL, &zero);
+        errno = EPIPE;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return n;
+}
+#endif
+
 struct pn_driver_t {
   pn_error_t *error;
   pn_listener_t *listener_head;
@@ -335,6 +363,8 @@ void pn_listener_free(pn_listener_t *l)
   if (!l) return;
 
   if (l->driver) pn_driver_remove_listener(l->driver, l);
+  // release the port for whoever binds it next
+  if (!l->closed) close(l->fd);
   free(l);
 }
 
@@ -427,6 +457,9 @@ pn_connector_t *pn_connector_fd(pn_driver_t *driver, int fd, void *context)
   c->connection = NULL;
   c->transport = pn_transport();
   c->sasl = pn_sasl(c->transport);
+#ifdef PN_HAVE_SENDFILE
+  pn_transport_set_sendfile(c->transport, true);
+#endif
   c->input_done = false;
   c->output_done = false;
   c->context = context;
@@ -522,6 +555,8 @@ void pn_connector_free(pn_connector_t *ctor)
   if (!ctor) return;
 
   if (ctor->driver) pn_driver_remove_connector(ctor->driver, ctor);
+  // the peer sees the connection drop rather than hang
+  if (!ctor->closed) close(ctor->fd);
   ctor->connection = NULL;
   pn_transport_free(ctor->transport);
   ctor->transport = NULL;
@@ -624,6 +659,30 @@ void pn_connector_process(pn_connector_t *c)
     ///
     if (!c->output_done) {
       ssize_t pending = pn_transport_pending(transport);
+#ifdef PN_HAVE_SENDFILE
+      int file = -1;
+      off_t offset = 0;
+      ssize_t due = pending ? 0 : pn_transport_head_file(transport, &file, &offset);
+      if (due > 0) {
+        c->status |= PN_SEL_WR;
+        if (c->pending_write) {
+          c->pending_write = false;
+          ssize_t n = pn_sendfile(c->fd, file, offset, due);
+          if (n > 0) {
+            pn_transport_pop_file(transport, (size_t) n);
+          } else if (n == 0 || errno == EINVAL || errno == ENOSYS) {
+            // not a file sendfile can take, or cut short: the transport
+            // copies it instead, and reports a short file as an error
+            pn_transport_set_sendfile(transport, false);
+          } else if (errno != EAGAIN) {
+            perror("sendfile");
+            c->output_done = true;
+            c->status &= ~PN_SEL_WR;
+            pn_transport_close_head( transport );
+          }
+        }
+      } else
+#endif
       if (pending > 0) {
         c->status |= PN_SEL_WR;
         if (c->pending_write) {
@@ -49,6 +49,7 @@ struct pn_sasl_t {
   bool rcvd_init;
   bool sent_done;
   bool rcvd_done;
+  bool pipeline;
   char scratch[SCRATCH];
 };
 
@@ -87,6 +88,7 @@ pn_sasl_t *pn_sasl(pn_transport_t *transport)
     sasl->rcvd_init = false;
     sasl->sent_done = false;
     sasl->rcvd_done = false;
+    sasl->pipeline = false;
 
     transport->sasl = sasl;
     sasl->transport = transport;
@@ -207,10 +209,19 @@ void pn_sasl_plain(pn_sasl_t *sasl, const char *username, const char *password)
   free(iresp);
 }
 
+void pn_sasl_pipeline(pn_sasl_t *sasl, bool pipeline)
+{
+  if (sasl) {
+    sasl->pipeline = pipeline;
+  }
+}
+
 void pn_sasl_done(pn_sasl_t *sasl, pn_sasl_outcome_t outcome)
 {
   if (sasl) {
     sasl->outcome = outcome;
+    // input pipelined behind the init waits for this
+    sasl->transport->reprocess = true;
   }
 }
 
@@ -239,7 +250,7 @@ void pn_sasl_free(pn_sasl_t *sasl)
 void pn_client_init(pn_sasl_t *sasl)
 {
   pn_bytes_t bytes = pn_buffer_bytes(sasl->send_data);
-  pn_post_frame(sasl->disp, 0, "DL[sz]", SASL_INIT, sasl->mechanisms,
+  pn_post_frame(sasl->disp, 0, SASL_INIT, "DL[sz]", SASL_INIT, sasl->mechanisms,
                 bytes.size, bytes.start);
   pn_buffer_clear(sasl->send_data);
 }
@@ -272,12 +283,13 @@ void pn_server_init(pn_sasl_t *sasl)
     }
   }
 
-  pn_post_frame(sasl->disp, 0, "DL[@T[*s]]", SASL_MECHANISMS, PN_SYMBOL, count, mechs);
+  pn_post_frame(sasl->disp, 0, SASL_MECHANISMS, "DL[@T[*s]]", SASL_MECHANISMS,
+                PN_SYMBOL, count, mechs);
 }
 
 void pn_server_done(pn_sasl_t *sasl)
 {
-  pn_post_frame(sasl->disp, 0, "DL[B]", SASL_OUTCOME, sasl->outcome);
+  pn_post_frame(sasl->disp, 0, SASL_OUTCOME, "DL[B]", SASL_OUTCOME, sasl->outcome);
 }
 
 void pn_sasl_process(pn_sasl_t *sasl)
@@ -295,8 +307,8 @@ void pn_sasl_process(pn_sasl_t *sasl)
 
   if (pn_buffer_size(sasl->send_data)) {
     pn_bytes_t bytes = pn_buffer_bytes(sasl->send_data);
-    pn_post_frame(sasl->disp, 0, "DL[z]", sasl->client ? SASL_RESPONSE : SASL_CHALLENGE,
-                  bytes.size, bytes.start);
+    uint64_t code = sasl->client ? SASL_RESPONSE : SASL_CHALLENGE;
+    pn_post_frame(sasl->disp, 0, code, "DL[z]", code, bytes.size, bytes.start);
     pn_buffer_clear(sasl->send_data);
   }
 
@@ -315,6 +327,29 @@ void pn_sasl_process(pn_sasl_t *sasl)
   }
 }
 
+// mechanisms that complete with the initial response, i.e. never
+// need a challenge from the server
+static bool pn_sasl_single_step(const char *mechanisms)
+{
+  return mechanisms && (!strcmp(mechanisms, "ANONYMOUS") ||
+                        !strcmp(mechanisms, "PLAIN") ||
+                        !strcmp(mechanisms, "EXTERNAL"));
+}
+
+// a pipelining client may move on to the AMQP layer as soon as its
+// init frame is out, rather than waiting for the outcome
+static bool pn_sasl_pipelined(pn_sasl_t *sasl)
+{
+  return sasl->pipeline && sasl->client && sasl->sent_init &&
+    !pn_buffer_size(sasl->send_data) && pn_sasl_single_step(sasl->mechanisms);
+}
+
+static ssize_t pn_sasl_failed(pn_sasl_t *sasl)
+{
+  return pn_error_format(sasl->transport->error, PN_ERR,
+                         "SASL negotiation failed (outcome %i)", sasl->outcome);
+}
+
 ssize_t pn_sasl_input(pn_sasl_t *sasl, const char *bytes, size_t available)
 {
   ssize_t n = pn_dispatcher_input(sasl->disp, bytes, available);
@@ -330,8 +365,8 @@ ssize_t pn_sasl_input(pn_sasl_t *sasl, const char *bytes, size_t available)
         return PN_EOS;
       }
     } else {
-      // XXX: should probably do something better here
-      return PN_ERR;
+      // anything pipelined behind the init must not be processed
+      return pn_sasl_failed(sasl);
     }
   } else {
     return n;
@@ -346,9 +381,10 @@ ssize_t pn_sasl_output(pn_sasl_t *sasl, char *bytes, size_t size)
     if (pn_sasl_state(sasl) == PN_SASL_PASS) {
       return PN_EOS;
     } else {
-      // XXX: should probably do something better here
-      return PN_ERR;
+      return pn_sasl_failed(sasl);
     }
+  } else if (sasl->disp->available == 0 && pn_sasl_pipelined(sasl)) {
+    return PN_EOS;
   } else {
     return pn_dispatcher_output(sasl->disp, bytes, size);
   }
@@ -462,6 +498,7 @@ static ssize_t pn_output_write_sasl(pn_io_layer_t *io_layer, char *bytes, size_t
   pn_sasl_t *sasl = (pn_sasl_t *)io_layer->context;
   ssize_t n = pn_sasl_output(sasl, bytes, size);
   if (n == PN_EOS) {
+    pn_dispatcher_release(sasl->disp);
     sasl->io_layer->process_output = pn_io_layer_output_passthru;
     pn_io_layer_t *io_next = sasl->io_layer->next;
     return io_next->process_output( io_next, bytes, size );
@@ -0,0 +1,381 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <proton/engine.h>
+#include <proton/event.h>
+#include <proton/stats.h>
+
+#define assert(E) ((E) ? 0 : (abort(), 0))
+
+static void pump_one(pn_transport_t *src, pn_transport_t *dst, bool *moved)
+{
+  char buf[1024];
+  ssize_t n = pn_transport_output(src, buf, sizeof(buf));
+  if (n > 0) {
+    // a closed transport stops accepting input, drop it on the floor
+    pn_transport_input(dst, buf, n);
+    *moved = true;
+  }
+}
+
+static void pump(pn_transport_t *a, pn_transport_t *b)
+{
+  bool moved = true;
+  while (moved) {
+    moved = false;
+    pump_one(a, b, &moved);
+    pump_one(b, a, &moved);
+  }
+}
+
+// pop events until one of the given type turns up, skipping
+// transport events
+static pn_event_t *expect(pn_collector_t *collector, pn_event_type_t type)
+{
+  pn_event_t *event;
+  while ((event = pn_collector_peek(collector))) {
+    if (pn_event_type(event) == type) return event;
+    assert(pn_event_type(event) == PN_TRANSPORT);
+    pn_collector_pop(collector);
+  }
+  abort();
+  return NULL;
+}
+
+static void drain(pn_collector_t *collector)
+{
+  while (pn_collector_pop(collector));
+}
+
+static void test_events()
+{
+  pn_collector_t *collector = pn_collector();
+  assert(pn_collector_peek(collector) == NULL);
+  assert(!pn_collector_pop(collector));
+
+  pn_connection_t *c1 = pn_connection();
+  pn_connection_t *c2 = pn_connection();
+  pn_transport_t *t1 = pn_transport();
+  pn_transport_t *t2 = pn_transport();
+  pn_transport_bind(t1, c1);
+  pn_transport_bind(t2, c2);
+  pn_connection_collect(c2, collector);
+
+  pn_connection_open(c1);
+  pn_session_t *s1 = pn_session(c1);
+  pn_session_open(s1);
+  pn_link_t *snd = pn_sender(s1, "link");
+  pn_link_open(snd);
+  pump(t1, t2);
+
+  pn_event_t *event = expect(collector, PN_CONNECTION_STATE);
+  assert(pn_event_connection(event) == c2);
+  assert(pn_event_session(event) == NULL);
+  pn_collector_pop(collector);
+
+  event = expect(collector, PN_SESSION_STATE);
+  pn_session_t *s2 = pn_event_session(event);
+  assert(s2 && pn_event_connection(event) == c2);
+  assert(pn_session_state(s2) == (PN_LOCAL_UNINIT | PN_REMOTE_ACTIVE));
+  pn_collector_pop(collector);
+
+  event = expect(collector, PN_LINK_STATE);
+  pn_link_t *rcv = pn_event_link(event);
+  assert(rcv && pn_link_is_receiver(rcv));
+  assert(pn_event_session(event) == s2);
+  pn_collector_pop(collector);
+  assert(pn_collector_peek(collector) == NULL);
+
+  // local changes on a bound connection only signal the transport
+  pn_connection_open(c2);
+  pn_session_open(s2);
+  pn_link_open(rcv);
+  pn_link_flow(rcv, 10);
+  event = pn_collector_peek(collector);
+  assert(pn_event_type(event) == PN_TRANSPORT);
+  assert(pn_event_transport(event) == t2);
+  drain(collector);
+
+  // the sender sees the credit as a flow event
+  pn_connection_collect(c2, NULL);
+  pn_connection_collect(c1, collector);
+  pump(t1, t2);
+  expect(collector, PN_CONNECTION_STATE);
+  pn_collector_pop(collector);
+  expect(collector, PN_SESSION_STATE);
+  pn_collector_pop(collector);
+  event = expect(collector, PN_LINK_STATE);
+  assert(pn_event_link(event) == snd);
+  assert(pn_link_state(snd) == (PN_LOCAL_ACTIVE | PN_REMOTE_ACTIVE));
+  pn_collector_pop(collector);
+  event = expect(collector, PN_LINK_FLOW);
+  assert(pn_event_link(event) == snd);
+  assert(pn_link_credit(snd) == 10);
+  drain(collector);
+  pn_delivery_t *d1 = pn_delivery(snd, pn_dtag("tag", 3));
+  assert(pn_link_send(snd, "hello", 5) == 5);
+  pn_link_advance(snd);
+
+  // a delivery produces a single event however often it changes
+  pn_connection_collect(c1, NULL);
+  pn_connection_collect(c2, collector);
+  for (int i = 0; i < 3; i++) {
+    pn_delivery(snd, pn_dtag("x", 1));
+    pn_link_send(snd, "more", 4);
+    pn_link_advance(snd);
+  }
+  pump(t1, t2);
+  pn_delivery_t *d2 = pn_link_current(rcv);
+  assert(d2 && pn_delivery_readable(d2));
+  event = expect(collector, PN_DELIVERY);
+  assert(pn_event_delivery(event) == d2);
+  assert(pn_event_link(event) == rcv);
+  pn_collector_pop(collector);
+  for (int i = 0; i < 3; i++) {
+    event = expect(collector, PN_DELIVERY);
+    assert(pn_event_delivery(event) != d2);
+    pn_collector_pop(collector);
+  }
+  assert(pn_collector_peek(collector) == NULL);
+
+  // settling discards a pending event
+  pn_delivery_update(d2, PN_ACCEPTED);
+  pn_delivery_settle(d2);
+  pn_connection_collect(c2, NULL);
+  pn_connection_collect(c1, collector);
+  pump(t1, t2);
+  event = expect(collector, PN_DELIVERY);
+  assert(pn_event_delivery(event) == d1);
+  assert(pn_delivery_updated(d1));
+  pn_delivery_settle(d1);
+  event = pn_collector_peek(collector);
+  assert(!event || pn_event_type(event) != PN_DELIVERY);
+  drain(collector);
+
+  // freeing an endpoint discards its events
+  pn_link_close(rcv);
+  pump(t1, t2);
+  event = expect(collector, PN_LINK_STATE);
+  assert(pn_event_link(event) == snd);
+  pn_link_free(snd);
+  assert(pn_collector_peek(collector) == NULL);
+
+  pn_connection_close(c2);
+  pump(t1, t2);
+  expect(collector, PN_CONNECTION_STATE);
+  pn_transport_unbind(t1);
+  pn_transport_free(t1);
+  pn_connection_free(c1);
+  assert(pn_collector_peek(collector) == NULL);
+
+  pn_transport_unbind(t2);
+  pn_transport_free(t2);
+  pn_connection_free(c2);
+  pn_collector_free(collector);
+}
+
+static void test_recv_slices()
+{
+  pn_connection_t *c1 = pn_connection();
+  pn_connection_t *c2 = pn_connection();
+  pn_transport_t *t1 = pn_transport();
+  pn_transport_t *t2 = pn_transport();
+  pn_transport_bind(t1, c1);
+  pn_transport_bind(t2, c2);
+
+  pn_connection_open(c1);
+  pn_session_t *s1 = pn_session(c1);
+  pn_session_open(s1);
+  pn_link_t *snd = pn_sender(s1, "link");
+  pn_link_open(snd);
+  pump(t1, t2);
+
+  pn_connection_open(c2);
+  pn_session_open(pn_session_head(c2, PN_REMOTE_ACTIVE));
+  pn_link_t *rcv = pn_link_head(c2, PN_REMOTE_ACTIVE);
+  pn_link_open(rcv);
+  pn_link_flow(rcv, 1);
+  pump(t1, t2);
+
+  pn_delivery(snd, pn_dtag("tag", 3));
+  pn_link_send(snd, "hello ", 6);
+  pn_link_send(snd, "world", 5);
+  pn_link_advance(snd);
+  pump(t1, t2);
+
+  pn_bytes_t out[2];
+  pn_delivery_t *d = pn_link_current(rcv);
+  assert(d && !pn_delivery_partial(d));
+
+  int count = pn_link_recv_slices(rcv, out, 2);
+  assert(count == 1);
+  assert(out[0].size == 11 && !memcmp(out[0].start, "hello world", 11));
+  assert(pn_link_recv_release(rcv, 6) == 6);
+  count = pn_link_recv_slices(rcv, out, 2);
+  assert(count == 1);
+  assert(out[0].size == 5 && !memcmp(out[0].start, "world", 5));
+  assert(pn_link_recv_release(rcv, 100) == 5);
+  assert(pn_link_recv_slices(rcv, out, 2) == PN_EOS);
+  assert(pn_delivery_pending(d) == 0);
+  pn_link_advance(rcv);
+  pn_delivery_settle(d);
+
+  // releasing part of a first transfer before the next one arrives
+  // wraps the ring, the pending bytes come back as two slices
+  char chunk[64];
+  pn_session_t *s2 = pn_link_session(rcv);
+  pn_link_flow(rcv, 1);
+  pump(t1, t2);
+  pn_delivery(snd, pn_dtag("wrap", 4));
+  memset(chunk, 'a', 40);
+  pn_link_send(snd, chunk, 40);
+  pump(t1, t2);
+  d = pn_link_current(rcv);
+  assert(d && pn_delivery_partial(d));
+  assert(pn_link_recv_slices(rcv, out, 2) == 1 && out[0].size == 40);
+  assert(pn_session_incoming_bytes(s2) == 40);
+  assert(pn_link_recv_release(rcv, 30) == 30);
+  assert(pn_session_incoming_bytes(s2) == 10);
+
+  memset(chunk, 'b', 40);
+  pn_link_send(snd, chunk, 40);
+  pump(t1, t2);
+  assert(pn_session_incoming_bytes(s2) == 50);
+  count = pn_link_recv_slices(rcv, out, 2);
+  assert(count == 2);
+  assert(out[0].size + out[1].size == 50);
+  assert(out[0].size > 10 && out[1].size > 0);
+  assert(!memcmp(out[0].start, "aaaaaaaaaa", 10));
+  for (size_t i = 10; i < out[0].size; i++) assert(out[0].start[i] == 'b');
+  for (size_t i = 0; i < out[1].size; i++) assert(out[1].start[i] == 'b');
+  size_t head = out[0].size, tail = out[1].size;
+  assert(pn_link_recv_slices(rcv, out, 1) == 1 && out[0].size == head);
+
+  // a partial release leaves the rest of the head and the whole tail
+  assert(pn_link_recv_release(rcv, 20) == 20);
+  assert(pn_session_incoming_bytes(s2) == 30);
+  count = pn_link_recv_slices(rcv, out, 2);
+  assert(count == 2 && out[0].size == 30 - tail && out[1].size == tail);
+  for (size_t i = 0; i < out[0].size; i++) assert(out[0].start[i] == 'b');
+
+  // a full release starts the ring over, so a frame that would have
+  // wrapped past the old start lands in one slice
+  assert(pn_link_recv_release(rcv, 30) == 30);
+  assert(pn_session_incoming_bytes(s2) == 0);
+  assert(pn_link_recv_slices(rcv, out, 2) == 0);
+  memset(chunk, 'c', 60);
+  pn_link_send(snd, chunk, 60);
+  pn_link_advance(snd);
+  pump(t1, t2);
+  assert(!pn_delivery_partial(d));
+  assert(pn_session_incoming_bytes(s2) == 60);
+  count = pn_link_recv_slices(rcv, out, 2);
+  assert(count == 1 && out[0].size == 60 && !memcmp(out[0].start, chunk, 60));
+  assert(pn_link_recv_release(rcv, 60) == 60);
+  assert(pn_session_incoming_bytes(s2) == 0);
+  assert(pn_link_recv_slices(rcv, out, 2) == PN_EOS);
+
+  pn_transport_unbind(t1);
+  pn_transport_free(t1);
+  pn_connection_free(c1);
+  pn_transport_unbind(t2);
+  pn_transport_free(t2);
+  pn_connection_free(c2);
+}
+
+static void test_stats()
+{
+  pn_connection_t *c1 = pn_connection();
+  pn_connection_t *c2 = pn_connection();
+  pn_transport_t *t1 = pn_transport();
+  pn_transport_t *t2 = pn_transport();
+  pn_transport_bind(t1, c1);
+  pn_transport_bind(t2, c2);
+
+  pn_connection_open(c1);
+  pn_session_t *s1 = pn_session(c1);
+  pn_session_open(s1);
+  pn_link_t *snd = pn_sender(s1, "link");
+  pn_link_open(snd);
+  pump(t1, t2);
+
+  // queued output without credit stalls the link
+  pn_delivery(snd, pn_dtag("tag", 3));
+  pn_link_send(snd, "hello", 5);
+  pn_link_advance(snd);
+  pump(t1, t2);
+  pn_link_stats_t lstats;
+  assert(pn_link_stats(snd, &lstats) == 0);
+  assert(lstats.credit_stalls == 1 && lstats.deliveries_sent == 0);
+
+  pn_connection_open(c2);
+  pn_session_t *s2 = pn_session_head(c2, PN_REMOTE_ACTIVE);
+  pn_session_open(s2);
+  pn_link_t *rcv = pn_link_head(c2, PN_REMOTE_ACTIVE);
+  pn_link_open(rcv);
+  pn_link_flow(rcv, 1);
+  pump(t1, t2);
+
+  pn_link_stats(snd, &lstats);
+  assert(lstats.credit_stalls == 1 && lstats.deliveries_sent == 1);
+  pn_link_stats_t before = lstats;
+  pn_link_stats(snd, &lstats);
+  assert(lstats.credit_stall_time == before.credit_stall_time);
+
+  pn_delivery_t *d = pn_link_current(rcv);
+  pn_link_advance(rcv);
+  pn_delivery_settle(d);
+  pn_link_stats(rcv, &lstats);
+  assert(lstats.deliveries_received == 1 && lstats.deliveries_settled == 1);
+  pn_session_stats_t sstats;
+  assert(pn_session_stats(s2, &sstats) == 0);
+  assert(sstats.deliveries_received == 1 && sstats.deliveries_settled == 1);
+
+  pn_connection_stats_t cstats;
+  assert(pn_connection_stats(c1, &cstats) == 0);
+  assert(cstats.frames_output[PN_PERF_OPEN] == 1);
+  assert(cstats.frames_output[PN_PERF_TRANSFER] == 1);
+  assert(cstats.frames_input[PN_PERF_FLOW] >= 1);
+  assert(cstats.bytes_output[PN_PERF_TRANSFER] > 5);
+  assert(cstats.output_high_water > 0 && cstats.input_high_water > 0);
+  assert(cstats.process_count > 0);
+  assert(pn_connection_stats(c2, &cstats) == 0);
+  assert(cstats.frames_input[PN_PERF_TRANSFER] == 1);
+  assert(pn_connection_stats(NULL, &cstats) == PN_ARG_ERR);
+
+  pn_transport_unbind(t1);
+  pn_transport_free(t1);
+  pn_connection_free(c1);
+  pn_transport_unbind(t2);
+  pn_transport_free(t2);
+  pn_connection_free(c2);
+}
+
+int main(int argc, char **argv)
+{
+  test_events();
+  test_recv_slices();
+  test_stats();
+  return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <proton/engine.h>
+
+#define assert(E) ((E) ? 0 : (abort(), 0))
+
+// loopback pairs, i.e. twice as many connections
+#define PAIRS (5000)
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+static size_t heap_used(void) { return mallinfo2().uordblks; }
+#else
+static size_t heap_used(void) { return mallinfo().uordblks; }
+#endif
+
+static void pump_one(pn_transport_t *src, pn_transport_t *dst, bool *moved)
+{
+  char buf[1024];
+  ssize_t n = pn_transport_output(src, buf, sizeof(buf));
+  if (n > 0) {
+    pn_transport_input(dst, buf, n);
+    *moved = true;
+  }
+}
+
+static void pump(pn_transport_t *a, pn_transport_t *b)
+{
+  bool moved = true;
+  while (moved) {
+    moved = false;
+    pump_one(a, b, &moved);
+    pump_one(b, a, &moved);
+  }
+}
+
+// open a connection pair with one settled delivery behind it and
+// leave it quiet long enough for the transports to shed their buffers
+static void open_pair(pn_connection_t **c, pn_transport_t **t)
+{
+  c[0] = pn_connection();
+  c[1] = pn_connection();
+  t[0] = pn_transport();
+  t[1] = pn_transport();
+  pn_transport_bind(t[0], c[0]);
+  pn_transport_bind(t[1], c[1]);
+
+  pn_connection_open(c[0]);
+  pn_session_t *ssn = pn_session(c[0]);
+  pn_session_open(ssn);
+  pn_link_t *snd = pn_sender(ssn, "link");
+  pn_link_open(snd);
+  pump(t[0], t[1]);
+
+  pn_connection_open(c[1]);
+  pn_session_open(pn_session_head(c[1], PN_REMOTE_ACTIVE));
+  pn_link_t *rcv = pn_link_head(c[1], PN_REMOTE_ACTIVE);
+  pn_link_open(rcv);
+  pn_link_flow(rcv, 10);
+  pump(t[0], t[1]);
+
+  pn_delivery_t *d = pn_delivery(snd, pn_dtag("tag", 3));
+  pn_link_send(snd, "hello", 5);
+  pn_link_advance(snd);
+  pump(t[0], t[1]);
+
+  char buf[16];
+  pn_delivery_t *r = pn_link_current(rcv);
+  assert(pn_link_recv(rcv, buf, sizeof(buf)) == 5);
+  pn_link_advance(rcv);
+  pn_delivery_update(r, PN_ACCEPTED);
+  pn_delivery_settle(r);
+  pump(t[0], t[1]);
+  pn_delivery_settle(d);
+  pump(t[0], t[1]);
+
+  for (int i = 0; i < 16; i++) {
+    assert(pn_transport_pending(t[0]) == 0);
+    assert(pn_transport_pending(t[1]) == 0);
+  }
+}
+
+// send one small message on snd, take it off rcv, and settle both ends
+static void transfer(pn_transport_t **t, pn_link_t *snd, pn_link_t *rcv,
+                     pn_delivery_t **sent)
+{
+  pn_delivery_t *d = pn_delivery(snd, pn_dtag("tag", 3));
+  assert(pn_link_send(snd, "hello", 5) == 5);
+  pn_link_advance(snd);
+  pump(t[0], t[1]);
+
+  char buf[16];
+  pn_delivery_t *r = pn_link_current(rcv);
+  assert(r && pn_link_recv(rcv, buf, sizeof(buf)) == 5);
+  pn_link_advance(rcv);
+  pn_delivery_update(r, PN_ACCEPTED);
+  pn_delivery_settle(r);
+  pump(t[0], t[1]);
+  assert(pn_delivery_remote_state(d) == PN_ACCEPTED);
+  pn_delivery_settle(d);
+  pump(t[0], t[1]);
+  if (sent) *sent = d;
+}
+
+// once warmed up, sending and settling small messages allocates
+// nothing, a settled delivery is handed out again on any link of its
+// connection
+static void test_steady_state(void)
+{
+  pn_connection_t *c[2] = {pn_connection(), pn_connection()};
+  pn_transport_t *t[2] = {pn_transport(), pn_transport()};
+  pn_transport_bind(t[0], c[0]);
+  pn_transport_bind(t[1], c[1]);
+
+  pn_connection_open(c[0]);
+  pn_session_t *ssn = pn_session(c[0]);
+  pn_session_open(ssn);
+  pn_link_t *snd[2] = {pn_sender(ssn, "a"), pn_sender(ssn, "b")};
+  pn_link_open(snd[0]);
+  pn_link_open(snd[1]);
+  pump(t[0], t[1]);
+
+  pn_connection_open(c[1]);
+  pn_session_open(pn_session_head(c[1], PN_REMOTE_ACTIVE));
+  pn_link_t *rcv[2];
+  for (int i = 0; i < 2; i++) {
+    rcv[i] = pn_link_head(c[1], PN_LOCAL_UNINIT | PN_REMOTE_ACTIVE);
+    pn_link_open(rcv[i]);
+  }
+  // the links are matched up by name, whichever came first
+  if (strcmp(pn_link_name(rcv[0]), "a")) {
+    pn_link_t *tmp = rcv[0];
+    rcv[0] = rcv[1];
+    rcv[1] = tmp;
+  }
+  pn_link_flow(rcv[0], 1 << 30);
+  pn_link_flow(rcv[1], 1 << 30);
+  pump(t[0], t[1]);
+
+  pn_delivery_t *a, *b;
+  transfer(t, snd[0], rcv[0], &a);
+  transfer(t, snd[1], rcv[1], &b);
+  assert(a == b);
+
+  for (int i = 0; i < 1000; i++) {
+    transfer(t, snd[i % 2], rcv[i % 2], NULL);
+  }
+  size_t before = heap_used();
+  for (int i = 0; i < 100000; i++) {
+    transfer(t, snd[i % 2], rcv[i % 2], NULL);
+  }
+  size_t after = heap_used();
+  printf("steady state: %zu bytes grown over 100000 transfers\n", after - before);
+  assert(after == before);
+
+  for (int i = 0; i < 2; i++) {
+    pn_transport_unbind(t[i]);
+    pn_transport_free(t[i]);
+    pn_connection_free(c[i]);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  test_steady_state();
+
+  pn_connection_t **c = (pn_connection_t **) malloc(2*PAIRS*sizeof(pn_connection_t *));
+  pn_transport_t **t = (pn_transport_t **) malloc(2*PAIRS*sizeof(pn_transport_t *));
+
+  size_t before = heap_used();
+  for (int i = 0; i < PAIRS; i++) {
+    open_pair(&c[2*i], &t[2*i]);
+  }
+  size_t per = (heap_used() - before) / (2*PAIRS);
+  printf("idle connection: %zu bytes, budget %d\n", per, PN_IDLE_CONNECTION_BUDGET);
+  assert(per <= PN_IDLE_CONNECTION_BUDGET);
+
+  for (int i = 0; i < 2*PAIRS; i++) {
+    pn_transport_unbind(t[i]);
+    pn_transport_free(t[i]);
+    pn_connection_free(c[i]);
+  }
+  free(c);
+  free(t);
+  return 0;
+}
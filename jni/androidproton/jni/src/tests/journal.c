@@ -0,0 +1,455 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <proton/messenger.h>
+#include <proton/message.h>
+
+#define assert(E) ((E) ? 0 : (abort(), 0))
+
+#define COUNT (10)
+#define BENCH_COUNT (20000)
+#define BENCH_SIZE (1024)
+
+static const char *address = "amqp://127.0.0.1:56723/queue";
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static int segments(const char *directory)
+{
+  int count = 0;
+  DIR *dir = opendir(directory);
+  struct dirent *ent;
+  while ((ent = readdir(dir))) {
+    if (strstr(ent->d_name, ".pnj")) count++;
+  }
+  closedir(dir);
+  return count;
+}
+
+static void cleanup(const char *directory)
+{
+  char path[1024];
+  DIR *dir = opendir(directory);
+  struct dirent *ent;
+  while ((ent = readdir(dir))) {
+    if (strstr(ent->d_name, ".pnj")) {
+      snprintf(path, sizeof(path), "%s/%s", directory, ent->d_name);
+      unlink(path);
+    }
+  }
+  closedir(dir);
+  rmdir(directory);
+}
+
+static pn_messenger_t *journaled(const char *name, const char *directory)
+{
+  pn_messenger_t *messenger = pn_messenger(name);
+  pn_messenger_set_blocking(messenger, false);
+  pn_messenger_set_outgoing_window(messenger, COUNT);
+  assert(pn_messenger_set_journal(messenger, directory) == 0);
+  pn_messenger_start(messenger);
+  return messenger;
+}
+
+static void test_journal_recovery(const char *directory)
+{
+  pn_messenger_t *snd = pn_messenger("journal-sender");
+  assert(pn_messenger_set_journal_sync(snd, 0, 0) == PN_STATE_ERR);
+  assert(pn_messenger_set_journal(snd, NULL) == PN_ARG_ERR);
+  assert(pn_messenger_set_journal(snd, directory) == 0);
+  assert(pn_messenger_set_journal(snd, directory) == PN_STATE_ERR);
+  assert(pn_messenger_set_journal_sync(snd, 0, 0) == 0);
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_start(snd);
+
+  // nobody is listening yet, so nothing gets out before the crash
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, address);
+  char body[32];
+  for (int i = 0; i < COUNT; i++) {
+    snprintf(body, sizeof(body), "message-%d", i);
+    pn_data_put_string(pn_message_body(msg), pn_bytes(strlen(body), body));
+    assert(pn_messenger_put(snd, msg) == 0);
+    pn_data_clear(pn_message_body(msg));
+  }
+  pn_messenger_free(snd);
+
+  pn_messenger_t *rcv = pn_messenger("journal-receiver");
+  pn_messenger_set_blocking(rcv, false);
+  pn_messenger_set_incoming_window(rcv, COUNT);
+  pn_messenger_start(rcv);
+  assert(pn_messenger_subscribe(rcv, "amqp://~127.0.0.1:56723"));
+  pn_messenger_recv(rcv, COUNT);
+
+  snd = journaled("journal-sender", directory);
+  assert(pn_messenger_outgoing(snd) == COUNT);
+
+  int received = 0;
+  while (received < COUNT) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+    while (pn_messenger_get(rcv, msg) == 0) {
+      pn_data_t *data = pn_message_body(msg);
+      pn_data_next(data);
+      snprintf(body, sizeof(body), "message-%d", received++);
+      pn_bytes_t bytes = pn_data_get_string(data);
+      assert(bytes.size == strlen(body) && !memcmp(bytes.start, body, bytes.size));
+      pn_messenger_accept(rcv, pn_messenger_incoming_tracker(rcv), 0);
+    }
+  }
+
+  // once accepted nothing is left to recover
+  while (pn_messenger_status(snd, pn_messenger_outgoing_tracker(snd)) != PN_STATUS_ACCEPTED) {
+    pn_messenger_work(rcv, 0);
+    pn_messenger_work(snd, 10);
+  }
+  pn_messenger_free(snd);
+  snd = journaled("journal-sender", directory);
+  assert(pn_messenger_outgoing(snd) == 0);
+  assert(segments(directory) == 1);
+  pn_messenger_free(snd);
+
+  pn_message_free(msg);
+  pn_messenger_stop(rcv);
+  pn_messenger_free(rcv);
+}
+
+// a body whose first bytes say which message it is
+static void put_indexed(pn_messenger_t *messenger, pn_message_t *msg, int index, size_t size)
+{
+  char *body = (char *) calloc(1, size);
+  snprintf(body, size, "message-%d", index);
+  pn_data_t *data = pn_message_body(msg);
+  pn_data_clear(data);
+  pn_data_put_binary(data, pn_bytes(size, body));
+  assert(pn_messenger_put(messenger, msg) == 0);
+  free(body);
+}
+
+static int get_indexed(pn_messenger_t *messenger, pn_message_t *msg)
+{
+  pn_data_t *data = pn_message_body(msg);
+  pn_data_rewind(data);
+  assert(pn_data_next(data) && pn_data_type(data) == PN_BINARY);
+  int index = -1;
+  assert(sscanf(pn_data_get_binary(data).start, "message-%d", &index) == 1);
+  return index;
+}
+
+static pn_messenger_t *receiver(int window)
+{
+  pn_messenger_t *rcv = pn_messenger("journal-receiver");
+  pn_messenger_set_blocking(rcv, false);
+  pn_messenger_set_incoming_window(rcv, window);
+  pn_messenger_start(rcv);
+  assert(pn_messenger_subscribe(rcv, "amqp://~127.0.0.1:56723"));
+  pn_messenger_recv(rcv, -1);
+  return rcv;
+}
+
+static void counted(pn_messenger_t *messenger, pn_tracker_t tracker,
+                    pn_status_t status, void *context)
+{
+  if (status == PN_STATUS_ACCEPTED) (*(int *) context)++;
+}
+
+// receive count messages, accepting those below accept_below, and
+// wait until the sender has the outcomes
+static void receive(pn_messenger_t *snd, pn_messenger_t *rcv, pn_message_t *msg,
+                    int first, int count, int accept_below)
+{
+  int outcomes = 0;
+  pn_messenger_set_tracker_callback(snd, counted, &outcomes);
+  int received = 0, accepted = 0;
+  while (received < count) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+    while (pn_messenger_get(rcv, msg) == 0) {
+      int index = get_indexed(rcv, msg);
+      assert(index == first + received++);
+      if (index < accept_below) {
+        pn_messenger_accept(rcv, pn_messenger_incoming_tracker(rcv), 0);
+        accepted++;
+      }
+    }
+  }
+  for (int i = 0; i < 500 && outcomes < accepted; i++) {
+    pn_messenger_work(rcv, 0);
+    pn_messenger_work(snd, 10);
+  }
+  assert(outcomes == accepted);
+  pn_messenger_set_tracker_callback(snd, NULL, NULL);
+}
+
+static off_t last_byte(const char *path)
+{
+  FILE *file = fopen(path, "r");
+  assert(file);
+  off_t last = -1, offset = 0;
+  int c;
+  while ((c = fgetc(file)) != EOF) {
+    if (c) last = offset;
+    offset++;
+  }
+  fclose(file);
+  return last;
+}
+
+static void segment_path(const char *directory, char *path, size_t size)
+{
+  DIR *dir = opendir(directory);
+  struct dirent *ent;
+  path[0] = 0;
+  while ((ent = readdir(dir))) {
+    if (strstr(ent->d_name, ".pnj")) snprintf(path, size, "%s/%s", directory, ent->d_name);
+  }
+  closedir(dir);
+}
+
+static void test_torn_record(const char *directory, bool truncate_it)
+{
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, address);
+  pn_messenger_t *snd = journaled("journal-sender", directory);
+  assert(pn_messenger_set_journal_sync(snd, 0, 0) == 0);
+  for (int i = 0; i < COUNT; i++) {
+    put_indexed(snd, msg, i, 64);
+  }
+  pn_messenger_free(snd);
+
+  // the crash caught the last record half written, or its bytes never
+  // reached the disk
+  char path[1024];
+  segment_path(directory, path, sizeof(path));
+  off_t last = last_byte(path);
+  assert(last > 0);
+  if (truncate_it) {
+    assert(truncate(path, last - 16) == 0);
+  } else {
+    FILE *file = fopen(path, "r+");
+    fseek(file, last - 16, SEEK_SET);
+    fputc('X', file);
+    fclose(file);
+  }
+
+  // everything before it is recovered, and the journal carries on
+  snd = journaled("journal-sender", directory);
+  assert(pn_messenger_outgoing(snd) == COUNT - 1);
+  put_indexed(snd, msg, COUNT - 1, 64);
+  pn_messenger_free(snd);
+
+  pn_messenger_t *rcv = receiver(COUNT);
+  snd = journaled("journal-sender", directory);
+  assert(pn_messenger_outgoing(snd) == COUNT);
+  receive(snd, rcv, msg, 0, COUNT, COUNT);
+  pn_messenger_free(snd);
+  snd = journaled("journal-sender", directory);
+  assert(pn_messenger_outgoing(snd) == 0);
+  pn_messenger_free(snd);
+
+  pn_messenger_free(rcv);
+  pn_message_free(msg);
+  cleanup(directory);
+  assert(mkdir(directory, 0700) == 0);
+}
+
+#define LARGE (200*1024)
+#define LARGE_COUNT (50)
+
+static void test_partial_settle(const char *directory)
+{
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, address);
+  pn_messenger_t *snd = journaled("journal-sender", directory);
+  pn_messenger_set_outgoing_window(snd, LARGE_COUNT);
+  for (int i = 0; i < LARGE_COUNT; i++) {
+    put_indexed(snd, msg, i, LARGE);
+  }
+  pn_messenger_free(snd);
+  assert(segments(directory) == 3);
+
+  // the first half is accepted, the settle runs covering puts in
+  // the first two segments
+  pn_messenger_t *rcv = receiver(LARGE_COUNT);
+  snd = journaled("journal-sender", directory);
+  pn_messenger_set_outgoing_window(snd, LARGE_COUNT);
+  receive(snd, rcv, msg, 0, LARGE_COUNT, LARGE_COUNT/2);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+
+  // only the rest comes back, in order
+  rcv = receiver(LARGE_COUNT);
+  snd = journaled("journal-sender", directory);
+  pn_messenger_set_outgoing_window(snd, LARGE_COUNT);
+  assert(pn_messenger_outgoing(snd) == LARGE_COUNT/2);
+  receive(snd, rcv, msg, LARGE_COUNT/2, LARGE_COUNT/2, LARGE_COUNT);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+
+  snd = journaled("journal-sender", directory);
+  assert(pn_messenger_outgoing(snd) == 0);
+  assert(segments(directory) == 1);
+  pn_messenger_free(snd);
+  pn_message_free(msg);
+}
+
+// without an outgoing window a journaled message is still kept until
+// its outcome, and a redial sends it again whole
+static void test_reconnect(const char *directory)
+{
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, address);
+  pn_messenger_t *snd = journaled("journal-sender", directory);
+  pn_messenger_set_outgoing_window(snd, 0);
+  assert(pn_messenger_set_reconnect(snd, 10, 100) == 0);
+  pn_messenger_t *rcv = receiver(COUNT);
+  for (int i = 0; i < COUNT; i++) {
+    put_indexed(snd, msg, i, 64);
+  }
+
+  // everything reaches the first receiver, which dies before accepting
+  for (int i = 0; i < 100 && pn_messenger_incoming(rcv) < COUNT; i++) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+  }
+  assert(pn_messenger_incoming(rcv) == COUNT);
+  assert(pn_messenger_outgoing(snd) == 0);
+  pn_messenger_free(rcv);
+  for (int i = 0; i < 20; i++) {
+    pn_messenger_work(snd, 10);
+  }
+  assert(pn_messenger_outgoing(snd) == COUNT);
+
+  rcv = receiver(COUNT);
+  receive(snd, rcv, msg, 0, COUNT, COUNT);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+
+  snd = journaled("journal-sender", directory);
+  assert(pn_messenger_outgoing(snd) == 0);
+  pn_messenger_free(snd);
+  pn_message_free(msg);
+}
+
+static void test_live_reclaim(const char *directory)
+{
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, address);
+  pn_messenger_t *rcv = receiver(LARGE_COUNT);
+  pn_messenger_t *snd = journaled("journal-sender", directory);
+  pn_messenger_set_outgoing_window(snd, LARGE_COUNT);
+  int before = segments(directory);
+  for (int i = 0; i < LARGE_COUNT; i++) {
+    put_indexed(snd, msg, i, LARGE);
+  }
+  assert(segments(directory) == before + 2);
+
+  // the oldest segment goes as soon as everything in it is settled,
+  // while later ones are still live
+  receive(snd, rcv, msg, 0, LARGE_COUNT, LARGE_COUNT/2);
+  assert(segments(directory) == before + 1);
+  assert(pn_messenger_outgoing(snd) == 0);
+
+  // and the rest once the others are
+  pn_messenger_accept(rcv, pn_messenger_incoming_tracker(rcv), PN_CUMULATIVE);
+  for (int i = 0; i < 500 && segments(directory) > 1; i++) {
+    pn_messenger_work(rcv, 0);
+    pn_messenger_work(snd, 10);
+  }
+  assert(segments(directory) == 1);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+
+  snd = journaled("journal-sender", directory);
+  assert(pn_messenger_outgoing(snd) == 0);
+  pn_messenger_free(snd);
+  pn_message_free(msg);
+}
+
+static void bench_journal(const char *directory)
+{
+  char body[BENCH_SIZE];
+  memset(body, 'x', sizeof(body));
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, address);
+  pn_data_put_binary(pn_message_body(msg), pn_bytes(sizeof(body), body));
+
+  pn_messenger_t *snd = pn_messenger("journal-bench");
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_start(snd);
+  double start = now();
+  for (int i = 0; i < BENCH_COUNT; i++) {
+    pn_messenger_put(snd, msg);
+  }
+  double plain = now() - start;
+  pn_messenger_free(snd);
+
+  snd = pn_messenger("journal-bench");
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_set_journal(snd, directory);
+  pn_messenger_start(snd);
+  start = now();
+  for (int i = 0; i < BENCH_COUNT; i++) {
+    pn_messenger_put(snd, msg);
+  }
+  double journaled = now() - start;
+  pn_messenger_free(snd);
+
+  snd = pn_messenger("journal-bench");
+  pn_messenger_set_blocking(snd, false);
+  start = now();
+  pn_messenger_set_journal(snd, directory);
+  double recovered = now() - start;
+  assert(pn_messenger_outgoing(snd) == BENCH_COUNT);
+  pn_messenger_free(snd);
+
+  printf("%d messages of %d bytes: put %.0f/s, journaled put %.0f/s, recovery %.0f/s\n",
+         BENCH_COUNT, BENCH_SIZE, BENCH_COUNT/plain, BENCH_COUNT/journaled,
+         BENCH_COUNT/recovered);
+  pn_message_free(msg);
+}
+
+int main(int argc, char **argv)
+{
+  char directory[] = "/tmp/proton-journal-XXXXXX";
+  assert(mkdtemp(directory));
+  test_journal_recovery(directory);
+  test_torn_record(directory, false);
+  test_torn_record(directory, true);
+  test_partial_settle(directory);
+  test_reconnect(directory);
+  test_live_reclaim(directory);
+  bench_journal(directory);
+  cleanup(directory);
+  return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <proton/messenger.h>
+#include <proton/message.h>
+
+#define assert(E) ((E) ? 0 : (abort(), 0))
+
+#define COUNT (10)
+
+static void test_histogram()
+{
+  assert(pn_histogram_bucket_value(0) == 0);
+  assert(pn_histogram_bucket_value(15) == 15);
+  assert(pn_histogram_bucket_value(16) == 16);
+  assert(pn_histogram_bucket_value(31) == 31);
+  assert(pn_histogram_bucket_value(32) == 32);
+  assert(pn_histogram_bucket_value(33) == 34);
+  assert(pn_histogram_bucket_value(48) == 64);
+  assert(pn_histogram_bucket_value(PN_HISTOGRAM_BUCKETS - 1) == 31ull << 31);
+
+  pn_histogram_t histogram;
+  memset(&histogram, 0, sizeof(histogram));
+  assert(pn_histogram_percentile(&histogram, 50) == 0);
+  // 90 values of 5, and 10 between 64 and 67
+  histogram.buckets[5] = 90;
+  histogram.buckets[48] = 10;
+  histogram.count = 100;
+  histogram.min = 5;
+  histogram.max = 66;
+  assert(pn_histogram_percentile(&histogram, 0) == 5);
+  assert(pn_histogram_percentile(&histogram, 90) == 5);
+  assert(pn_histogram_percentile(&histogram, 91) == 66);
+  assert(pn_histogram_percentile(&histogram, 100) == 66);
+}
+
+static void test_latency()
+{
+  const char *address = "amqp://127.0.0.1:56737/queue";
+  pn_messenger_t *rcv = pn_messenger("latency-receiver");
+  pn_messenger_t *snd = pn_messenger("latency-sender");
+  pn_histogram_t histogram;
+  assert(pn_messenger_set_latency(NULL, true) == PN_ARG_ERR);
+  assert(pn_messenger_latency(snd, NULL, PN_LATENCY_CT, &histogram) == PN_ARG_ERR);
+  assert(pn_messenger_latency(snd, NULL, PN_LATENCY_TOTAL, NULL) == PN_ARG_ERR);
+  assert(pn_messenger_set_latency(snd, true) == 0);
+  assert(pn_messenger_set_latency(rcv, true) == 0);
+  pn_messenger_set_blocking(rcv, false);
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_set_outgoing_window(snd, COUNT);
+  pn_messenger_set_incoming_window(rcv, COUNT);
+  pn_messenger_start(rcv);
+  pn_messenger_start(snd);
+  assert(pn_messenger_subscribe(rcv, "amqp://~127.0.0.1:56737"));
+  pn_messenger_recv(rcv, -1);
+
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, address);
+  for (int i = 0; i < COUNT; i++) {
+    assert(pn_messenger_put(snd, msg) == 0);
+  }
+  pn_tracker_t last = pn_messenger_outgoing_tracker(snd);
+
+  int received = 0;
+  for (int i = 0; i < 500 && pn_messenger_status(snd, last) != PN_STATUS_ACCEPTED; i++) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+    while (pn_messenger_get(rcv, msg) == 0) {
+      pn_messenger_accept(rcv, pn_messenger_incoming_tracker(rcv), 0);
+      received++;
+    }
+  }
+  assert(received == COUNT);
+  assert(pn_messenger_status(snd, last) == PN_STATUS_ACCEPTED);
+
+  // every step of every message was timed, under its address too
+  for (int step = PN_LATENCY_QUEUED; step < PN_LATENCY_CT; step++) {
+    pn_messenger_t *m = step == PN_LATENCY_RECEIVE ? rcv : snd;
+    assert(pn_messenger_latency(m, NULL, (pn_latency_t) step, &histogram) == 0);
+    assert(histogram.count == COUNT);
+    assert(histogram.min <= histogram.max);
+    assert(pn_histogram_percentile(&histogram, 50) <= histogram.max);
+    assert(pn_histogram_percentile(&histogram, 100) == histogram.max);
+  }
+  pn_histogram_t total;
+  pn_messenger_latency(snd, address, PN_LATENCY_TOTAL, &total);
+  assert(total.count == COUNT);
+  pn_messenger_latency(snd, address, PN_LATENCY_QUEUED, &histogram);
+  assert(histogram.count == COUNT && histogram.max <= total.max);
+  pn_messenger_latency(snd, "amqp://127.0.0.1:56737/other", PN_LATENCY_TOTAL, &histogram);
+  assert(histogram.count == 0);
+
+  pn_message_free(msg);
+  pn_messenger_stop(snd);
+  pn_messenger_stop(rcv);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+}
+
+int main(int argc, char **argv)
+{
+  test_histogram();
+  test_latency();
+  return 0;
+}
@@ -0,0 +1,370 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <proton/messenger.h>
+#include <proton/message.h>
+
+#define assert(E) ((E) ? 0 : (abort(), 0))
+
+#define COUNT (20)
+#define LIMIT (4)
+#define ASIDE (3)
+
+static void test_outgoing_limit()
+{
+  pn_messenger_t *snd = pn_messenger("limit-sender");
+  pn_messenger_set_blocking(snd, false);
+  assert(pn_messenger_set_outgoing_limit(NULL, 0, 0) == PN_ARG_ERR);
+  assert(pn_messenger_set_outgoing_limit(snd, LIMIT, 0) == 0);
+  pn_messenger_start(snd);
+
+  // nobody is listening, so everything stays queued
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, "amqp://127.0.0.1:56727/queue");
+  pn_data_put_string(pn_message_body(msg), pn_bytes(5, "hello"));
+  assert(pn_messenger_outgoing_bytes(snd) == 0);
+  assert(pn_messenger_put(snd, msg) == 0);
+  size_t size = pn_messenger_outgoing_bytes(snd);
+  assert(size > 5);
+  for (int i = 1; i < LIMIT; i++) {
+    assert(pn_messenger_put(snd, msg) == 0);
+  }
+  assert(pn_messenger_put(snd, msg) == PN_OVERFLOW);
+  assert(pn_messenger_outgoing_bytes(snd) == LIMIT*size);
+
+  // the byte limit counts too, and so does the limit per address
+  pn_messenger_set_outgoing_limit(snd, 0, (LIMIT + 2)*size);
+  assert(pn_messenger_put(snd, msg) == 0);
+  assert(pn_messenger_put(snd, msg) == 0);
+  assert(pn_messenger_put(snd, msg) == PN_OVERFLOW);
+  pn_messenger_set_outgoing_limit(snd, 0, 0);
+  pn_messenger_set_address_limit(snd, LIMIT + 2, 0);
+  assert(pn_messenger_put(snd, msg) == PN_OVERFLOW);
+  pn_message_set_address(msg, "amqp://127.0.0.1:56727/other");
+  assert(pn_messenger_put(snd, msg) == 0);
+  assert(pn_messenger_outgoing_bytes(snd) == (LIMIT + 3)*size);
+
+  pn_message_free(msg);
+  pn_messenger_free(snd);
+}
+
+static void test_incoming_limit()
+{
+  const char *address = "amqp://127.0.0.1:56727/queue";
+  pn_messenger_t *rcv = pn_messenger("limit-receiver");
+  pn_messenger_t *snd = pn_messenger("limit-sender");
+  pn_messenger_set_blocking(rcv, false);
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_set_incoming_limit(rcv, LIMIT, 0);
+  pn_messenger_start(rcv);
+  pn_messenger_start(snd);
+  assert(pn_messenger_subscribe(rcv, "amqp://~127.0.0.1:56727"));
+  pn_messenger_recv(rcv, -1);
+
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, address);
+  for (int i = 0; i < COUNT; i++) {
+    assert(pn_messenger_put(snd, msg) == 0);
+  }
+
+  // the receiver only takes what it has room for, the rest waits at
+  // the sender
+  for (int i = 0; i < 10; i++) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+  }
+  assert(pn_messenger_incoming(rcv) == LIMIT);
+  assert(pn_messenger_outgoing(snd) == COUNT - LIMIT);
+  assert(pn_messenger_incoming_bytes(rcv) > 0);
+
+  int received = 0;
+  while (received < COUNT) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+    assert(pn_messenger_incoming(rcv) <= LIMIT);
+    while (pn_messenger_get(rcv, msg) == 0) {
+      received++;
+    }
+  }
+  assert(pn_messenger_incoming_bytes(rcv) == 0);
+
+  pn_message_free(msg);
+  pn_messenger_stop(snd);
+  pn_messenger_stop(rcv);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+}
+
+// a receiver whose address is full must not hold back the others
+static void test_address_limit_blocked()
+{
+  pn_messenger_t *rcv = pn_messenger("limit-receiver");
+  pn_messenger_set_blocking(rcv, false);
+  pn_messenger_set_address_limit(rcv, LIMIT, 0);
+  pn_messenger_start(rcv);
+  assert(pn_messenger_subscribe(rcv, "amqp://~127.0.0.1:56727"));
+  pn_messenger_recv(rcv, -1);
+
+  // fill the first address from a sender that then goes away, so that
+  // the next link to it starts out blocked
+  pn_message_t *msg = pn_message();
+  pn_messenger_t *snd = pn_messenger("limit-sender");
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_start(snd);
+  pn_message_set_address(msg, "amqp://127.0.0.1:56727/full");
+  for (int i = 0; i < LIMIT; i++) {
+    assert(pn_messenger_put(snd, msg) == 0);
+  }
+  while (pn_messenger_incoming(rcv) < LIMIT) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+  }
+  pn_messenger_stop(snd);
+  while (!pn_messenger_stopped(snd)) {
+    pn_messenger_work(rcv, 0);
+    pn_messenger_work(snd, 10);
+  }
+  pn_messenger_free(snd);
+
+  snd = pn_messenger("limit-sender");
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_start(snd);
+  for (int i = 0; i < COUNT; i++) {
+    assert(pn_messenger_put(snd, msg) == 0);
+  }
+  pn_message_set_address(msg, "amqp://127.0.0.1:56727/free");
+  for (int i = 0; i < COUNT; i++) {
+    assert(pn_messenger_put(snd, msg) == 0);
+  }
+  for (int i = 0; i < 20 && pn_messenger_incoming(rcv) < 2*LIMIT; i++) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+  }
+  assert(pn_messenger_incoming(rcv) == 2*LIMIT);
+
+  int received = 0;
+  while (received < LIMIT + 2*COUNT) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+    while (pn_messenger_get(rcv, msg) == 0) {
+      received++;
+    }
+  }
+
+  pn_message_free(msg);
+  pn_messenger_stop(snd);
+  pn_messenger_stop(rcv);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+}
+
+typedef struct {
+  pn_messenger_t *messenger;
+  volatile bool done;
+  int queue;
+  int aside;
+} receiver_t;
+
+static void *receive(void *context)
+{
+  receiver_t *receiver = (receiver_t *) context;
+  pn_message_t *msg = pn_message();
+  // kept working until the sender has its outcomes
+  while (!receiver->done) {
+    pn_messenger_work(receiver->messenger, 10);
+    while (pn_messenger_get(receiver->messenger, msg) == 0) {
+      if (strstr(pn_message_get_address(msg), "/queue")) receiver->queue++;
+      if (strstr(pn_message_get_address(msg), "/aside")) receiver->aside++;
+      pn_messenger_accept(receiver->messenger,
+                          pn_messenger_incoming_tracker(receiver->messenger), 0);
+    }
+  }
+  pn_message_free(msg);
+  return NULL;
+}
+
+typedef struct {
+  pn_message_t *msg;
+  int puts;
+} putter_t;
+
+static void put_aside(pn_messenger_t *messenger, pn_tracker_t tracker,
+                      pn_status_t status, void *context)
+{
+  putter_t *putter = (putter_t *) context;
+  pn_messenger_settle(messenger, tracker, 0);
+  if (putter->puts < ASIDE) {
+    putter->puts++;
+    assert(pn_messenger_put(messenger, putter->msg) == 0);
+  }
+}
+
+// a put from a tracker callback while another waits for room must not
+// disturb the address the waiting one goes to
+static void test_put_from_callback()
+{
+  pn_messenger_t *rcv = pn_messenger("limit-receiver");
+  pn_messenger_t *snd = pn_messenger("limit-sender");
+  pn_messenger_set_blocking(rcv, false);
+  pn_messenger_set_incoming_window(rcv, COUNT + ASIDE);
+  // a slow receiver, so that puts wait for room, which takes back
+  // credit left on an idle link soon
+  pn_messenger_set_incoming_limit(rcv, 1, 0);
+  pn_messenger_set_drain_latency(rcv, 10);
+  pn_messenger_set_outgoing_window(snd, COUNT + ASIDE);
+  pn_messenger_set_timeout(snd, 10000);
+  pn_messenger_set_address_limit(snd, LIMIT, 0);
+  putter_t putter = {pn_message(), 0};
+  pn_message_set_address(putter.msg, "amqp://127.0.0.1:56727/aside"
+                         "/with/a/name/long/enough/to/move/the/buffers/it/lands/in");
+  pn_messenger_set_tracker_callback(snd, put_aside, &putter);
+  pn_messenger_start(rcv);
+  pn_messenger_start(snd);
+  assert(pn_messenger_subscribe(rcv, "amqp://~127.0.0.1:56727"));
+  pn_messenger_recv(rcv, -1);
+
+  receiver_t receiver = {rcv, false, 0, 0};
+  pthread_t thread;
+  pthread_create(&thread, NULL, receive, &receiver);
+
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, "amqp://127.0.0.1:56727/queue");
+  for (int i = 0; i < COUNT; i++) {
+    assert(pn_messenger_put(snd, msg) == 0);
+    assert(!strcmp(pn_message_get_address(msg), "amqp://127.0.0.1:56727/queue"));
+  }
+  assert(pn_messenger_send(snd, -1) == 0);
+  receiver.done = true;
+  pthread_join(thread, NULL);
+  assert(putter.puts == ASIDE);
+  assert(receiver.queue == COUNT && receiver.aside == ASIDE);
+
+  pn_message_free(msg);
+  pn_message_free(putter.msg);
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_stop(snd);
+  pn_messenger_stop(rcv);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+}
+
+static pn_messenger_t *slow_receiver()
+{
+  pn_messenger_t *rcv = pn_messenger("limit-receiver");
+  pn_messenger_set_blocking(rcv, false);
+  pn_messenger_set_incoming_window(rcv, COUNT);
+  pn_messenger_set_incoming_limit(rcv, 1, 0);
+  pn_messenger_start(rcv);
+  assert(pn_messenger_subscribe(rcv, "amqp://~127.0.0.1:56727"));
+  pn_messenger_recv(rcv, -1);
+  return rcv;
+}
+
+typedef struct {
+  pn_messenger_t *messenger;
+  volatile bool done;
+  int seen[COUNT];
+} dropper_t;
+
+// take a few messages without accepting them and go away, then come
+// back and take everything
+static void *receive_dropping(void *context)
+{
+  dropper_t *dropper = (dropper_t *) context;
+  pn_message_t *msg = pn_message();
+  int taken = 0;
+  while (taken < LIMIT) {
+    pn_messenger_work(dropper->messenger, 10);
+    while (taken < LIMIT && pn_messenger_get(dropper->messenger, msg) == 0) {
+      taken++;
+    }
+  }
+  pn_messenger_free(dropper->messenger);
+
+  dropper->messenger = slow_receiver();
+  while (!dropper->done) {
+    pn_messenger_work(dropper->messenger, 10);
+    while (pn_messenger_get(dropper->messenger, msg) == 0) {
+      pn_data_t *body = pn_message_body(msg);
+      pn_data_rewind(body);
+      assert(pn_data_next(body));
+      dropper->seen[pn_data_get_int(body)]++;
+      pn_messenger_accept(dropper->messenger,
+                          pn_messenger_incoming_tracker(dropper->messenger), 0);
+    }
+  }
+  pn_message_free(msg);
+  return NULL;
+}
+
+// a batch to one address goes on across a connection lost while it
+// waits for room
+static void test_batch_across_drop()
+{
+  pn_messenger_t *snd = pn_messenger("limit-sender");
+  pn_messenger_set_outgoing_window(snd, COUNT);
+  pn_messenger_set_timeout(snd, 10000);
+  pn_messenger_set_address_limit(snd, LIMIT, 0);
+  assert(pn_messenger_set_reconnect(snd, 10, 100) == 0);
+  pn_messenger_start(snd);
+
+  dropper_t dropper;
+  memset(&dropper, 0, sizeof(dropper));
+  dropper.messenger = slow_receiver();
+  pthread_t thread;
+  pthread_create(&thread, NULL, receive_dropping, &dropper);
+
+  pn_message_t *msgs[COUNT];
+  for (int i = 0; i < COUNT; i++) {
+    msgs[i] = pn_message();
+    pn_message_set_address(msgs[i], "amqp://127.0.0.1:56727/queue");
+    pn_data_put_int(pn_message_body(msgs[i]), i);
+  }
+  assert(pn_messenger_put_batch(snd, msgs, COUNT) == COUNT);
+  assert(pn_messenger_send(snd, -1) == 0);
+  dropper.done = true;
+  pthread_join(thread, NULL);
+  for (int i = 0; i < COUNT; i++) {
+    assert(dropper.seen[i] >= 1);
+    pn_message_free(msgs[i]);
+  }
+
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_stop(snd);
+  pn_messenger_stop(dropper.messenger);
+  pn_messenger_free(snd);
+  pn_messenger_free(dropper.messenger);
+}
+
+int main(int argc, char **argv)
+{
+  test_outgoing_limit();
+  test_incoming_limit();
+  test_address_limit_blocked();
+  test_put_from_callback();
+  test_batch_across_drop();
+  return 0;
+}
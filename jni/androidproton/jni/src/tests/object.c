@@ -499,6 +499,53 @@ static void test_hash()
   pn_decref(three);
 }
 
+static void test_hash_del_chained()
+{
+  void *one = pn_new(0, NULL);
+  void *two = pn_new(0, NULL);
+
+  // 1 and 4 land in the same slot, removing the first must not lose
+  // the second
+  pn_hash_t *hash = pn_hash(4, 0.75, PN_REFCOUNT);
+  pn_hash_put(hash, 1, one);
+  pn_hash_put(hash, 4, two);
+  pn_hash_del(hash, 1);
+  assert(pn_hash_size(hash) == 1);
+  assert(pn_hash_get(hash, 1) == NULL);
+  assert(pn_hash_get(hash, 4) == two);
+  pn_hash_put(hash, 1, one);
+  assert(pn_hash_get(hash, 1) == one);
+  assert(pn_hash_get(hash, 4) == two);
+  pn_decref(hash);
+
+  // enough string keys for chains to spill past their buckets, then
+  // knock out every other one
+  pn_map_t *map = pn_map(0, 0.75, PN_REFCOUNT);
+  pn_list_t *keys = pn_list(0, PN_REFCOUNT);
+  for (int i = 0; i < 200; i++) {
+    pn_string_t *key = pn_string(NULL);
+    pn_string_format(key, "key-%d", i);
+    pn_map_put(map, key, key);
+    pn_list_add(keys, key);
+    pn_decref(key);
+  }
+  for (int i = 0; i < 200; i += 2) {
+    pn_map_del(map, pn_list_get(keys, i));
+  }
+  assert(pn_map_size(map) == 100);
+  for (int i = 0; i < 200; i++) {
+    void *key = pn_list_get(keys, i);
+    assert(pn_map_get(map, key) == ((i % 2) ? key : NULL));
+  }
+  pn_decref(map);
+  pn_decref(keys);
+
+  assert(pn_refcount(one) == 1);
+  assert(pn_refcount(two) == 1);
+  pn_decref(one);
+  pn_decref(two);
+}
+
 static bool equals(const char *a, const char *b)
 {
   if (a == NULL && b == NULL) {
@@ -755,6 +802,7 @@ int main(int argc, char **argv)
   test_map();
 
   test_hash();
+  test_hash_del_chained();
 
   test_string(NULL);
   test_string("");
@@ -0,0 +1,87 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <proton/messenger.h>
+#include <proton/message.h>
+
+#define assert(E) ((E) ? 0 : (abort(), 0))
+
+#define COUNT (20)
+
+static void test_priority_order()
+{
+  const char *address = "amqp://127.0.0.1:56725/queue";
+  pn_messenger_t *rcv = pn_messenger("priority-receiver");
+  pn_messenger_t *snd = pn_messenger("priority-sender");
+  pn_messenger_set_blocking(rcv, false);
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_start(rcv);
+  pn_messenger_start(snd);
+  assert(pn_messenger_subscribe(rcv, "amqp://~127.0.0.1:56725"));
+
+  // nothing goes out without credit, so everything is queued by the
+  // time the receiver asks: low priority first, then high
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, address);
+  for (int i = 0; i < 2*COUNT; i++) {
+    pn_message_set_priority(msg, i < COUNT ? 1 : 9);
+    assert(pn_messenger_put(snd, msg) == 0);
+  }
+  for (int i = 0; i < 10; i++) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+  }
+  assert(pn_messenger_outgoing(snd) == 2*COUNT);
+
+  pn_messenger_recv(rcv, 2*COUNT);
+  int received = 0, high = 0, first_low = -1;
+  while (received < 2*COUNT) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+    while (pn_messenger_get(rcv, msg) == 0) {
+      if (pn_message_get_priority(msg) == 9) {
+        high++;
+      } else if (first_low < 0) {
+        first_low = received;
+      }
+      received++;
+    }
+  }
+  assert(high == COUNT);
+  // high priority goes first, but the low priority messages are not
+  // kept waiting until it has all gone
+  assert(first_low > 0 && first_low < COUNT);
+
+  pn_message_free(msg);
+  pn_messenger_stop(snd);
+  pn_messenger_stop(rcv);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+}
+
+int main(int argc, char **argv)
+{
+  test_priority_order();
+  return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <proton/messenger.h>
+#include <proton/message.h>
+
+#define assert(E) ((E) ? 0 : (abort(), 0))
+
+#define COUNT (20)
+
+static pn_messenger_t *receiver(const char *name, const char *source)
+{
+  pn_messenger_t *rcv = pn_messenger(name);
+  pn_messenger_set_blocking(rcv, false);
+  pn_messenger_set_incoming_window(rcv, COUNT);
+  pn_messenger_start(rcv);
+  assert(pn_messenger_subscribe(rcv, source));
+  pn_messenger_recv(rcv, -1);
+  return rcv;
+}
+
+static void test_reconnect()
+{
+  pn_messenger_t *snd = pn_messenger("reconnect-sender");
+  assert(pn_messenger_set_reconnect(NULL, 10, 100) == PN_ARG_ERR);
+  assert(pn_messenger_set_reconnect(snd, -1, 100) == PN_ARG_ERR);
+  assert(pn_messenger_set_reconnect(snd, 10, 100) == 0);
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_set_outgoing_window(snd, COUNT);
+  pn_messenger_start(snd);
+  pn_messenger_t *rcv = receiver("reconnect-receiver-1", "amqp://~127.0.0.1:56731");
+
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, "amqp://127.0.0.1:56731/queue");
+  pn_tracker_t trackers[COUNT];
+  for (int i = 0; i < COUNT; i++) {
+    pn_data_t *body = pn_message_body(msg);
+    pn_data_clear(body);
+    pn_data_put_int(body, i);
+    assert(pn_messenger_put(snd, msg) == 0);
+    trackers[i] = pn_messenger_outgoing_tracker(snd);
+  }
+
+  // everything reaches the first receiver, which dies before settling
+  for (int i = 0; i < 100 && pn_messenger_incoming(rcv) < COUNT; i++) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+  }
+  assert(pn_messenger_incoming(rcv) == COUNT);
+  assert(pn_messenger_outgoing(snd) == 0);
+  assert(pn_messenger_status(snd, trackers[0]) == PN_STATUS_PENDING);
+  pn_messenger_free(rcv);
+
+  // with nobody listening the sender keeps redialling, and the lost
+  // messages wait in its queue
+  for (int i = 0; i < 20; i++) {
+    pn_messenger_work(snd, 10);
+  }
+  assert(pn_messenger_outgoing(snd) == COUNT);
+  assert(pn_messenger_status(snd, trackers[0]) == PN_STATUS_PENDING);
+
+  // a new receiver on the same port gets all of them, in order
+  rcv = receiver("reconnect-receiver-2", "amqp://~127.0.0.1:56731");
+  int received = 0;
+  for (int i = 0; i < 500 && received < COUNT; i++) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+    while (pn_messenger_get(rcv, msg) == 0) {
+      pn_data_t *body = pn_message_body(msg);
+      pn_data_rewind(body);
+      assert(pn_data_next(body) && pn_data_get_int(body) == received);
+      pn_messenger_accept(rcv, pn_messenger_incoming_tracker(rcv), 0);
+      received++;
+    }
+  }
+  assert(received == COUNT);
+
+  for (int i = 0; i < 100 &&
+         pn_messenger_status(snd, trackers[COUNT - 1]) != PN_STATUS_ACCEPTED; i++) {
+    pn_messenger_work(rcv, 0);
+    pn_messenger_work(snd, 10);
+  }
+  for (int i = 0; i < COUNT; i++) {
+    assert(pn_messenger_status(snd, trackers[i]) == PN_STATUS_ACCEPTED);
+  }
+
+  pn_message_free(msg);
+  pn_messenger_stop(snd);
+  pn_messenger_stop(rcv);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+}
+
+// a peer that hangs up on every connection, counting them
+static int hang_up(int fd)
+{
+  int count = 0;
+  int conn;
+  while ((conn = accept(fd, NULL, NULL)) >= 0) {
+    close(conn);
+    count++;
+  }
+  return count;
+}
+
+// puts while a destination is down wait for its redial, rather than
+// dialling it again each time
+static void test_put_during_outage()
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in sin;
+  memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons(56745);
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  assert(bind(fd, (struct sockaddr *) &sin, sizeof(sin)) == 0);
+  assert(listen(fd, 16) == 0);
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  pn_messenger_t *snd = pn_messenger("outage-sender");
+  assert(pn_messenger_set_reconnect(snd, 20, 200) == 0);
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_start(snd);
+
+  pn_message_t *msg = pn_message();
+  int dials = 0;
+  for (int i = 0; i < COUNT; i++) {
+    // an address first put to during the outage is redialled too
+    pn_message_set_address(msg, i % 2 ? "amqp://127.0.0.1:56745/other" :
+                           "amqp://127.0.0.1:56745/queue");
+    assert(pn_messenger_put(snd, msg) == 0);
+    for (int j = 0; j < 4; j++) {
+      pn_messenger_work(snd, 5);
+      dials += hang_up(fd);
+    }
+  }
+  assert(pn_messenger_outgoing(snd) == COUNT);
+  // 400ms take at most seven attempts at the shortest jittered backoff
+  assert(dials > 1 && dials <= 8);
+  close(fd);
+
+  pn_messenger_t *rcv = receiver("outage-receiver", "amqp://~127.0.0.1:56745");
+  int received = 0;
+  for (int i = 0; i < 500 && received < COUNT; i++) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+    while (pn_messenger_get(rcv, msg) == 0) {
+      received++;
+    }
+  }
+  assert(received == COUNT);
+
+  pn_message_free(msg);
+  pn_messenger_stop(snd);
+  pn_messenger_stop(rcv);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+}
+
+int main(int argc, char **argv)
+{
+  test_reconnect();
+  test_put_during_outage();
+  return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <proton/engine.h>
+#include <proton/sasl.h>
+
+#define assert(E) ((E) ? 0 : (abort(), 0))
+
+#define AMQP_HEADER ("AMQP\x00\x01\x00\x00")
+#define SASL_HEADER ("AMQP\x03\x01\x00\x00")
+
+typedef struct {
+  pn_connection_t *conn;
+  pn_transport_t *transport;
+  pn_sasl_t *sasl;
+} peer_t;
+
+static void peer_open(peer_t *p, bool client, bool sasl)
+{
+  p->conn = pn_connection();
+  p->transport = pn_transport();
+  p->sasl = NULL;
+  if (sasl) {
+    p->sasl = pn_sasl(p->transport);
+    pn_sasl_mechanisms(p->sasl, "ANONYMOUS");
+    if (client) {
+      pn_sasl_client(p->sasl);
+      pn_sasl_pipeline(p->sasl, true);
+    } else {
+      pn_sasl_server(p->sasl);
+    }
+  }
+  pn_transport_bind(p->transport, p->conn);
+  if (client) {
+    pn_connection_open(p->conn);
+    pn_session_t *ssn = pn_session(p->conn);
+    pn_session_open(ssn);
+    pn_link_open(pn_sender(ssn, "link"));
+  }
+}
+
+static void peer_close(peer_t *p)
+{
+  pn_transport_unbind(p->transport);
+  pn_transport_free(p->transport);
+  pn_connection_free(p->conn);
+}
+
+static bool contains(const char *bytes, size_t size, const char *what, size_t n)
+{
+  for (size_t i = 0; i + n <= size; i++) {
+    if (!memcmp(bytes + i, what, n)) return true;
+  }
+  return false;
+}
+
+// everything one side has to say, without waiting for the other
+static ssize_t flight(peer_t *from, char *buf, size_t size)
+{
+  size_t total = 0;
+  ssize_t n;
+  while (total < size &&
+         (n = pn_transport_output(from->transport, buf + total, size - total)) > 0) {
+    total += n;
+  }
+  return total ? (ssize_t) total : n;
+}
+
+static bool remote_active(pn_connection_t *conn)
+{
+  return pn_connection_state(conn) & PN_REMOTE_ACTIVE;
+}
+
+static void test_pipelined()
+{
+  peer_t client, server;
+  peer_open(&client, true, true);
+  peer_open(&server, false, true);
+
+  // the first flight carries the sasl init and the amqp setup together
+  char buf[4096];
+  ssize_t n = flight(&client, buf, sizeof(buf));
+  assert(n > 0);
+  assert(!memcmp(buf, SASL_HEADER, 8));
+  assert(contains(buf, n, AMQP_HEADER, 8));
+  assert(pn_transport_input(server.transport, buf, n) == n);
+
+  // the server holds the amqp frames until it has decided
+  assert(pn_sasl_state(server.sasl) == PN_SASL_STEP);
+  assert(!remote_active(server.conn));
+  pn_sasl_done(server.sasl, PN_SASL_OK);
+
+  // and takes them up without any more input from the client
+  n = flight(&server, buf, sizeof(buf));
+  assert(n > 0);
+  assert(remote_active(server.conn));
+  assert(pn_link_head(server.conn, PN_REMOTE_ACTIVE));
+  assert(pn_sasl_state(server.sasl) == PN_SASL_PASS);
+
+  assert(pn_transport_input(client.transport, buf, n) == n);
+  assert(pn_sasl_state(client.sasl) == PN_SASL_PASS);
+
+  peer_close(&client);
+  peer_close(&server);
+}
+
+static void test_rejected()
+{
+  peer_t client, server;
+  peer_open(&client, true, true);
+  peer_open(&server, false, true);
+
+  char buf[4096];
+  ssize_t n = flight(&client, buf, sizeof(buf));
+  assert(pn_transport_input(server.transport, buf, n) == n);
+  pn_sasl_done(server.sasl, PN_SASL_AUTH);
+
+  // the pipelined frames are never processed by the server
+  n = flight(&server, buf, sizeof(buf));
+  assert(n > 0);
+  assert(!remote_active(server.conn));
+  assert(pn_sasl_state(server.sasl) == PN_SASL_FAIL);
+
+  // and the client stops with an error rather than going on
+  assert(pn_transport_input(client.transport, buf, n) < 0);
+  assert(pn_sasl_state(client.sasl) == PN_SASL_FAIL);
+  assert(strstr(pn_error_text(pn_transport_error(client.transport)), "SASL negotiation failed"));
+  assert(pn_transport_output(client.transport, buf, sizeof(buf)) < 0);
+
+  peer_close(&client);
+  peer_close(&server);
+}
+
+static void test_mismatch()
+{
+  // a pipelining client against a server that does not do sasl
+  peer_t client, server;
+  peer_open(&client, true, true);
+  peer_open(&server, false, false);
+
+  char buf[4096];
+  ssize_t n = flight(&client, buf, sizeof(buf));
+  assert(n > 0);
+  assert(pn_transport_input(server.transport, buf, n) < 0);
+  assert(strstr(pn_error_text(pn_transport_error(server.transport)), "header mismatch"));
+  assert(!remote_active(server.conn));
+
+  n = flight(&server, buf, sizeof(buf));
+  assert(n > 0 && !memcmp(buf, AMQP_HEADER, 8));
+  assert(pn_transport_input(client.transport, buf, n) < 0);
+  assert(strstr(pn_error_text(pn_transport_error(client.transport)), "header mismatch"));
+
+  peer_close(&client);
+  peer_close(&server);
+}
+
+int main(int argc, char **argv)
+{
+  test_pipelined();
+  test_rejected();
+  test_mismatch();
+  return 0;
+}
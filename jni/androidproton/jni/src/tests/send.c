@@ -0,0 +1,225 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <proton/engine.h>
+#include <proton/message.h>
+
+#define assert(E) ((E) ? 0 : (abort(), 0))
+
+#define ROUNDS (2000)
+
+static void pump_one(pn_transport_t *src, pn_transport_t *dst, bool *moved)
+{
+  char buf[16*1024];
+  ssize_t n = pn_transport_output(src, buf, sizeof(buf));
+  if (n > 0) {
+    pn_transport_input(dst, buf, n);
+    *moved = true;
+  }
+}
+
+static void pump(pn_transport_t *a, pn_transport_t *b)
+{
+  bool moved = true;
+  while (moved) {
+    moved = false;
+    pump_one(a, b, &moved);
+    pump_one(b, a, &moved);
+  }
+}
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+typedef struct {
+  pn_connection_t *c1, *c2;
+  pn_transport_t *t1, *t2;
+  pn_link_t *snd, *rcv;
+} pair_t;
+
+static void pair_open(pair_t *p)
+{
+  p->c1 = pn_connection();
+  p->c2 = pn_connection();
+  p->t1 = pn_transport();
+  p->t2 = pn_transport();
+  pn_transport_bind(p->t1, p->c1);
+  pn_transport_bind(p->t2, p->c2);
+
+  pn_connection_open(p->c1);
+  pn_session_t *ssn = pn_session(p->c1);
+  pn_session_open(ssn);
+  p->snd = pn_sender(ssn, "link");
+  pn_link_open(p->snd);
+  pump(p->t1, p->t2);
+
+  pn_connection_open(p->c2);
+  pn_session_open(pn_session_head(p->c2, PN_REMOTE_ACTIVE));
+  p->rcv = pn_link_head(p->c2, PN_REMOTE_ACTIVE);
+  pn_link_open(p->rcv);
+  pn_link_flow(p->rcv, ROUNDS + 1);
+  pump(p->t1, p->t2);
+}
+
+static void pair_close(pair_t *p)
+{
+  pn_transport_unbind(p->t1);
+  pn_transport_free(p->t1);
+  pn_connection_free(p->c1);
+  pn_transport_unbind(p->t2);
+  pn_transport_free(p->t2);
+  pn_connection_free(p->c2);
+}
+
+static void test_send_buffer()
+{
+  pair_t p;
+  pair_open(&p);
+
+  pn_buffer_t *buf = pn_buffer(64);
+  assert(pn_link_send_buffer(p.snd, buf) == PN_EOS);
+
+  // an idle delivery takes over the storage
+  pn_delivery(p.snd, pn_dtag("a", 1));
+  pn_bytes_t space = pn_buffer_space(buf);
+  assert(space.size == 64);
+  memcpy(space.start, "hello ", 6);
+  assert(pn_buffer_commit(buf, 6) == 0);
+  assert(pn_buffer_commit(buf, 100) == PN_OVERFLOW);
+  assert(pn_link_send_buffer(p.snd, buf) == 6);
+  assert(pn_buffer_size(buf) == 0);
+
+  // a partly written one is appended to
+  pn_buffer_append(buf, "world", 5);
+  assert(pn_link_send_buffer(p.snd, buf) == 5);
+  assert(pn_buffer_size(buf) == 0);
+  pn_link_advance(p.snd);
+  pump(p.t1, p.t2);
+
+  char out[16];
+  pn_delivery_t *d = pn_link_current(p.rcv);
+  assert(d && !pn_delivery_partial(d));
+  assert(pn_link_recv(p.rcv, out, sizeof(out)) == 11);
+  assert(!memcmp(out, "hello world", 11));
+  pn_link_advance(p.rcv);
+
+  // the receiving side hands its storage over the same way
+  pn_delivery(p.snd, pn_dtag("b", 1));
+  pn_link_send(p.snd, "again", 5);
+  pn_link_advance(p.snd);
+  pump(p.t1, p.t2);
+  assert(pn_link_recv_buffer(p.rcv, buf) == 5);
+  assert(pn_link_recv_buffer(p.rcv, buf) == PN_EOS);
+  pn_bytes_t bytes = pn_buffer_bytes(buf);
+  assert(bytes.size == 5 && !memcmp(bytes.start, "again", 5));
+  pn_link_advance(p.rcv);
+  assert(pn_link_recv_buffer(p.rcv, buf) == PN_STATE_ERR);
+
+  pn_buffer_free(buf);
+  pair_close(&p);
+}
+
+// the sending half of a messenger put: encode the message into a
+// fresh entry buffer and queue it on a delivery, either the old way
+// (re-encoding at every doubling, then two copies) or directly into
+// storage that is handed to the delivery
+static double bench(pn_message_t *msg, bool zero_copy)
+{
+  pair_t p;
+  pair_open(&p);
+
+  size_t hint = 0;
+  double elapsed = 0;
+  for (int i = 0; i < ROUNDS; i++) {
+    pn_delivery(p.snd, pn_dtag((char *) &i, sizeof(i)));
+    double start = now();
+    pn_buffer_t *buf = pn_buffer(64);
+    if (zero_copy) pn_buffer_ensure(buf, hint);
+    while (true) {
+      pn_bytes_t space = pn_buffer_space(buf);
+      size_t size = space.size;
+      int err = pn_message_encode(msg, space.start, &size);
+      if (err == PN_OVERFLOW) {
+        pn_buffer_ensure(buf, 2*pn_buffer_capacity(buf));
+        continue;
+      }
+      assert(!err);
+      if (zero_copy) {
+        pn_buffer_commit(buf, size);
+        hint = size;
+        pn_link_send_buffer(p.snd, buf);
+      } else {
+        pn_buffer_append(buf, space.start, size);
+        pn_bytes_t bytes = pn_buffer_bytes(buf);
+        pn_link_send(p.snd, bytes.start, bytes.size);
+      }
+      break;
+    }
+    pn_link_advance(p.snd);
+    pn_buffer_free(buf);
+    elapsed += now() - start;
+
+    pump(p.t1, p.t2);
+    pn_delivery_t *d = pn_link_current(p.rcv);
+    assert(d && !pn_delivery_partial(d));
+    pn_link_advance(p.rcv);
+    pn_delivery_settle(d);
+    pn_delivery_settle(pn_unsettled_head(p.snd));
+  }
+
+  pair_close(&p);
+  return elapsed/ROUNDS;
+}
+
+static void bench_put()
+{
+  static char body[64*1024];
+  memset(body, 'x', sizeof(body));
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, "amqp://0.0.0.0/bench");
+
+  for (size_t size = 1024; size <= sizeof(body); size *= 4) {
+    pn_data_t *data = pn_message_body(msg);
+    pn_data_clear(data);
+    pn_data_put_binary(data, pn_bytes(size, body));
+    double copied = bench(msg, false);
+    double direct = bench(msg, true);
+    printf("put %6zu bytes: copied %8.2f us, direct %8.2f us\n",
+           size, copied*1e6, direct*1e6);
+  }
+
+  pn_message_free(msg);
+}
+
+int main(int argc, char **argv)
+{
+  test_send_buffer();
+  bench_put();
+  return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <proton/sharded.h>
+#include <proton/message.h>
+
+#define assert(E) ((E) ? 0 : (abort(), 0))
+
+#define SHARDS (4)
+#define THREADS (4)
+#define ADDRESSES (8)
+#define COUNT (500)
+
+typedef struct {
+  pn_sharded_t *sharded;
+  int id;
+} producer_t;
+
+static void *produce(void *context)
+{
+  producer_t *producer = (producer_t *) context;
+  pn_message_t *msg = pn_message();
+  char address[64];
+  for (int i = 0; i < COUNT; i++) {
+    sprintf(address, "amqp://127.0.0.1:56735/q%d", i % ADDRESSES);
+    pn_message_set_address(msg, address);
+    pn_data_t *body = pn_message_body(msg);
+    pn_data_clear(body);
+    pn_data_put_int(body, producer->id*COUNT + i);
+    int err;
+    while ((err = pn_sharded_put(producer->sharded, msg)) == PN_OVERFLOW);
+    assert(!err);
+  }
+  pn_message_free(msg);
+  return NULL;
+}
+
+static void test_sharded()
+{
+  assert(!pn_sharded("sharded", 0));
+  assert(!pn_sharded("sharded", PN_SHARDS_MAX + 1));
+
+  pn_sharded_t *rcv = pn_sharded("sharded-receiver", 2);
+  assert(pn_sharded_subscribe(rcv, "amqp://~127.0.0.1:56735") == 0);
+  assert(pn_sharded_start(rcv) == 0);
+  assert(pn_sharded_start(rcv) == PN_STATE_ERR);
+  assert(pn_sharded_messenger(rcv, 0) == NULL);
+
+  pn_sharded_t *snd = pn_sharded("sharded-sender", SHARDS);
+  assert(pn_sharded_messenger(snd, SHARDS) == NULL);
+  for (int i = 0; i < SHARDS; i++) {
+    pn_messenger_set_timeout(pn_sharded_messenger(snd, i), 10000);
+  }
+  assert(pn_sharded_start(snd) == 0);
+
+  pthread_t threads[THREADS];
+  producer_t producers[THREADS];
+  for (int i = 0; i < THREADS; i++) {
+    producers[i].sharded = snd;
+    producers[i].id = i;
+    pthread_create(&threads[i], NULL, produce, &producers[i]);
+  }
+
+  // each producer's messages to an address arrive in the order put
+  int last[THREADS][ADDRESSES];
+  memset(last, -1, sizeof(last));
+  pn_message_t *msg = pn_message();
+  for (int n = 0; n < THREADS*COUNT; n++) {
+    assert(pn_sharded_get(rcv, msg, 10000) == 0);
+    pn_data_t *body = pn_message_body(msg);
+    pn_data_rewind(body);
+    assert(pn_data_next(body));
+    int value = pn_data_get_int(body);
+    int producer = value / COUNT, seq = value % COUNT;
+    int address = seq % ADDRESSES;
+    assert(seq > last[producer][address]);
+    last[producer][address] = seq;
+  }
+  assert(pn_sharded_get(rcv, msg, 0) == PN_EOS);
+
+  for (int i = 0; i < THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  assert(pn_sharded_stop(snd) == 0);
+  assert(pn_sharded_put(snd, msg) == PN_STATE_ERR);
+  assert(pn_sharded_stop(rcv) == 0);
+  assert(pn_sharded_get(rcv, msg, -1) == PN_EOS);
+
+  pn_message_free(msg);
+  pn_sharded_free(snd);
+  pn_sharded_free(rcv);
+}
+
+// a shard whose messenger is full holds messages back rather than
+// losing them
+static void test_sharded_limit()
+{
+  pn_sharded_t *rcv = pn_sharded("limited-receiver", 1);
+  assert(pn_sharded_subscribe(rcv, "amqp://~127.0.0.1:56746") == 0);
+  assert(pn_sharded_start(rcv) == 0);
+
+  pn_sharded_t *snd = pn_sharded("limited-sender", 1);
+  pn_messenger_t *messenger = pn_sharded_messenger(snd, 0);
+  pn_messenger_set_timeout(messenger, 10000);
+  assert(pn_messenger_set_outgoing_limit(messenger, 4, 0) == 0);
+  assert(pn_messenger_set_address_limit(messenger, 2, 0) == 0);
+  assert(pn_sharded_start(snd) == 0);
+
+  pn_message_t *msg = pn_message();
+  char address[64];
+  for (int i = 0; i < COUNT; i++) {
+    sprintf(address, "amqp://127.0.0.1:56746/q%d", i % ADDRESSES);
+    pn_message_set_address(msg, address);
+    pn_data_t *body = pn_message_body(msg);
+    pn_data_clear(body);
+    pn_data_put_int(body, i);
+    int err;
+    while ((err = pn_sharded_put(snd, msg)) == PN_OVERFLOW);
+    assert(!err);
+  }
+
+  bool seen[COUNT] = {false};
+  for (int n = 0; n < COUNT; n++) {
+    assert(pn_sharded_get(rcv, msg, 10000) == 0);
+    pn_data_t *body = pn_message_body(msg);
+    pn_data_rewind(body);
+    assert(pn_data_next(body));
+    int value = pn_data_get_int(body);
+    assert(value >= 0 && value < COUNT && !seen[value]);
+    seen[value] = true;
+  }
+
+  assert(pn_sharded_stop(snd) == 0);
+  assert(pn_sharded_failed(snd) == 0);
+  assert(pn_sharded_failed(NULL) == PN_ARG_ERR);
+  assert(pn_sharded_stop(rcv) == 0);
+
+  pn_message_free(msg);
+  pn_sharded_free(snd);
+  pn_sharded_free(rcv);
+}
+
+int main(int argc, char **argv)
+{
+  test_sharded();
+  test_sharded_limit();
+  return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <proton/messenger.h>
+#include <proton/message.h>
+
+#define assert(E) ((E) ? 0 : (abort(), 0))
+
+#define SIZE (4*1024*1024)
+#define CHUNK (10000)
+#define HIGH_WATER (32*1024)
+
+static void put_string(pn_messenger_t *messenger, pn_message_t *msg, const char *text)
+{
+  pn_data_t *body = pn_message_body(msg);
+  pn_data_clear(body);
+  pn_data_put_string(body, pn_bytes(strlen(text), (char *) text));
+  assert(pn_messenger_put(messenger, msg) == 0);
+}
+
+static void get_string(pn_messenger_t *messenger, pn_message_t *msg, const char *text)
+{
+  while (pn_messenger_get(messenger, msg) == PN_EOS) {
+    pn_messenger_work(messenger, 10);
+  }
+  pn_data_t *body = pn_message_body(msg);
+  pn_data_rewind(body);
+  assert(pn_data_next(body) && pn_data_type(body) == PN_STRING);
+  pn_bytes_t bytes = pn_data_get_string(body);
+  assert(bytes.size == strlen(text) && !memcmp(bytes.start, text, bytes.size));
+}
+
+static void test_stream()
+{
+  const char *address = "amqp://127.0.0.1:56739/queue";
+  pn_messenger_t *rcv = pn_messenger("stream-receiver");
+  pn_messenger_t *snd = pn_messenger("stream-sender");
+  pn_messenger_set_blocking(rcv, false);
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_set_outgoing_window(snd, 4);
+  pn_messenger_set_incoming_window(rcv, 4);
+  assert(pn_messenger_set_stream_high_water(snd, HIGH_WATER) == 0);
+  pn_messenger_start(rcv);
+  pn_messenger_start(snd);
+  assert(pn_messenger_subscribe(rcv, "amqp://~127.0.0.1:56739"));
+  pn_messenger_recv(rcv, -1);
+
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, address);
+  assert(pn_messenger_stream_write(snd, "x", 1) == PN_STATE_ERR);
+  assert(pn_messenger_stream_end(snd) == PN_STATE_ERR);
+  put_string(snd, msg, "before");
+  assert(pn_messenger_stream_begin(snd, msg, SIZE) == PN_ARG_ERR);
+
+  pn_message_t *head = pn_message();
+  pn_message_set_address(head, address);
+  pn_message_set_subject(head, "archive");
+  // non-blocking, the stream waits for earlier messages to get credit
+  int err;
+  while ((err = pn_messenger_stream_begin(snd, head, SIZE)) == PN_OVERFLOW) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+  }
+  assert(err == 0);
+  pn_tracker_t tracker = pn_messenger_outgoing_tracker(snd);
+  assert(pn_messenger_stream_begin(snd, head, SIZE) == PN_STATE_ERR);
+  // put while the stream is open, it goes after
+  put_string(snd, msg, "after");
+
+  char *chunk = (char *) malloc(CHUNK);
+  size_t written = 0;
+  int full = 0;
+  while (written < SIZE) {
+    size_t n = SIZE - written < CHUNK ? SIZE - written : CHUNK;
+    for (size_t i = 0; i < n; i++) chunk[i] = (char) ((written + i) % 251);
+    ssize_t taken = pn_messenger_stream_write(snd, chunk, n);
+    if (taken == PN_OVERFLOW) {
+      // what waits to go out stays under the high water mark
+      assert(pn_messenger_outgoing_bytes(snd) <= HIGH_WATER + 1024);
+      full++;
+      pn_messenger_work(snd, 0);
+      pn_messenger_work(rcv, 0);
+      continue;
+    }
+    assert(taken > 0 && (size_t) taken <= n);
+    written += taken;
+  }
+  assert(full > 0);
+  assert(pn_messenger_stream_write(snd, chunk, 1) == PN_ARG_ERR);
+  assert(pn_messenger_stream_end(snd) == 0);
+  free(chunk);
+
+  // in order, the streamed message whole
+  get_string(rcv, msg, "before");
+  while (pn_messenger_get(rcv, msg) == PN_EOS) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+  }
+  assert(!strcmp(pn_message_get_subject(msg), "archive"));
+  pn_data_t *body = pn_message_body(msg);
+  pn_data_rewind(body);
+  assert(pn_data_next(body) && pn_data_type(body) == PN_BINARY);
+  pn_bytes_t bytes = pn_data_get_binary(body);
+  assert(bytes.size == SIZE);
+  for (size_t i = 0; i < SIZE; i++) {
+    assert(bytes.start[i] == (char) (i % 251));
+  }
+  pn_messenger_accept(rcv, pn_messenger_incoming_tracker(rcv), 0);
+  for (int i = 0; i < 100 && pn_messenger_status(snd, tracker) != PN_STATUS_ACCEPTED; i++) {
+    pn_messenger_work(rcv, 0);
+    pn_messenger_work(snd, 10);
+  }
+  assert(pn_messenger_status(snd, tracker) == PN_STATUS_ACCEPTED);
+  get_string(rcv, msg, "after");
+
+  pn_message_free(head);
+  pn_message_free(msg);
+  pn_messenger_stop(snd);
+  pn_messenger_stop(rcv);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+}
+
+int main(int argc, char **argv)
+{
+  test_stream();
+  return 0;
+}
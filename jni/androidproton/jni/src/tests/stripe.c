@@ -0,0 +1,83 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <proton/messenger.h>
+#include <proton/message.h>
+
+#define assert(E) ((E) ? 0 : (abort(), 0))
+
+#define COUNT (40)
+#define STRIPES (4)
+
+static void test_stripes(pn_stripe_mode_t mode)
+{
+  const char *address = "amqp://127.0.0.1:56729/queue";
+  pn_messenger_t *rcv = pn_messenger("stripe-receiver");
+  pn_messenger_t *snd = pn_messenger("stripe-sender");
+  pn_messenger_set_blocking(rcv, false);
+  pn_messenger_set_blocking(snd, false);
+  assert(pn_messenger_set_stripes(snd, 0, mode) == PN_ARG_ERR);
+  assert(pn_messenger_set_stripes(snd, PN_STRIPES_MAX + 1, mode) == PN_ARG_ERR);
+  assert(pn_messenger_set_stripes(snd, STRIPES, mode) == 0);
+  pn_messenger_start(rcv);
+  pn_messenger_start(snd);
+  assert(pn_messenger_subscribe(rcv, "amqp://~127.0.0.1:56729"));
+  pn_messenger_recv(rcv, -1);
+
+  // every other message belongs to a group, numbered in put order
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, address);
+  for (int i = 0; i < COUNT; i++) {
+    pn_message_set_group_id(msg, i % 2 ? "group" : NULL);
+    pn_message_set_group_sequence(msg, i);
+    assert(pn_messenger_put(snd, msg) == 0);
+  }
+
+  int received = 0, last = -1;
+  while (received < COUNT) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+    while (pn_messenger_get(rcv, msg) == 0) {
+      received++;
+      if (pn_message_get_group_id(msg)) {
+        assert(pn_message_get_group_sequence(msg) > last);
+        last = pn_message_get_group_sequence(msg);
+      }
+    }
+  }
+  assert(last == COUNT - 1);
+
+  pn_message_free(msg);
+  pn_messenger_stop(snd);
+  pn_messenger_stop(rcv);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+}
+
+int main(int argc, char **argv)
+{
+  test_stripes(PN_STRIPE_ROUND_ROBIN);
+  test_stripes(PN_STRIPE_LEAST_BYTES);
+  return 0;
+}
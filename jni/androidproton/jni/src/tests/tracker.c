@@ -0,0 +1,183 @@
+/*
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <proton/messenger.h>
+#include <proton/message.h>
+
+#define assert(E) ((E) ? 0 : (abort(), 0))
+
+#define COUNT (10)
+
+typedef struct {
+  int calls;
+  int accepted;
+  int rejected;
+  pn_tracker_t last;
+} outcomes_t;
+
+static void tracked(pn_messenger_t *messenger, pn_tracker_t tracker,
+                    pn_status_t status, void *context)
+{
+  outcomes_t *outcomes = (outcomes_t *) context;
+  assert(pn_messenger_status(messenger, tracker) == status);
+  outcomes->calls++;
+  outcomes->last = tracker;
+  if (status == PN_STATUS_ACCEPTED) outcomes->accepted++;
+  if (status == PN_STATUS_REJECTED) outcomes->rejected++;
+  pn_messenger_settle(messenger, tracker, 0);
+}
+
+static void test_tracker_callback()
+{
+  const char *address = "amqp://127.0.0.1:56721/queue";
+  pn_messenger_t *rcv = pn_messenger("tracker-receiver");
+  pn_messenger_t *snd = pn_messenger("tracker-sender");
+  pn_messenger_set_blocking(rcv, false);
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_set_incoming_window(rcv, COUNT);
+  pn_messenger_set_outgoing_window(snd, COUNT);
+  assert(pn_messenger_set_tracker_callback(NULL, tracked, NULL) == PN_ARG_ERR);
+  outcomes_t outcomes = {0, 0, 0, 0};
+  assert(pn_messenger_set_tracker_callback(snd, tracked, &outcomes) == 0);
+  pn_messenger_start(rcv);
+  pn_messenger_start(snd);
+  assert(pn_messenger_subscribe(rcv, "amqp://~127.0.0.1:56721"));
+  pn_messenger_recv(rcv, COUNT);
+
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, address);
+  for (int i = 0; i < COUNT; i++) {
+    assert(pn_messenger_put(snd, msg) == 0);
+  }
+
+  // accept the even messages and reject the odd ones
+  int received = 0;
+  while (received < COUNT) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+    while (pn_messenger_get(rcv, msg) == 0) {
+      pn_tracker_t tracker = pn_messenger_incoming_tracker(rcv);
+      if (received++ % 2) {
+        pn_messenger_reject(rcv, tracker, 0);
+      } else {
+        pn_messenger_accept(rcv, tracker, 0);
+      }
+    }
+  }
+
+  while (outcomes.calls < COUNT) {
+    pn_messenger_work(rcv, 0);
+    pn_messenger_work(snd, 10);
+  }
+  assert(outcomes.accepted == COUNT/2 && outcomes.rejected == COUNT/2);
+  // settled from the callback, nothing left to report
+  assert(pn_messenger_status(snd, outcomes.last) == PN_STATUS_UNKNOWN);
+
+  pn_message_free(msg);
+  pn_messenger_stop(snd);
+  pn_messenger_stop(rcv);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+}
+
+typedef struct {
+  pn_tracker_t trackers[COUNT];
+  int seen[COUNT];
+  int calls;
+  bool nested;
+} reentry_t;
+
+// works the messenger from inside the callback, as a put to a full
+// blocking queue would
+static void reentered(pn_messenger_t *messenger, pn_tracker_t tracker,
+                      pn_status_t status, void *context)
+{
+  reentry_t *reentry = (reentry_t *) context;
+  reentry->calls++;
+  for (int i = 0; i < COUNT; i++) {
+    if (reentry->trackers[i] == tracker) reentry->seen[i]++;
+  }
+  pn_messenger_settle(messenger, tracker, 0);
+  if (!reentry->nested) {
+    reentry->nested = true;
+    pn_messenger_work(messenger, 0);
+    reentry->nested = false;
+  }
+}
+
+static void test_reentrant_callback()
+{
+  const char *address = "amqp://127.0.0.1:56743/queue";
+  pn_messenger_t *rcv = pn_messenger("reentry-receiver");
+  pn_messenger_t *snd = pn_messenger("reentry-sender");
+  pn_messenger_set_blocking(rcv, false);
+  pn_messenger_set_blocking(snd, false);
+  pn_messenger_set_incoming_window(rcv, COUNT);
+  pn_messenger_set_outgoing_window(snd, COUNT);
+  reentry_t reentry;
+  memset(&reentry, 0, sizeof(reentry));
+  assert(pn_messenger_set_tracker_callback(snd, reentered, &reentry) == 0);
+  pn_messenger_start(rcv);
+  pn_messenger_start(snd);
+  assert(pn_messenger_subscribe(rcv, "amqp://~127.0.0.1:56743"));
+  pn_messenger_recv(rcv, COUNT);
+
+  pn_message_t *msg = pn_message();
+  pn_message_set_address(msg, address);
+  for (int i = 0; i < COUNT; i++) {
+    assert(pn_messenger_put(snd, msg) == 0);
+    reentry.trackers[i] = pn_messenger_outgoing_tracker(snd);
+  }
+
+  // all the outcomes reach the sender together
+  int received = 0;
+  while (received < COUNT) {
+    pn_messenger_work(snd, 0);
+    pn_messenger_work(rcv, 10);
+    while (pn_messenger_get(rcv, msg) == 0) received++;
+  }
+  pn_messenger_accept(rcv, pn_messenger_incoming_tracker(rcv), PN_CUMULATIVE);
+  for (int i = 0; i < 100 && reentry.calls < COUNT; i++) {
+    pn_messenger_work(rcv, 0);
+    pn_messenger_work(snd, 10);
+  }
+  // each one once, nested or not
+  assert(reentry.calls == COUNT);
+  for (int i = 0; i < COUNT; i++) {
+    assert(reentry.seen[i] == 1);
+  }
+
+  pn_message_free(msg);
+  pn_messenger_stop(snd);
+  pn_messenger_stop(rcv);
+  pn_messenger_free(snd);
+  pn_messenger_free(rcv);
+}
+
+int main(int argc, char **argv)
+{
+  test_tracker_callback();
+  test_reentrant_callback();
+  return 0;
+}
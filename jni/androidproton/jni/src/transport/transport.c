@@ -40,7 +40,7 @@ static ssize_t transport_consume(pn_transport_t *transport);
 
 void pn_delivery_map_init(pn_delivery_map_t *db, pn_sequence_t next)
 {
-  db->deliveries = pn_hash(1024, 0.75, PN_REFCOUNT);
+  db->deliveries = pn_hash(0, 0.75, PN_REFCOUNT);
   db->next = next;
 }
 
@@ -115,6 +115,7 @@ void pn_transport_init(pn_transport_t *transport)
   transport->header_count = 0;
   transport->sasl = NULL;
   transport->ssl = NULL;
+  transport->sendfile = false;
   transport->scratch = pn_string(NULL);
   transport->disp = pn_dispatcher(0, transport);
 
@@ -154,6 +155,7 @@ void pn_transport_init(pn_transport_t *transport)
   transport->close_sent = false;
   transport->close_rcvd = false;
   transport->tail_closed = false;
+  transport->reprocess = false;
   transport->remote_container = NULL;
   transport->remote_hostname = NULL;
   transport->local_max_frame = PN_DEFAULT_MAX_FRAME_SIZE;
@@ -164,10 +166,10 @@ void pn_transport_init(pn_transport_t *transport)
   transport->remote_idle_timeout = 0;
   transport->keepalive_deadline = 0;
   transport->last_bytes_output = 0;
-  transport->remote_offered_capabilities = pn_data(16);
-  transport->remote_desired_capabilities = pn_data(16);
-  transport->remote_properties = pn_data(16);
-  transport->disp_data = pn_data(16);
+  transport->remote_offered_capabilities = pn_data(0);
+  transport->remote_desired_capabilities = pn_data(0);
+  transport->remote_properties = pn_data(0);
+  transport->disp_data = pn_data(0);
   transport->error = pn_error();
   pn_condition_init(&transport->remote_condition);
 
@@ -176,6 +178,10 @@ void pn_transport_init(pn_transport_t *transport)
 
   transport->bytes_input = 0;
   transport->bytes_output = 0;
+  transport->process_start = 0;
+  transport->idle_bytes_input = 0;
+  transport->idle_bytes_output = 0;
+  transport->idle_polls = 0;
 
   transport->input_pending = 0;
   transport->output_pending = 0;
@@ -202,19 +208,11 @@ pn_transport_t *pn_transport()
 {
   pn_transport_t *transport = (pn_transport_t *) malloc(sizeof(pn_transport_t));
   if (!transport) return NULL;
-  transport->output_size = PN_DEFAULT_MAX_FRAME_SIZE ? PN_DEFAULT_MAX_FRAME_SIZE : 16 * 1024;
-  transport->output_buf = (char *) malloc(transport->output_size);
-  if (!transport->output_buf) {
-    free(transport);
-    return NULL;
-  }
-  transport->input_size =  PN_DEFAULT_MAX_FRAME_SIZE ? PN_DEFAULT_MAX_FRAME_SIZE : 16 * 1024;
-  transport->input_buf = (char *) malloc(transport->input_size);
-  if (!transport->input_buf) {
-    free(transport->output_buf);
-    free(transport);
-    return NULL;
-  }
+  // the io buffers themselves are allocated on first use
+  transport->output_size = PN_TRANSPORT_BUFFER_SIZE;
+  transport->output_buf = NULL;
+  transport->input_size = PN_TRANSPORT_BUFFER_SIZE;
+  transport->input_buf = NULL;
 
   transport->connection = NULL;
   pn_transport_init(transport);
@@ -253,6 +251,7 @@ int pn_transport_bind(pn_transport_t *transport, pn_connection_t *connection)
   connection->transport = transport;
   if (transport->open_rcvd) {
     PN_SET_REMOTE(connection->endpoint.state, PN_REMOTE_ACTIVE);
+    pn_collector_put(connection->collector, PN_CONNECTION_STATE, connection);
     if (!pn_error_code(transport->error)) {
       transport->disp->halt = false;
       transport_consume(transport);        // blech - testBindAfterOpen
@@ -267,6 +266,7 @@ int pn_transport_unbind(pn_transport_t *transport)
   if (!transport->connection) return 0;
 
   pn_connection_t *conn = transport->connection;
+  pn_collector_purge(conn->collector, transport);
   transport->connection = NULL;
   conn->transport = NULL;
 
@@ -280,7 +280,7 @@ int pn_transport_unbind(pn_transport_t *transport)
   pn_endpoint_t *endpoint = conn->endpoint_head;
   while (endpoint) {
     pn_condition_clear(&endpoint->remote_condition);
-    pn_modified(conn, endpoint);
+    pn_modified(conn, endpoint, false);
     endpoint = endpoint->endpoint_next;
   }
 
@@ -367,7 +367,7 @@ int pn_post_close(pn_transport_t *transport, const char *condition)
     info = pn_condition_info(cond);
   }
 
-  return pn_post_frame(transport->disp, 0, "DL[?DL[sSC]]", CLOSE,
+  return pn_post_frame(transport->disp, 0, CLOSE, "DL[?DL[sSC]]", CLOSE,
                        (bool) condition, ERROR, condition, description, info);
 }
 
@@ -418,8 +418,6 @@ int pn_do_open(pn_dispatcher_t *disp)
       transport->remote_max_frame = AMQP_MIN_MAX_FRAME_SIZE;
     }
     disp->remote_max_frame = transport->remote_max_frame;
-    pn_buffer_clear( disp->frame );
-    pn_buffer_ensure( disp->frame, disp->remote_max_frame );
   }
   if (container_q) {
     transport->remote_container = pn_bytes_strdup(remote_container);
@@ -433,6 +431,7 @@ int pn_do_open(pn_dispatcher_t *disp)
   }
   if (conn) {
     PN_SET_REMOTE(conn->endpoint.state, PN_REMOTE_ACTIVE);
+    pn_collector_put(conn->collector, PN_CONNECTION_STATE, conn);
   } else {
     transport->disp->halt = true;
   }
@@ -461,6 +460,7 @@ int pn_do_begin(pn_dispatcher_t *disp)
   ssn->state.incoming_transfer_count = next;
   pn_map_channel(transport, disp->channel, ssn);
   PN_SET_REMOTE(ssn->endpoint.state, PN_REMOTE_ACTIVE);
+  pn_collector_put(transport->connection->collector, PN_SESSION_STATE, ssn);
 
   return 0;
 }
@@ -631,6 +631,8 @@ int pn_do_attach(pn_dispatcher_t *disp)
     link->state.delivery_count = idc;
   }
 
+  pn_collector_put(transport->connection->collector, PN_LINK_STATE, link);
+
   return 0;
 }
 
@@ -689,6 +691,8 @@ int pn_do_transfer(pn_dispatcher_t *disp)
       return err;
     }
 
+    link->stats.deliveries_received++;
+    ssn->stats.deliveries_received++;
     link->state.delivery_count++;
     link->state.link_credit--;
     link->queued++;
@@ -708,6 +712,8 @@ int pn_do_transfer(pn_dispatcher_t *disp)
   ssn->state.incoming_transfer_count++;
   ssn->state.incoming_window--;
 
+  pn_collector_put(transport->connection->collector, PN_DELIVERY, delivery);
+
   // XXX: need better policy for when to refresh window
   if (!ssn->state.incoming_window && (int32_t) link->state.local_handle >= 0) {
     pn_post_flow(transport, ssn, link);
@@ -716,6 +722,22 @@ int pn_do_transfer(pn_dispatcher_t *disp)
   return 0;
 }
 
+static void pn_stall_begin(uint64_t *start, uint64_t *count)
+{
+  if (!*start) {
+    *start = pn_i_micros();
+    (*count)++;
+  }
+}
+
+static void pn_stall_end(uint64_t *start, uint64_t *total)
+{
+  if (*start) {
+    *total += pn_i_micros() - *start;
+    *start = 0;
+  }
+}
+
 int pn_do_flow(pn_dispatcher_t *disp)
 {
   pn_transport_t *transport = disp->transport;
@@ -735,6 +757,9 @@ int pn_do_flow(pn_dispatcher_t *disp)
   } else {
     ssn->state.remote_incoming_window = iwin;
   }
+  if (ssn->state.remote_incoming_window > 0) {
+    pn_stall_end(&ssn->window_stall_start, &ssn->stats.window_stall_time);
+  }
 
   if (handle_init) {
     pn_link_t *link = pn_handle_state(ssn, handle);
@@ -750,8 +775,12 @@ int pn_do_flow(pn_dispatcher_t *disp)
       link->state.link_credit = receiver_count + link_credit - link->state.delivery_count;
       link->credit += link->state.link_credit - old;
       link->drain = drain;
+      if (link->state.link_credit > 0) {
+        pn_stall_end(&link->credit_stall_start, &link->stats.credit_stall_time);
+      }
       pn_delivery_t *delivery = pn_link_current(link);
       if (delivery) pn_work_update(transport->connection, delivery);
+      pn_collector_put(transport->connection->collector, PN_LINK_FLOW, link);
     } else {
       pn_sequence_t delta = delivery_count - link->state.delivery_count;
       if (delta > 0) {
@@ -759,6 +788,7 @@ int pn_do_flow(pn_dispatcher_t *disp)
         link->state.link_credit -= delta;
         link->credit -= delta;
         link->drained += delta;
+        pn_collector_put(transport->connection->collector, PN_LINK_FLOW, link);
       }
     }
   }
@@ -854,6 +884,7 @@ int pn_do_disposition(pn_dispatcher_t *disp)
       remote->settled = settled;
       delivery->updated = true;
       pn_work_update(transport->connection, delivery);
+      pn_collector_put(transport->connection->collector, PN_DELIVERY, delivery);
     }
   }
 
@@ -882,6 +913,7 @@ int pn_do_detach(pn_dispatcher_t *disp)
   if (closed)
   {
     PN_SET_REMOTE(link->endpoint.state, PN_REMOTE_CLOSED);
+    pn_collector_put(transport->connection->collector, PN_LINK_STATE, link);
   } else {
     // TODO: implement
   }
@@ -897,6 +929,7 @@ int pn_do_end(pn_dispatcher_t *disp)
   if (err) return err;
   pn_unmap_channel(transport, ssn);
   PN_SET_REMOTE(ssn->endpoint.state, PN_REMOTE_CLOSED);
+  pn_collector_put(transport->connection->collector, PN_SESSION_STATE, ssn);
   return 0;
 }
 
@@ -908,6 +941,7 @@ int pn_do_close(pn_dispatcher_t *disp)
   if (err) return err;
   transport->close_rcvd = true;
   PN_SET_REMOTE(conn->endpoint.state, PN_REMOTE_CLOSED);
+  pn_collector_put(conn->collector, PN_CONNECTION_STATE, conn);
   return 0;
 }
 
@@ -1063,7 +1097,7 @@ static pn_timestamp_t pn_tick_amqp(pn_io_layer_t *io_layer, pn_timestamp_t now)
       transport->keepalive_deadline = now + (pn_timestamp_t)(transport->remote_idle_timeout/2.0);
       if (transport->disp->available == 0) {    // no outbound data pending
         // so send empty frame (and account for it!)
-        pn_post_frame(transport->disp, 0, "");
+        pn_post_frame(transport->disp, 0, 0, "");
         transport->last_bytes_output += transport->disp->available;
       }
     }
@@ -1080,7 +1114,7 @@ int pn_process_conn_setup(pn_transport_t *transport, pn_endpoint_t *endpoint)
     if (!(endpoint->state & PN_LOCAL_UNINIT) && !transport->open_sent)
     {
       pn_connection_t *connection = (pn_connection_t *) endpoint;
-      int err = pn_post_frame(transport->disp, 0, "DL[SS?In?InnCCC]", OPEN,
+      int err = pn_post_frame(transport->disp, 0, OPEN, "DL[SS?In?InnCCC]", OPEN,
                               pn_string_get(connection->container),
                               pn_string_get(connection->hostname),
                               // if not zero, advertise our max frame size and idle timeout
@@ -1144,7 +1178,7 @@ int pn_process_ssn_setup(pn_transport_t *transport, pn_endpoint_t *endpoint)
       uint16_t channel = allocate_alias(transport->local_channels);
       state->incoming_window = pn_session_incoming_window(ssn);
       state->outgoing_window = pn_session_outgoing_window(ssn);
-      pn_post_frame(transport->disp, channel, "DL[?HIII]", BEGIN,
+      pn_post_frame(transport->disp, channel, BEGIN, "DL[?HIII]", BEGIN,
                     ((int16_t) state->remote_channel >= 0), state->remote_channel,
                     state->outgoing_transfer_count,
                     state->incoming_window,
@@ -1187,7 +1221,7 @@ int pn_process_link_setup(pn_transport_t *transport, pn_endpoint_t *endpoint)
       state->local_handle = allocate_alias(ssn_state->local_handles);
       pn_hash_put(ssn_state->local_handles, state->local_handle, link);
       const pn_distribution_mode_t dist_mode = link->source.distribution_mode;
-      int err = pn_post_frame(transport->disp, ssn_state->local_channel,
+      int err = pn_post_frame(transport->disp, ssn_state->local_channel, ATTACH,
                               "DL[SIoBB?DL[SIsIoC?sCnCC]?DL[SIsIoCC]nnI]", ATTACH,
                               pn_string_get(link->name),
                               state->local_handle,
@@ -1227,7 +1261,7 @@ int pn_post_flow(pn_transport_t *transport, pn_session_t *ssn, pn_link_t *link)
   ssn->state.outgoing_window = pn_session_outgoing_window(ssn);
   bool linkq = (bool) link;
   pn_link_state_t *state = &link->state;
-  return pn_post_frame(transport->disp, ssn->state.local_channel, "DL[?IIII?I?I?In?o]", FLOW,
+  return pn_post_frame(transport->disp, ssn->state.local_channel, FLOW, "DL[?IIII?I?I?In?o]", FLOW,
                        (int16_t) ssn->state.remote_channel >= 0, ssn->state.incoming_transfer_count,
                        ssn->state.incoming_window,
                        ssn->state.outgoing_transfer_count,
@@ -1261,7 +1295,7 @@ int pn_flush_disp(pn_transport_t *transport, pn_session_t *ssn)
   uint64_t code = ssn->state.disp_code;
   bool settled = ssn->state.disp_settled;
   if (ssn->state.disp) {
-    int err = pn_post_frame(transport->disp, ssn->state.local_channel, "DL[oIIo?DL[]]", DISPOSITION,
+    int err = pn_post_frame(transport->disp, ssn->state.local_channel, DISPOSITION, "DL[oIIo?DL[]]", DISPOSITION,
                             ssn->state.disp_type, ssn->state.disp_first, ssn->state.disp_last,
                             settled, (bool)code, code);
     if (err) return err;
@@ -1280,7 +1314,7 @@ int pn_post_disp(pn_transport_t *transport, pn_delivery_t *delivery)
   pn_link_t *link = delivery->link;
   pn_session_t *ssn = link->session;
   pn_session_state_t *ssn_state = &ssn->state;
-  pn_modified(transport->connection, &link->session->endpoint);
+  pn_modified(transport->connection, &link->session->endpoint, false);
   pn_delivery_state_t *state = &delivery->state;
   assert(state->init);
   bool role = (link->endpoint.type == RECEIVER);
@@ -1293,7 +1327,7 @@ int pn_post_disp(pn_transport_t *transport, pn_delivery_t *delivery)
   if (!pni_disposition_batchable(&delivery->local)) {
     pn_data_clear(transport->disp_data);
     pni_disposition_encode(&delivery->local, transport->disp_data);
-    return pn_post_frame(transport->disp, ssn->state.local_channel,
+    return pn_post_frame(transport->disp, ssn->state.local_channel, DISPOSITION,
                          "DL[oIIo?DLC]", DISPOSITION,
                          role, state->id, state->id, delivery->local.settled,
                          (bool)code, code, transport->disp_data);
@@ -1334,37 +1368,81 @@ int pn_process_tpwork_sender(pn_transport_t *transport, pn_delivery_t *delivery)
   bool xfr_posted = false;
   if ((int16_t) ssn_state->local_channel >= 0 && (int32_t) link_state->local_handle >= 0) {
     pn_delivery_state_t *state = &delivery->state;
-    if (!state->sent && (delivery->done || pn_buffer_size(delivery->bytes) > 0) &&
-        ssn_state->remote_incoming_window > 0 && link_state->link_credit > 0) {
+    bool ready = !state->sent && (delivery->done || pn_buffer_size(delivery->bytes) > 0 ||
+                                  delivery->file_size > 0);
+    if (ready && !ssn_state->remote_incoming_window) {
+      pn_stall_begin(&link->session->window_stall_start, &link->session->stats.window_stalls);
+    }
+    if (ready && link_state->link_credit <= 0) {
+      pn_stall_begin(&link->credit_stall_start, &link->stats.credit_stalls);
+    }
+    // a link with a high water mark waits for the frames already
+    // written to go out, rather than have the whole of a large
+    // delivery moved into the output buffer
+    bool held = link->high_water && transport->disp->available >= link->high_water;
+    if (ready && !held && ssn_state->remote_incoming_window > 0 && link_state->link_credit > 0) {
       if (!state->init) {
         state = pn_delivery_map_push(&ssn_state->outgoing, delivery);
       }
 
+      pn_bytes_t tag = pn_delivery_tag_bytes(delivery);
       pn_bytes_t bytes = pn_buffer_bytes(delivery->bytes);
-      pn_set_payload(transport->disp, bytes.start, bytes.size);
-      pn_bytes_t tag = pn_buffer_bytes(delivery->tag);
-      int count = pn_post_transfer_frame(transport->disp,
-                                         ssn_state->local_channel,
-                                         link_state->local_handle,
-                                         state->id, &tag,
-                                         0, // message-format
-                                         delivery->local.settled,
-                                         !delivery->done,
-                                         ssn_state->remote_incoming_window);
-      if (count < 0) return count;
-      xfr_posted = true;
-      ssn_state->outgoing_transfer_count += count;
-      ssn_state->remote_incoming_window -= count;
-
-      int sent = bytes.size - transport->disp->output_size;
-      pn_buffer_trim(delivery->bytes, sent, 0);
-      link->session->outgoing_bytes -= sent;
-      if (!pn_buffer_size(delivery->bytes) && delivery->done) {
+      if (bytes.size || !delivery->file_size) {
+        pn_set_payload(transport->disp, bytes.start, bytes.size);
+        int count = pn_post_transfer_frame(transport->disp,
+                                           ssn_state->local_channel,
+                                           link_state->local_handle,
+                                           state->id, &tag,
+                                           0, // message-format
+                                           delivery->local.settled,
+                                           !delivery->done || delivery->file_size,
+                                           ssn_state->remote_incoming_window);
+        if (count < 0) return count;
+        xfr_posted = true;
+        ssn_state->outgoing_transfer_count += count;
+        ssn_state->remote_incoming_window -= count;
+
+        int sent = bytes.size - transport->disp->output_size;
+        pn_buffer_trim(delivery->bytes, sent, 0);
+        link->session->outgoing_bytes -= sent;
+      }
+
+      // a file region follows the buffered bytes, and is only read, or
+      // handed to sendfile, as the frames carrying it are written out
+      if (!pn_buffer_size(delivery->bytes) && delivery->file_size &&
+          ssn_state->remote_incoming_window > 0) {
+        size_t posted;
+        int count = pn_post_transfer_file(transport->disp,
+                                          ssn_state->local_channel,
+                                          link_state->local_handle,
+                                          state->id, &tag,
+                                          0, // message-format
+                                          delivery->local.settled,
+                                          !delivery->done,
+                                          delivery->file,
+                                          delivery->file_offset,
+                                          delivery->file_size,
+                                          &posted,
+                                          ssn_state->remote_incoming_window);
+        if (count < 0) return count;
+        xfr_posted = true;
+        ssn_state->outgoing_transfer_count += count;
+        ssn_state->remote_incoming_window -= count;
+
+        delivery->file_offset += posted;
+        delivery->file_size -= posted;
+        link->session->outgoing_bytes -= posted;
+      }
+
+      if (!delivery->transferred) delivery->transferred = transport->process_start;
+      if (!pn_buffer_size(delivery->bytes) && !delivery->file_size && delivery->done) {
         state->sent = true;
         link_state->delivery_count++;
         link_state->link_credit--;
         link->queued--;
         link->session->outgoing_deliveries--;
+        link->stats.deliveries_sent++;
+        link->session->stats.deliveries_sent++;
       }
     }
   }
@@ -1499,7 +1577,7 @@ int pn_process_link_teardown(pn_transport_t *transport, pn_endpoint_t *endpoint)
         info = pn_condition_info(&endpoint->condition);
       }
 
-      int err = pn_post_frame(transport->disp, ssn_state->local_channel, "DL[Io?DL[sSC]]", DETACH,
+      int err = pn_post_frame(transport->disp, ssn_state->local_channel, DETACH, "DL[Io?DL[sSC]]", DETACH,
                               state->local_handle, true, (bool) name, ERROR, name, description, info);
       if (err) return err;
       state->local_handle = -2;
@@ -1555,7 +1633,7 @@ int pn_process_ssn_teardown(pn_transport_t *transport, pn_endpoint_t *endpoint)
         info = pn_condition_info(&endpoint->condition);
       }
 
-      int err = pn_post_frame(transport->disp, state->local_channel, "DL[?DL[sSC]]", END,
+      int err = pn_post_frame(transport->disp, state->local_channel, END, "DL[?DL[sSC]]", END,
                               (bool) name, ERROR, name, description, info);
       if (err) return err;
       state->local_channel = -2;
@@ -1618,7 +1696,7 @@ int pn_process(pn_transport_t *transport)
   if ((err = pn_phase(transport, pn_process_conn_teardown))) return err;
 
   if (transport->connection->tpwork_head) {
-    pn_modified(transport->connection, &transport->connection->endpoint);
+    pn_modified(transport->connection, &transport->connection->endpoint, false);
   }
 
   return 0;
@@ -1648,6 +1726,13 @@ static ssize_t pn_output_write_amqp_header(pn_io_layer_t *io_layer, char *bytes,
                                 pn_output_write_amqp);
 }
 
+// file payloads go to the socket directly only when nothing below the
+// amqp layer transforms the output
+static bool pni_transport_sendfile(pn_transport_t *transport)
+{
+  return transport->sendfile && !transport->ssl;
+}
+
 static ssize_t pn_output_write_amqp(pn_io_layer_t *io_layer, char *bytes, size_t size)
 {
   pn_transport_t *transport = (pn_transport_t *)io_layer->context;
@@ -1656,23 +1741,68 @@ static ssize_t pn_output_write_amqp(pn_io_layer_t *io_layer, char *bytes, size_t
   }
 
   if (!pn_error_code(transport->error)) {
+    pn_connection_stats_t *stats = &transport->connection->stats;
+    uint64_t start = pn_i_micros();
+    transport->process_start = start;
     pn_error_set(transport->error, pn_process(transport), "process error");
+    stats->process_time += pn_i_micros() - start;
+    stats->process_count++;
   }
 
-  if (!transport->disp->available && (transport->close_sent || pn_error_code(transport->error))) {
+  if (!transport->disp->available) {
     if (pn_error_code(transport->error))
       return pn_error_code(transport->error);
-    else
+    else if (transport->close_sent && !transport->disp->files_head)
       return PN_EOS;
   }
 
-  return pn_dispatcher_output(transport->disp, bytes, size);
+  ssize_t n = pn_dispatcher_output(transport->disp, bytes, size);
+  // a file payload that is due is copied in, unless the driver takes it
+  // straight from the file, see pn_transport_head_file
+  if (!n && pn_dispatcher_file(transport->disp) && !pni_transport_sendfile(transport)) {
+    n = pn_dispatcher_read_file(transport->disp, bytes, size);
+    if (n < 0) {
+      return pn_error_format(transport->error, PN_ERR, "unable to read file payload");
+    }
+  }
+  return n;
+}
+
+// give back the io buffers of an idle transport, they are allocated
+// again as soon as there is traffic
+static void pni_transport_release(pn_transport_t *transport)
+{
+  if (!transport->input_pending && transport->input_buf) {
+    free(transport->input_buf);
+    transport->input_buf = NULL;
+    transport->input_size = PN_TRANSPORT_BUFFER_SIZE;
+  }
+  if (!transport->output_pending && transport->output_buf) {
+    free(transport->output_buf);
+    transport->output_buf = NULL;
+    transport->output_size = PN_TRANSPORT_BUFFER_SIZE;
+  }
+  pn_dispatcher_release(transport->disp);
 }
 
+#define PN_TRANSPORT_PROBE_SIZE (64)
+#define PN_TRANSPORT_IDLE_POLLS (8)
+
 // generate outbound data, return amount of pending output else error
 static ssize_t transport_produce(pn_transport_t *transport)
 {
   pn_io_layer_t *io_layer = transport->io_layers;
+
+  // a layer that held input back until local state caught up, e.g. a
+  // server sasl layer waiting for pn_sasl_done while the client has
+  // already pipelined its AMQP frames, gets another look at it
+  if (transport->reprocess) {
+    transport->reprocess = false;
+    if (transport->input_pending && !transport->tail_closed) {
+      pn_transport_process(transport, 0);
+    }
+  }
+
   ssize_t space = transport->output_size - transport->output_pending;
 
   if (space == 0) {     // can we expand the buffer?
@@ -1694,10 +1824,20 @@ static ssize_t transport_produce(pn_transport_t *transport)
   }
 
   while (space > 0) {
+    // while the buffer is released output goes to a small probe first,
+    // so that polling an idle transport does not allocate
+    char probe[PN_TRANSPORT_PROBE_SIZE];
+    char *dst = transport->output_buf ? &transport->output_buf[transport->output_pending] : probe;
     ssize_t n;
-    n = io_layer->process_output( io_layer,
-                                  &transport->output_buf[transport->output_pending],
-                                  space );
+    n = io_layer->process_output( io_layer, dst,
+                                  transport->output_buf ? space : PN_TRANSPORT_PROBE_SIZE );
+    if (n > 0 && !transport->output_buf) {
+      transport->output_buf = (char *) malloc(transport->output_size);
+      if (!transport->output_buf) {
+        return pn_error_format(transport->error, PN_ERR, "unable to allocate output buffer");
+      }
+      memmove(transport->output_buf, probe, n);
+    }
     if (n > 0) {
       space -= n;
       transport->output_pending += n;
@@ -1716,6 +1856,28 @@ static ssize_t transport_produce(pn_transport_t *transport)
       return n;
     }
   }
+
+  pn_connection_t *connection = transport->connection;
+  if (connection && transport->output_pending > connection->stats.output_high_water) {
+    connection->stats.output_high_water = transport->output_pending;
+  }
+
+  // release the buffers once nothing has moved in either direction
+  // for a number of calls in a row, so that a busy transport does not
+  // churn the allocator between frames
+  if (!transport->output_pending && !transport->input_pending &&
+      transport->bytes_input == transport->idle_bytes_input &&
+      transport->bytes_output == transport->idle_bytes_output) {
+    if (transport->idle_polls < PN_TRANSPORT_IDLE_POLLS &&
+        ++transport->idle_polls == PN_TRANSPORT_IDLE_POLLS) {
+      pni_transport_release(transport);
+    }
+  } else {
+    transport->idle_polls = 0;
+  }
+  transport->idle_bytes_input = transport->bytes_input;
+  transport->idle_bytes_output = transport->bytes_output;
+
   return transport->output_pending;
 }
 
@@ -1899,6 +2061,10 @@ ssize_t pn_transport_capacity(pn_transport_t *transport)  /* <0 == done */
 
 char *pn_transport_tail(pn_transport_t *transport)
 {
+  if (transport && !transport->input_buf) {
+    transport->input_buf = (char *) malloc(transport->input_size);
+    if (!transport->input_buf) return NULL;
+  }
   if (transport && transport->input_pending < transport->input_size) {
     return &transport->input_buf[transport->input_pending];
   }
@@ -1930,6 +2096,11 @@ int pn_transport_process(pn_transport_t *transport, size_t size)
   transport->input_pending += size;
   transport->bytes_input += size;
 
+  pn_connection_t *connection = transport->connection;
+  if (connection && transport->input_pending > connection->stats.input_high_water) {
+    connection->stats.input_high_water = transport->input_pending;
+  }
+
   ssize_t n = transport_consume( transport );
   if (n == PN_EOS) {
     transport->tail_closed = true;
@@ -1996,6 +2167,32 @@ void pn_transport_pop(pn_transport_t *transport, size_t size)
   }
 }
 
+void pn_transport_set_sendfile(pn_transport_t *transport, bool sendfile)
+{
+  assert(transport);
+  transport->sendfile = sendfile;
+}
+
+ssize_t pn_transport_head_file(pn_transport_t *transport, int *fd, off_t *offset)
+{
+  if (!transport || transport->output_pending || !pni_transport_sendfile(transport)) {
+    return 0;
+  }
+  pn_file_segment_t *segment = pn_dispatcher_file(transport->disp);
+  if (!segment) return 0;
+  *fd = segment->fd;
+  *offset = segment->offset;
+  return segment->size;
+}
+
+void pn_transport_pop_file(pn_transport_t *transport, size_t size)
+{
+  if (transport && size) {
+    pn_dispatcher_pop_file(transport->disp, size);
+    transport->bytes_output += size;
+  }
+}
+
 int pn_transport_close_head(pn_transport_t *transport)
 {
   return 0;
@@ -2008,6 +2205,7 @@ bool pn_transport_quiesced(pn_transport_t *transport)
   ssize_t pending = pn_transport_pending(transport);
   if (pending < 0) return true; // output done
   else if (pending > 0) return false;
+  if (transport->disp->files_head) return false;
   // no pending at transport, but check if data is buffered in I/O layers
   pn_io_layer_t *io_layer = transport->io_layers;
   while (io_layer != &transport->io_layers[PN_IO_LAYER_CT]) {
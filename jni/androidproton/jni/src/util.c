@@ -206,6 +206,69 @@ char *pn_strndup(const char *src, size_t n)
   }
 }
 
+uint32_t pn_strhash(const char *str)
+{
+  uint32_t hash = 2166136261u;
+  while (*str) {
+    hash ^= (unsigned char) *str++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// the first 16 buckets count one value each, after that each power of
+// two is split 16 ways
+static int pn_histogram_bucket(uint64_t value)
+{
+  if (value < 16) return (int) value;
+  int magnitude = 63 - __builtin_clzll(value);
+  if (magnitude > 35) return PN_HISTOGRAM_BUCKETS - 1;
+  return (magnitude - 3)*16 + (int) ((value >> (magnitude - 4)) & 15);
+}
+
+uint64_t pn_histogram_bucket_value(int bucket)
+{
+  if (bucket < 16) return bucket < 0 ? 0 : (uint64_t) bucket;
+  if (bucket >= PN_HISTOGRAM_BUCKETS) bucket = PN_HISTOGRAM_BUCKETS - 1;
+  return (uint64_t) (16 + bucket % 16) << (bucket/16 - 1);
+}
+
+void pn_histogram_record(pn_histogram_t *histogram, uint64_t value)
+{
+  if (!histogram->count || value < histogram->min) histogram->min = value;
+  if (value > histogram->max) histogram->max = value;
+  histogram->count++;
+  histogram->total += value;
+  histogram->buckets[pn_histogram_bucket(value)]++;
+}
+
+void pn_histogram_merge(pn_histogram_t *histogram, const pn_histogram_t *other)
+{
+  if (!other->count) return;
+  if (!histogram->count || other->min < histogram->min) histogram->min = other->min;
+  if (other->max > histogram->max) histogram->max = other->max;
+  histogram->count += other->count;
+  histogram->total += other->total;
+  for (int i = 0; i < PN_HISTOGRAM_BUCKETS; i++) {
+    histogram->buckets[i] += other->buckets[i];
+  }
+}
+
+uint64_t pn_histogram_percentile(const pn_histogram_t *histogram, double percentile)
+{
+  if (!histogram || !histogram->count) return 0;
+  double rank = histogram->count * percentile / 100;
+  uint64_t seen = 0;
+  for (int i = 0; i < PN_HISTOGRAM_BUCKETS - 1; i++) {
+    seen += histogram->buckets[i];
+    if (seen && seen >= rank) {
+      uint64_t value = pn_histogram_bucket_value(i + 1) - 1;
+      return pn_max(pn_min(value, histogram->max), histogram->min);
+    }
+  }
+  return histogram->max;
+}
+
 // which timestamp will expire next, or zero if none set
 pn_timestamp_t pn_timestamp_min( pn_timestamp_t a, pn_timestamp_t b )
 {
@@ -32,6 +32,7 @@
 #include <sys/types.h>
 #include <proton/types.h>
 #include <proton/object.h>
+#include <proton/stats.h>
 
 PN_EXTERN ssize_t pn_quote_data(char *dst, size_t capacity, const char *src, size_t size);
 int pn_quote(pn_string_t *dst, const char *src, size_t size);
@@ -99,8 +100,29 @@ pn_timestamp_t pn_timestamp_min(pn_timestamp_t a, pn_timestamp_t b);
       LL_TAIL(ROOT, LIST) = (NODE)-> LIST ## _prev;                    \
   }
 
+// insert NODE ahead of NEXT, or at the tail when NEXT is NULL
+#define LL_INSERT(ROOT, LIST, NEXT, NODE)                              \
+  {                                                                    \
+    if (!(NEXT)) {                                                     \
+      LL_ADD(ROOT, LIST, NODE);                                        \
+    } else {                                                           \
+      (NODE)-> LIST ## _next = (NEXT);                                 \
+      (NODE)-> LIST ## _prev = (NEXT)-> LIST ## _prev;                 \
+      if ((NEXT)-> LIST ## _prev)                                      \
+        (NEXT)-> LIST ## _prev-> LIST ## _next = (NODE);               \
+      else                                                             \
+        LL_HEAD(ROOT, LIST) = (NODE);                                  \
+      (NEXT)-> LIST ## _prev = (NODE);                                 \
+    }                                                                  \
+  }
+
 char *pn_strdup(const char *src);
 char *pn_strndup(const char *src, size_t n);
+// FNV-1a, for spreading strings over a few buckets
+uint32_t pn_strhash(const char *str);
+void pn_histogram_record(pn_histogram_t *histogram, uint64_t value);
+// add the values of other to histogram
+void pn_histogram_merge(pn_histogram_t *histogram, const pn_histogram_t *other);
 
 #define pn_min(X,Y) ((X) > (Y) ? (Y) : (X))
 #define pn_max(X,Y) ((X) < (Y) ? (Y) : (X))